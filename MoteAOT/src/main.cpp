@@ -0,0 +1,81 @@
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8AOT.h"
+#include "ROMLoader.h"
+
+// Translates a ROM ahead of time into C++ source for a shared library that
+// MoteEmuCLI --aot loads, and optionally compiles it with the host compiler.
+
+static void PrintUsage(const char* program)
+{
+	printf("Usage: %s <rom> --out FILE [options]\n", program);
+	printf("  --out FILE     C++ source to write\n");
+	printf("  --quirks Q     Quirks the module is compiled for (default: default)\n");
+	printf("  --compile FILE Build the source into a shared library with $CXX (default: c++)\n");
+}
+
+int main(int argc, char** argv) {
+	const char* rom = nullptr;
+	const char* source = nullptr;
+	const char* library = nullptr;
+	Chip8::Quirks quirks = Chip8::DEFAULT_QUIRKS;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--out") == 0 && hasValue)
+			source = argv[++i];
+		else if (strcmp(argv[i], "--compile") == 0 && hasValue)
+			library = argv[++i];
+		else if (strcmp(argv[i], "--quirks") == 0 && hasValue) {
+			if (!Chip8::ParseQuirks(argv[++i], quirks)) {
+				printf("Unknown quirks: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (argv[i][0] != '-' && rom == nullptr)
+			rom = argv[i];
+		else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (rom == nullptr || source == nullptr) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	ROMImage image;
+	ROMLoader::Error error = ROMLoader::Map(rom, image);
+	if (error != ROMLoader::Error::NONE) {
+		printf("Could not load %s: %s\n", rom, ROMLoader::GetErrorName(error));
+		return 1;
+	}
+	std::ofstream out(source);
+	size_t blocks = Chip8AOT::Generate(image.GetData(), image.GetSize(), quirks, out);
+	out.close();
+	if (!out.good()) {
+		printf("Could not write %s\n", source);
+		return 1;
+	}
+	printf("Compiled %llu blocks of %s into %s\n", static_cast<unsigned long long>(blocks), rom, source);
+	if (library == nullptr)
+		return 0;
+
+	const char* compiler = getenv("CXX");
+#ifdef _WIN32
+	std::string command = std::string(compiler ? compiler : "cl") + " /nologo /O2 /LD \"" + source + "\" /Fe\"" + library + "\"";
+#else
+	std::string command = std::string(compiler ? compiler : "c++") + " -O2 -shared -fPIC -o '" + library + "' '" + source + "'";
+#endif // _WIN32
+	printf("%s\n", command.c_str());
+	if (system(command.c_str()) != 0) {
+		printf("Could not compile %s\n", source);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,145 @@
+#include "BatchRunner.h"
+#include "HeadlessVM.h"
+#include "Hash.h"
+
+#include <set>
+
+BatchRunner::BatchRunner(const size_t& threads)
+	:m_Pool(threads)
+{
+}
+
+BatchRunner::~BatchRunner()
+{
+}
+
+bool BatchRunner::SetExecutionMode(const Chip8::ExecutionMode& mode)
+{
+	Chip8 probe;
+	if (!probe.SetExecutionMode(mode))
+		return false;
+	m_ExecutionMode = mode;
+	return true;
+}
+
+void BatchRunner::SetCatalog(ROMCatalog* catalog)
+{
+	m_Catalog = catalog;
+}
+
+size_t BatchRunner::Add(const Job& job)
+{
+	m_Jobs.push_back(job);
+	return m_Jobs.size() - 1;
+}
+
+const std::vector<BatchRunner::Result>& BatchRunner::Run()
+{
+	// ROMs are mapped up front so that the workers only ever read them
+	for (const Job& job : m_Jobs)
+	{
+		if (m_ROMs.count(job.rom) != 0)
+			continue;
+		std::unique_ptr<ROM> rom(new ROM());
+		rom->error = ROMLoader::Map(job.rom.c_str(), rom->image);
+		if (m_Catalog != nullptr && rom->error == ROMLoader::Error::NONE) {
+			rom->entry = m_Catalog->Lookup(rom->image.GetData(), rom->image.GetSize());
+			rom->cataloged = true;
+		}
+		m_ROMs[job.rom] = std::move(rom);
+	}
+	std::set<std::string> named;
+	for (const Job& job : m_Jobs)
+	{
+		ROM& rom = *m_ROMs[job.rom];
+		if (rom.cataloged && job.quirks != ROMCatalog::NO_PLATFORM && named.insert(job.rom).second)
+			m_Catalog->SetPlatform(rom.entry, job.quirks);
+	}
+
+	m_Results.assign(m_Jobs.size(), Result());
+	for (size_t i = 0; i < m_Jobs.size(); i++)
+	{
+		const Job* job = &m_Jobs[i];
+		const ROM* rom = m_ROMs[job->rom].get();
+		Result* result = &m_Results[i];
+		m_Pool.Submit([this, job, rom, result] { RunJob(*job, *rom, *result); });
+	}
+	m_Pool.Wait();
+	return m_Results;
+}
+
+const std::vector<BatchRunner::Result>& BatchRunner::GetResults() const
+{
+	return m_Results;
+}
+
+size_t BatchRunner::GetThreadCount() const
+{
+	return m_Pool.GetThreadCount();
+}
+
+uint64_t BatchRunner::GetSteals() const
+{
+	return m_Pool.GetSteals();
+}
+
+const char* BatchRunner::GetExitReasonName(const ExitReason& reason)
+{
+	switch (reason)
+	{
+	case ExitReason::BUDGET_REACHED:
+		return "budget reached";
+	case ExitReason::PROGRAM_ENDED:
+		return "program ended";
+	case ExitReason::LOAD_FAILED:
+		return "load failed";
+	case ExitReason::CRASHED:
+		return "crashed";
+	default:
+		return "unknown";
+	}
+}
+
+void BatchRunner::RunJob(const Job& job, const ROM& rom, Result& result) const
+{
+	Chip8 chip8;
+	chip8.SetExecutionMode(m_ExecutionMode);
+	chip8.Seed(job.seed);
+	Chip8::Quirks quirks = job.quirks;
+	if (quirks == ROMCatalog::NO_PLATFORM)
+		quirks = rom.cataloged && rom.entry.platform != ROMCatalog::NO_PLATFORM ? rom.entry.platform : Chip8::DEFAULT_QUIRKS;
+	if (!chip8.SetQuirks(quirks)) {
+		result.reason = ExitReason::LOAD_FAILED;
+		result.error = "unknown quirks";
+		return;
+	}
+	HeadlessVM vm(&chip8);
+	ROMLoader::Error error = rom.error;
+	if (error == ROMLoader::Error::NONE)
+		error = vm.Load(rom.image);
+	if (error != ROMLoader::Error::NONE) {
+		result.reason = ExitReason::LOAD_FAILED;
+		result.error = ROMLoader::GetErrorName(error);
+		return;
+	}
+	if (rom.cataloged) // Nothing to translate in the interpreter
+		ROMCatalog::Precompile(rom.entry, chip8);
+	vm.GetScheduler().SetInstructionsPerSecond(job.ips);
+	vm.GetPeripherals().SetKeyState(job.keys);
+
+	try {
+		result.executed = vm.Run(job.cycles);
+		result.reason = result.executed < job.cycles ? ExitReason::PROGRAM_ENDED : ExitReason::BUDGET_REACHED;
+	}
+	catch (const std::exception& error) {
+		result.reason = ExitReason::CRASHED;
+		result.error = error.what();
+		// Run didn't return, the scheduler counted up to the frame it crashed in
+		result.executed = static_cast<size_t>(vm.GetScheduler().GetStats().instructions);
+	}
+
+	// Also filled in for crashed instances, to see how far they got
+	result.stateHash = chip8.GetStateHash();
+	result.display = chip8.GetDisplay();
+	result.framebufferHash = Hash::Fnv1a(result.display.GetRows().data(), sizeof(Display::Rows));
+}
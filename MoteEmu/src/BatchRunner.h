@@ -0,0 +1,84 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Chip8.h"
+#include "ROMLoader.h"
+#include "ROMCatalog.h"
+#include "HeadlessAPI.h"
+#include "Scheduler.h"
+#include "ThreadPool.h"
+
+// Runs many independent Chip8 instances in one process, spread over a
+// ThreadPool. Every instance owns its CPU, memory and peripherals, so they
+// share nothing but the (read-only) ROM images.
+class BatchRunner
+{
+public:
+	enum class ExitReason {
+		BUDGET_REACHED, // Executed all the requested instructions
+		PROGRAM_ENDED,  // PC ran past the end of the program
+		LOAD_FAILED,    // The ROM couldn't be read or didn't fit in memory (or the quirks are unknown)
+		CRASHED         // An exception was thrown (call stack overflow or underflow)
+	};
+
+	struct Job {
+		std::string rom;
+		size_t cycles = 1000000;
+		uint32_t ips = Scheduler::DEFAULT_IPS; // Decides when the timers tick
+		uint16_t keys = 0;  // Held down for the whole run, bit N is key N
+		uint32_t seed = 0;
+		// ROMCatalog::NO_PLATFORM runs the quirks the catalog has for the ROM, or the default ones
+		Chip8::Quirks quirks = Chip8::DEFAULT_QUIRKS;
+	};
+
+	struct Result {
+		ExitReason reason = ExitReason::LOAD_FAILED;
+		size_t executed = 0; // For crashed instances, up to the start of the frame they crashed in
+		uint64_t stateHash = 0;
+		uint64_t framebufferHash = 0;
+		Display display;
+		std::string error;
+	};
+
+	// 0 threads means one per hardware thread
+	explicit BatchRunner(const size_t& threads = 0);
+	~BatchRunner();
+
+	// Returns false if the mode isn't available on this host
+	bool SetExecutionMode(const Chip8::ExecutionMode& mode);
+	// ROMs are looked up in (or added to) the catalog before running, and the
+	// instances start with their blocks translated. The quirks of a ROM's first
+	// job that names them are recorded as its platform. The catalog must not
+	// be saved or reopened while the runner is in use, the runner keeps its entries.
+	void SetCatalog(ROMCatalog* catalog);
+	// Returns the index of the job's result
+	size_t Add(const Job& job);
+	// Runs every job added so far, results are in the order the jobs were added
+	const std::vector<Result>& Run();
+
+	const std::vector<Result>& GetResults() const;
+	size_t GetThreadCount() const;
+	uint64_t GetSteals() const;
+
+	static const char* GetExitReasonName(const ExitReason& reason);
+private:
+	struct ROM {
+		ROMImage image;
+		ROMLoader::Error error = ROMLoader::Error::NONE;
+		bool cataloged = false;
+		ROMCatalog::Entry entry;
+	};
+
+	void RunJob(const Job& job, const ROM& rom, Result& result) const;
+
+	ThreadPool m_Pool;
+	Chip8::ExecutionMode m_ExecutionMode = Chip8::ExecutionMode::INTERPRETER;
+	ROMCatalog* m_Catalog = nullptr;
+	std::vector<Job> m_Jobs;
+	std::vector<Result> m_Results;
+	// Every ROM is mapped once and shared by all its instances, error says why if it couldn't be
+	std::map<std::string, std::unique_ptr<ROM>> m_ROMs;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+// Keeps translated blocks of code by their start address and drops them again
+// when the memory they were translated from is written to.
+// Block must provide `start` and `end` (exclusive) address members.
+template<typename Block, size_t AddressSpace = 4096, size_t PageSize = 64>
+class BlockCache
+{
+public:
+	typedef uint16_t Address;
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t invalidations = 0;
+
+		double HitRate() const;
+	};
+
+	// Returns the block starting at addr or nullptr if there is none
+	Block* Find(const Address& addr);
+	// Takes ownership of a freshly translated block
+	Block* Insert(std::unique_ptr<Block> block);
+	// Drops every block that contains a byte in [addr, addr + size)
+	void Invalidate(const Address& addr, const size_t& size = 1);
+	void Clear();
+
+	const Stats& GetStats() const;
+private:
+	static constexpr const size_t PAGE_COUNT = AddressSpace / PageSize;
+	static_assert((AddressSpace & (AddressSpace - 1)) == 0, "Address space must be a power of 2");
+
+	std::array<std::unique_ptr<Block>, AddressSpace> m_Blocks;
+	// Start addresses of the blocks overlapping each page
+	std::array<std::vector<Address>, PAGE_COUNT> m_Pages;
+	// Invalidated blocks are kept alive until the next lookup as
+	// the write that invalidated them may come from the block itself
+	std::vector<std::unique_ptr<Block>> m_Retired;
+	Stats m_Stats;
+};
+
+template<typename Block, size_t AddressSpace, size_t PageSize>
+inline double BlockCache<Block, AddressSpace, PageSize>::Stats::HitRate() const
+{
+	uint64_t lookups = hits + misses;
+	return lookups ? static_cast<double>(hits) / lookups : 0.0;
+}
+
+template<typename Block, size_t AddressSpace, size_t PageSize>
+inline Block* BlockCache<Block, AddressSpace, PageSize>::Find(const Address& addr)
+{
+	if (!m_Retired.empty())
+		m_Retired.clear();
+	Block* block = m_Blocks[addr & (AddressSpace - 1)].get();
+	if (block != nullptr)
+		m_Stats.hits++;
+	else
+		m_Stats.misses++;
+	return block;
+}
+
+template<typename Block, size_t AddressSpace, size_t PageSize>
+inline Block* BlockCache<Block, AddressSpace, PageSize>::Insert(std::unique_ptr<Block> block)
+{
+	Address start = block->start & (AddressSpace - 1);
+	size_t firstPage = start / PageSize;
+	size_t lastPage = std::min<size_t>((block->end - 1) / PageSize, PAGE_COUNT - 1);
+	for (size_t page = firstPage; page <= lastPage; page++)
+	{
+		std::vector<Address>& starts = m_Pages[page];
+		if (std::find(starts.begin(), starts.end(), start) == starts.end())
+			starts.push_back(start);
+	}
+	m_Blocks[start] = std::move(block);
+	return m_Blocks[start].get();
+}
+
+template<typename Block, size_t AddressSpace, size_t PageSize>
+inline void BlockCache<Block, AddressSpace, PageSize>::Invalidate(const Address& addr, const size_t& size)
+{
+	size_t firstPage = (addr & (AddressSpace - 1)) / PageSize;
+	size_t lastPage = std::min<size_t>((addr + size - 1) / PageSize, PAGE_COUNT - 1);
+	for (size_t page = firstPage; page <= lastPage; page++)
+	{
+		std::vector<Address>& starts = m_Pages[page];
+		for (size_t i = 0; i < starts.size();)
+		{
+			std::unique_ptr<Block>& block = m_Blocks[starts[i]];
+			if (block && block->start < addr + size && addr < block->end) {
+				m_Retired.push_back(std::move(block));
+				m_Stats.invalidations++;
+			}
+			if (!block) {
+				// Either just invalidated or a leftover from an invalidation through another page
+				starts[i] = starts.back();
+				starts.pop_back();
+			}
+			else {
+				i++;
+			}
+		}
+	}
+}
+
+template<typename Block, size_t AddressSpace, size_t PageSize>
+inline void BlockCache<Block, AddressSpace, PageSize>::Clear()
+{
+	for (std::unique_ptr<Block>& block : m_Blocks)
+	{
+		if (block)
+			m_Retired.push_back(std::move(block));
+	}
+	for (std::vector<Address>& starts : m_Pages)
+		starts.clear();
+}
+
+template<typename Block, size_t AddressSpace, size_t PageSize>
+inline const typename BlockCache<Block, AddressSpace, PageSize>::Stats& BlockCache<Block, AddressSpace, PageSize>::GetStats() const
+{
+	return m_Stats;
+}
@@ -4,7 +4,7 @@
 CPU::CPU()
 {}
 
-CPU::CPU(Memory* RAM, SDLAPI* peripherals)
+CPU::CPU(Memory* RAM, Peripherals* peripherals)
 	:m_RAM(RAM), m_Peripherals(peripherals)
 {}
 
@@ -12,7 +12,7 @@ CPU::~CPU()
 {
 }
 
-void CPU::UsePeripherals(SDLAPI* peripherals)
+void CPU::UsePeripherals(Peripherals* peripherals)
 {
 	m_Peripherals = peripherals;
 }
@@ -21,3 +21,16 @@ void CPU::UseMemory(Memory* RAM)
 {
 	m_RAM = RAM;
 }
+
+bool CPU::LoadProgram(const Memory& program)
+{
+	return LoadProgram(program.data(), program.size());
+}
+
+size_t CPU::Run(const size_t& cycles)
+{
+	size_t executed = 0;
+	while (executed < cycles && ExecuteInstruction())
+		executed++;
+	return executed;
+}
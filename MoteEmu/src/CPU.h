@@ -1,9 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <stdexcept>
+#include <cstdlib>
 #include <stdint.h>
 
-#include "SDLAPI.h"
+#include "Peripherals.h"
 
 typedef unsigned char Byte;
 typedef std::vector<Byte> Memory;
@@ -25,20 +27,40 @@ public:
 	typedef uint32_t Opcode;
 
 	explicit CPU();
-	explicit CPU(Memory* RAM, SDLAPI* peripherals);
+	explicit CPU(Memory* RAM, Peripherals* peripherals);
 	virtual ~CPU();
 
 	void UseMemory(Memory* RAM);
-	void UsePeripherals(SDLAPI* peripherals);
+	void UsePeripherals(Peripherals* peripherals);
 	
 	virtual void Init() = 0;
 	virtual void Reset() = 0;
-	virtual void LoadProgram(const Memory&) = 0;
+	// Copies a program into memory and resets the machine to run it. Returns
+	// false, leaving the machine untouched, if it's larger than GetMaxProgramSize().
+	virtual bool LoadProgram(const Byte* program, const size_t& size) = 0;
+	bool LoadProgram(const Memory& program);
+	virtual size_t GetMaxProgramSize() const = 0;
 	virtual bool ExecuteInstruction() = 0;
+	// Executes up to `cycles` instructions and returns how many were executed.
+	// Returns less than requested only if the program ran off its end.
+	virtual size_t Run(const size_t& cycles);
+	// Advances the timers by one 60 Hz tick
+	virtual void TickTimers() = 0;
+	// Makes the random number generator reproducible
+	virtual void Seed(const uint32_t& seed) = 0;
+	// The screen as drawn so far, for the peripherals to present
+	virtual const Display& GetDisplay() const = 0;
+
+	// Save states: a binary snapshot of the whole machine, written to a buffer
+	// of GetSaveStateSize() bytes. SaveState returns the bytes written (0 if
+	// the buffer is too small), LoadState false if the data doesn't fit this machine.
+	virtual size_t GetSaveStateSize() const = 0;
+	virtual size_t SaveState(Byte* buffer, const size_t& capacity) const = 0;
+	virtual bool LoadState(const Byte* data, const size_t& size) = 0;
 
 protected:
 	Memory* m_RAM;
-	SDLAPI* m_Peripherals;
+	Peripherals* m_Peripherals;
 };
 
 template<typename T>
@@ -49,7 +71,7 @@ inline CPU::Stack<T>::Stack(T* baseAddr, const size_t& size)
 template<typename T>
 inline void CPU::Stack<T>::push(const T & val)
 {
-	if (std::abs(m_SBP - m_SP) > m_Size)
+	if (static_cast<size_t>(m_SP - m_SBP) >= m_Size)
 		throw std::overflow_error("Stack overflow!");
 	*(m_SP++) = val;
 }
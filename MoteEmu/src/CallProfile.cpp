@@ -0,0 +1,135 @@
+#include "CallProfile.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+
+CallProfile::CallProfile(const Address& root)
+	:m_Root(root)
+{
+	Reset();
+}
+
+CallProfile::~CallProfile()
+{
+}
+
+void CallProfile::Reset()
+{
+	m_Nodes.clear();
+	m_Nodes.push_back(Node());
+	m_Nodes[0].entry = m_Root;
+	m_Nodes[0].parent = 0;
+	m_Stack.assign(1, 0);
+}
+
+void CallProfile::SetDepth(const size_t& depth)
+{
+	m_Stack.resize(std::min(m_Stack.size(), depth + 1));
+	while (m_Stack.size() < depth + 1)
+		m_Stack.push_back(Child(m_Stack.back(), UNKNOWN_ENTRY));
+}
+
+uint32_t CallProfile::Child(const uint32_t& parent, const Address& entry)
+{
+	for (uint32_t child : m_Nodes[parent].children)
+	{
+		if (m_Nodes[child].entry == entry)
+			return child;
+	}
+	if (m_Nodes.size() == MAX_NODES)
+		return parent;
+	uint32_t child = static_cast<uint32_t>(m_Nodes.size());
+	m_Nodes.push_back(Node());
+	m_Nodes[child].entry = entry;
+	m_Nodes[child].parent = parent;
+	m_Nodes[parent].children.push_back(child);
+	return child;
+}
+
+std::vector<CallProfile::Subroutine> CallProfile::GetSubroutines() const
+{
+	// Children always come after their parent, so a reverse pass sums the subtrees
+	std::vector<uint64_t> total(m_Nodes.size());
+	for (size_t i = m_Nodes.size(); i-- > 0;)
+	{
+		total[i] += m_Nodes[i].self;
+		if (i != 0)
+			total[m_Nodes[i].parent] += total[i];
+	}
+
+	std::unordered_map<Address, Subroutine> subroutines;
+	for (size_t i = 0; i < m_Nodes.size(); i++)
+	{
+		const Node& node = m_Nodes[i];
+		Subroutine& subroutine = subroutines.emplace(node.entry, Subroutine{ node.entry, 0, 0, 0 }).first->second;
+		subroutine.calls += node.calls;
+		subroutine.exclusive += node.self;
+
+		// A recursive call is already part of the outer call's subtree
+		bool recursive = false;
+		for (size_t ancestor = i; ancestor != 0 && !recursive;)
+		{
+			ancestor = m_Nodes[ancestor].parent;
+			recursive = m_Nodes[ancestor].entry == node.entry;
+		}
+		if (!recursive)
+			subroutine.inclusive += total[i];
+	}
+
+	std::vector<Subroutine> sorted;
+	for (const auto& pair : subroutines)
+		sorted.push_back(pair.second);
+	std::sort(sorted.begin(), sorted.end(), [](const Subroutine& lhs, const Subroutine& rhs) {
+		return lhs.exclusive != rhs.exclusive ? lhs.exclusive > rhs.exclusive : lhs.entry < rhs.entry;
+	});
+	return sorted;
+}
+
+void CallProfile::AppendName(std::string& path, const Address& entry) const
+{
+	char name[8];
+	if (entry == UNKNOWN_ENTRY)
+		snprintf(name, sizeof(name), "?");
+	else
+		snprintf(name, sizeof(name), "0x%03X", static_cast<unsigned>(entry));
+	path += name;
+}
+
+void CallProfile::WriteFolded(std::ostream& out) const
+{
+	std::vector<std::string> paths(m_Nodes.size());
+	for (size_t i = 0; i < m_Nodes.size(); i++)
+	{
+		if (i != 0)
+			paths[i] = paths[m_Nodes[i].parent] + ";";
+		AppendName(paths[i], m_Nodes[i].entry);
+		if (m_Nodes[i].self != 0)
+			out << paths[i] << " " << m_Nodes[i].self << "\n";
+	}
+}
+
+void CallProfile::WriteTop(std::ostream& out, const size_t& count) const
+{
+	std::vector<Subroutine> subroutines = GetSubroutines();
+	uint64_t instructions = 0;
+	for (const Subroutine& subroutine : subroutines)
+		instructions += subroutine.exclusive;
+	double scale = instructions ? 100.0 / instructions : 0.0;
+
+	char line[128];
+	snprintf(line, sizeof(line), "%-8s %12s %14s %8s %14s %8s\n", "entry", "calls", "inclusive", "%", "exclusive", "%");
+	out << line;
+	for (size_t i = 0; i < subroutines.size() && i < count; i++)
+	{
+		const Subroutine& subroutine = subroutines[i];
+		std::string name;
+		AppendName(name, subroutine.entry);
+		snprintf(line, sizeof(line), "%-8s %12llu %14llu %7.2f%% %14llu %7.2f%%\n", name.c_str(),
+			static_cast<unsigned long long>(subroutine.calls),
+			static_cast<unsigned long long>(subroutine.inclusive), subroutine.inclusive * scale,
+			static_cast<unsigned long long>(subroutine.exclusive), subroutine.exclusive * scale);
+		out << line;
+	}
+}
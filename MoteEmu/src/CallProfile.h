@@ -0,0 +1,81 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CPU.h"
+
+// Instruction counts per subroutine, kept on a shadow of the 2NNN/00EE call
+// stack. Every distinct chain of calls is a node of a call tree, instructions
+// are counted on the node of the innermost running subroutine. Subroutines
+// are identified by their entry address, the program itself is the root at
+// its load address. Part of ExecutionProfile, so only in MOTE_PROFILE builds.
+class CallProfile
+{
+public:
+	typedef uint16_t Address;
+	static constexpr const size_t MAX_NODES = 1 << 16; // Deeper chains are counted on the last node that fit
+	static constexpr const Address UNKNOWN_ENTRY = 0xFFFF; // Frames restored from a save state
+
+	struct Subroutine {
+		Address entry;
+		uint64_t calls;
+		uint64_t inclusive; // Instructions in the subroutine and everything it called
+		uint64_t exclusive; // Instructions in the subroutine itself
+	};
+
+	explicit CallProfile(const Address& root);
+	~CallProfile();
+
+	void Reset();
+
+	inline void Count();
+	inline void Call(const Address& entry);
+	inline void Return();
+	// Matches the shadow stack to a call stack of the given depth, e.g. after
+	// a save state was loaded. Frames that have to be added are unknown ones.
+	void SetDepth(const size_t& depth);
+
+	// Per entry address, sorted by exclusive count. Recursive calls count once towards inclusive.
+	std::vector<Subroutine> GetSubroutines() const;
+	// One line per call chain, "0x200;0x2A0;0x310 count", the input format of
+	// flamegraph.pl and compatible tools
+	void WriteFolded(std::ostream& out) const;
+	// The `count` subroutines with the most exclusive instructions
+	void WriteTop(std::ostream& out, const size_t& count) const;
+private:
+	struct Node {
+		Address entry;
+		uint32_t parent;
+		uint64_t calls = 0;
+		uint64_t self = 0;
+		std::vector<uint32_t> children;
+	};
+
+	uint32_t Child(const uint32_t& parent, const Address& entry);
+	void AppendName(std::string& path, const Address& entry) const;
+
+	Address m_Root;
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_Stack; // Shadow call stack, the running subroutine's node is on top
+};
+
+inline void CallProfile::Count()
+{
+	m_Nodes[m_Stack.back()].self++;
+}
+
+inline void CallProfile::Call(const Address& entry)
+{
+	uint32_t node = Child(m_Stack.back(), entry);
+	m_Nodes[node].calls++;
+	m_Stack.push_back(node);
+}
+
+inline void CallProfile::Return()
+{
+	// The CPU throws on a return with an empty stack
+	if (m_Stack.size() > 1)
+		m_Stack.pop_back();
+}
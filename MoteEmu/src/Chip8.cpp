@@ -1,23 +1,164 @@
 #include "Chip8.h"
-
-
+#include "Chip8AOT.h"
+#include "Chip8JIT.h"
+#include "Hash.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <type_traits>
+
+#ifdef MOTE_PROFILE
+#include "ExecutionProfile.h"
+#define PROFILE(call) m_Profile->call
+#define PROFILING true
+#else
+#define PROFILE(call)
+#define PROFILING false
+#endif // MOTE_PROFILE
+
+#ifdef MOTE_TRACE
+#include "Tracer.h"
+#define TRACE_BEGIN(pc) const Address tracePC = (pc); const Register16 traceI = m_I
+#define TRACE_END(opcode) if (m_Tracer) TraceInstruction(tracePC, opcode, traceI)
+#define TRACING (m_Tracer != nullptr)
+#else
+#define TRACE_BEGIN(pc)
+#define TRACE_END(opcode)
+#define TRACING false
+#endif // MOTE_TRACE
+
+// Builds the opcode -> instruction id table at compile time
+static constexpr Chip8::DecodeTable BuildDecodeTable()
+{
+	Chip8::DecodeTable table = {};
+	for (size_t opcode = 0; opcode < table.size(); opcode++)
+		table[opcode] = Chip8::Decode(static_cast<CPU::Opcode>(opcode));
+	return table;
+}
+
+const Chip8::DecodeTable Chip8::s_DecodeTable = BuildDecodeTable();
+
+template<Chip8::Quirks Q>
+const Chip8::HandlerTable Chip8::s_Handlers = {
+	&Chip8::InstructionUnknown,
+	&Chip8::Instruction0NNN, &Chip8::Instruction00E0, &Chip8::Instruction00EE, &Chip8::Instruction1NNN,
+	&Chip8::Instruction2NNN, &Chip8::Instruction3XNN, &Chip8::Instruction4XNN, &Chip8::Instruction5XY0,
+	&Chip8::Instruction6XNN, &Chip8::Instruction7XNN, &Chip8::Instruction8XY0, &Chip8::Instruction8XY1,
+	&Chip8::Instruction8XY2, &Chip8::Instruction8XY3, &Chip8::Instruction8XY4, &Chip8::Instruction8XY5,
+	&Chip8::Instruction8XY6<Q>, &Chip8::Instruction8XY7, &Chip8::Instruction8XYE<Q>, &Chip8::Instruction9XY0,
+	&Chip8::InstructionANNN, &Chip8::InstructionBNNN<Q>, &Chip8::InstructionCXNN, &Chip8::InstructionDXYN<Q>,
+	&Chip8::InstructionEX9E, &Chip8::InstructionEXA1, &Chip8::InstructionFX07, &Chip8::InstructionFX0A,
+	&Chip8::InstructionFX15, &Chip8::InstructionFX18, &Chip8::InstructionFX1E, &Chip8::InstructionFX29,
+	&Chip8::InstructionFX33, &Chip8::InstructionFX55<Q>, &Chip8::InstructionFX65<Q>
+};
+
+template<size_t... Q>
+constexpr std::array<const Chip8::HandlerTable*, sizeof...(Q)> Chip8::MakeHandlerTables(std::index_sequence<Q...>)
+{
+	return { &s_Handlers<static_cast<Quirks>(Q)>... };
+}
+
+const std::array<const Chip8::HandlerTable*, 1 << Chip8::QUIRK_COUNT> Chip8::s_HandlerTables =
+	MakeHandlerTables(std::make_index_sequence<1 << QUIRK_COUNT>());
+
+// Platforms for ParseQuirks
+static const struct {
+	const char* name;
+	Chip8::Quirks quirks;
+} s_QuirkProfiles[] = {
+	{ "default", Chip8::DEFAULT_QUIRKS },
+	{ "vip", Chip8::LOAD_STORE_INCREMENT }, // The original COSMAC VIP interpreter
+	{ "schip", Chip8::SHIFT_VX | Chip8::JUMP_VX },
+	{ "xochip", Chip8::LOAD_STORE_INCREMENT | Chip8::SPRITE_WRAP }
+};
+
+#ifdef MOTE_MAP_DISPATCH
+const std::array<Chip8::OpcodeMask, 4> Chip8::s_OpcodeMasks = { 0xFFFF, 0xF0FF, 0xF00F, 0xF000 };
+const Chip8::InstructionMap Chip8::s_Instructions = {
+	{ 0x0000, InstructionId::OP_0NNN },
+	{ 0x00E0, InstructionId::OP_00E0 },
+	{ 0x00EE, InstructionId::OP_00EE },
+	{ 0x1000, InstructionId::OP_1NNN },
+	{ 0x2000, InstructionId::OP_2NNN },
+	{ 0x3000, InstructionId::OP_3XNN },
+	{ 0x4000, InstructionId::OP_4XNN },
+	{ 0x5000, InstructionId::OP_5XY0 },
+	{ 0x6000, InstructionId::OP_6XNN },
+	{ 0x7000, InstructionId::OP_7XNN },
+	{ 0x8000, InstructionId::OP_8XY0 },
+	{ 0x8001, InstructionId::OP_8XY1 },
+	{ 0x8002, InstructionId::OP_8XY2 },
+	{ 0x8003, InstructionId::OP_8XY3 },
+	{ 0x8004, InstructionId::OP_8XY4 },
+	{ 0x8005, InstructionId::OP_8XY5 },
+	{ 0x8006, InstructionId::OP_8XY6 },
+	{ 0x8007, InstructionId::OP_8XY7 },
+	{ 0x800E, InstructionId::OP_8XYE },
+	{ 0x9000, InstructionId::OP_9XY0 },
+	{ 0xA000, InstructionId::OP_ANNN },
+	{ 0xB000, InstructionId::OP_BNNN },
+	{ 0xC000, InstructionId::OP_CXNN },
+	{ 0xD000, InstructionId::OP_DXYN },
+	{ 0xE09E, InstructionId::OP_EX9E },
+	{ 0xE0A1, InstructionId::OP_EXA1 },
+	{ 0xF007, InstructionId::OP_FX07 },
+	{ 0xF00A, InstructionId::OP_FX0A },
+	{ 0xF015, InstructionId::OP_FX15 },
+	{ 0xF018, InstructionId::OP_FX18 },
+	{ 0xF01E, InstructionId::OP_FX1E },
+	{ 0xF029, InstructionId::OP_FX29 },
+	{ 0xF033, InstructionId::OP_FX33 },
+	{ 0xF055, InstructionId::OP_FX55 },
+	{ 0xF065, InstructionId::OP_FX65 }
+};
+#endif // MOTE_MAP_DISPATCH
+
+static const std::array<const char*, static_cast<size_t>(Chip8::InstructionId::COUNT)> s_InstructionNames = {
+	"UNKNOWN",
+	"0NNN", "00E0", "00EE", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0",
+	"6XNN", "7XNN", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5",
+	"8XY6", "8XY7", "8XYE", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN",
+	"EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29",
+	"FX33", "FX55", "FX65"
+};
+
+const std::array<Byte, 80> Chip8::FONT = {
+	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+	0x20, 0x60, 0x20, 0x20, 0x70, // 1
+	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+	0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+	0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+	0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+	0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+	0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+	0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+	0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+	0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+	0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+	0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+	0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+	0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
 
 Chip8::Chip8()
 {
-	m_RNG.seed(std::random_device()());
+	m_RNG.Seed(std::random_device()());
+#ifdef MOTE_PROFILE
+	m_Profile.reset(new ExecutionProfile());
+#endif // MOTE_PROFILE
 }
 
 
 Chip8::~Chip8()
 {
-	delete m_SP;
 }
 
 void Chip8::Init()
 {
-	m_SP = new CPU::Stack<int16_t>(reinterpret_cast<int16_t*>(&m_RAM->front()), 16);
 	InitFonts();
-	printf_s("Chip8 initialized! Memory capacity: %uB\n", m_RAM->size());
 }
 
 void Chip8::Reset()
@@ -26,16 +167,32 @@ void Chip8::Reset()
 	m_I = NULLPTR;
 	m_PC = USER_SPACE_ADDR;
 	m_ProgramEnd = USER_SPACE_ADDR;
+	m_StackDepth = 0;
 	m_Delay = m_Sound = 0;
 }
 
-void Chip8::LoadProgram(const Memory & mem)
+bool Chip8::LoadProgram(const Byte* program, const size_t& size)
 {
-	if (mem.size() + USER_SPACE_ADDR > m_RAM->size())
-		throw "Memory insufficient!";
+	if (size > GetMaxProgramSize())
+		return false;
 	Reset();
-	std::copy(mem.begin(), mem.end(), m_RAM->begin() + USER_SPACE_ADDR);
-	m_ProgramEnd = USER_SPACE_ADDR + mem.size();
+	m_Display.Clear();
+	m_Memory.fill(0);
+	InitFonts();
+	std::copy_n(program, size, m_Memory.begin() + USER_SPACE_ADDR);
+	m_ProgramEnd = static_cast<Address>(USER_SPACE_ADDR + size);
+	if (m_BlockCache)
+		m_BlockCache->Clear();
+	PROFILE(Reset());
+	if (m_JIT)
+		m_JIT->Reset();
+	m_AOT = nullptr;
+	return true;
+}
+
+size_t Chip8::GetMaxProgramSize() const
+{
+	return RAM_SIZE - USER_SPACE_ADDR;
 }
 
 bool Chip8::ExecuteInstruction()
@@ -44,274 +201,625 @@ bool Chip8::ExecuteInstruction()
 	if(!ReadInsruction(opcode))
 		return false;
 
-	//printf_s("Instruction received: 0x%X\n", opcode);
-	
+	PROFILE(Record(m_PC - INSTRUCTION_SIZE, opcode, s_DecodeTable[opcode]));
+	TRACE_BEGIN(m_PC - INSTRUCTION_SIZE);
+
+#ifdef MOTE_MAP_DISPATCH
 	InstructionMap::const_iterator it;
-	for (size_t i = 0; i < m_OpcodeMasks.size(); i++)
+	for (size_t i = 0; i < s_OpcodeMasks.size(); i++)
 	{
 		// Check if the opcode masked the current mask is in the map of valid instructions 
-		it = m_Instructions.find(opcode & m_OpcodeMasks.at(i));
-		if (it != m_Instructions.end()) {
-			(this->*(it->second))(opcode); // Call the instruction handler
+		it = s_Instructions.find(opcode & s_OpcodeMasks[i]);
+		if (it != s_Instructions.end()) {
+			(this->*(*m_Handlers)[static_cast<size_t>(it->second)])(MakeInstruction(opcode)); // Call the instruction handler
+			TRACE_END(opcode);
 			return true;
 		}
 	}
+	InstructionUnknown(MakeInstruction(opcode));
+#else
+	InstructionId id = s_DecodeTable[opcode];
+	(this->*(*m_Handlers)[static_cast<size_t>(id)])(MakeInstruction(opcode)); // Call the instruction handler
+#endif // MOTE_MAP_DISPATCH
+	TRACE_END(opcode);
+	return true;
+}
+
+size_t Chip8::Run(const size_t& cycles)
+{
+	bool skipIdle = m_IdleSkipping && !TRACING && !PROFILING;
+	size_t executed = 0;
+	if (m_ExecutionMode == ExecutionMode::INTERPRETER) {
+		while (executed < cycles)
+		{
+			Address pc = m_PC;
+			if (!ExecuteInstruction())
+				break;
+			executed++;
+			if (m_PC <= pc && skipIdle && executed < cycles && !BackOffIdleCheck())
+				executed += SkipIdleLoop(cycles - executed);
+		}
+		return executed;
+	}
+
+	while (executed < cycles && m_PC <= m_ProgramEnd)
+	{
+		Block* block = m_BlockCache->Find(m_PC);
+		if (block == nullptr)
+			block = TranslateBlock(m_PC);
+
+		// Run the compiled prefix first (if any) and interpret the rest.
+		// The budget may end in the middle of the block, the rest of it
+		// then becomes a block of its own on the next call.
+		size_t native = 0;
+		if (m_JIT && !TRACING)
+			native = m_JIT->Execute(*block, cycles - executed);
+		else if (block->native != nullptr && block->nativeLength <= cycles - executed && !TRACING) {
+			native = block->native(m_V.data(), &m_I, &m_PC); // Compiled ahead of time
+			m_AOTInstructions += native;
+		}
+		size_t count = std::min(block->code.size(), cycles - executed); // native never exceeds the budget
+#ifdef MOTE_PROFILE
+		for (size_t i = 0; i < native; i++)
+		{
+			Opcode opcode = block->code[i].instruction.opcode;
+			m_Profile->Record(block->start + static_cast<Address>(i * INSTRUCTION_SIZE), opcode, s_DecodeTable[opcode]);
+		}
+#endif // MOTE_PROFILE
+		for (size_t i = native; i < count; i++)
+		{
+			const CachedInstruction& entry = block->code[i];
+			PROFILE(Record(m_PC, entry.instruction.opcode, s_DecodeTable[entry.instruction.opcode]));
+			TRACE_BEGIN(m_PC);
+			m_PC += INSTRUCTION_SIZE;
+			(this->*entry.handler)(entry.instruction);
+			TRACE_END(entry.instruction.opcode);
+		}
+		executed += count;
+		if (m_PC <= block->start && skipIdle && executed < cycles && !BackOffIdleCheck())
+			executed += SkipIdleLoop(cycles - executed);
+	}
+	return executed;
+}
+
+bool Chip8::SetExecutionMode(const ExecutionMode& mode)
+{
+	if (mode == ExecutionMode::JIT && !Chip8JIT::IsSupported())
+		return false;
+	m_ExecutionMode = mode;
+	if (mode == ExecutionMode::INTERPRETER)
+		m_BlockCache.reset();
+	else
+		m_BlockCache.reset(new InstructionCache());
+	if (mode == ExecutionMode::JIT)
+		m_JIT.reset(new Chip8JIT(*this));
+	else
+		m_JIT.reset();
+	return true;
+}
+
+void Chip8::TickTimers()
+{
+	PROFILE(TickTimers());
+	if (m_Delay > 0)
+		m_Delay--;
+	if (m_Sound > 0)
+		m_Sound--;
+}
+
+const Display& Chip8::GetDisplay() const
+{
+	return m_Display;
+}
+
+Chip8::ExecutionMode Chip8::GetExecutionMode() const
+{
+	return m_ExecutionMode;
+}
+
+bool Chip8::Precompile(const Address& start, const size_t& count)
+{
+	if (!m_BlockCache || start > m_ProgramEnd)
+		return false;
+	std::unique_ptr<Block> block = DecodeBlock(start);
+	if (block->code.size() != count)
+		return false;
+	m_BlockCache->Insert(std::move(block));
+	return true;
+}
+
+const Chip8::InstructionCache::Stats& Chip8::GetCacheStats() const
+{
+	static const InstructionCache::Stats none;
+	return m_BlockCache ? m_BlockCache->GetStats() : none;
+}
+
+Chip8JIT* Chip8::GetJIT() const
+{
+	return m_JIT.get();
+}
+
+bool Chip8::SetAOT(const Chip8AOT* module)
+{
+	if (module != nullptr) {
+		const Chip8AOT::Module& header = module->GetModule();
+		uint64_t romHash = Hash::Fnv1a(m_Memory.data() + USER_SPACE_ADDR, m_ProgramEnd - USER_SPACE_ADDR);
+		if (header.quirks != m_Quirks || header.romHash != romHash)
+			return false;
+	}
+	m_AOT = module;
+	// Blocks translated so far get the module's code when they're translated again
+	if (m_BlockCache)
+		m_BlockCache->Clear();
+	if (m_JIT)
+		m_JIT->Reset();
+	return true;
+}
+
+uint64_t Chip8::GetAOTInstructions() const
+{
+	return m_AOTInstructions;
+}
+
+void Chip8::SetIdleSkipping(const bool& enabled)
+{
+	m_IdleSkipping = enabled;
+}
+
+uint64_t Chip8::GetIdleCycles() const
+{
+	return m_IdleCycles;
+}
 
-	printf_s("Unknown instruction 0x%X! Skipping...\n", opcode);
+bool Chip8::SetQuirks(const Quirks& quirks)
+{
+	if (quirks >= s_HandlerTables.size())
+		return false;
+	if (m_AOT && m_AOT->GetModule().quirks != quirks)
+		m_AOT = nullptr;
+	m_Quirks = quirks;
+	m_Handlers = s_HandlerTables[quirks];
+	// Translated blocks point to the old handlers, compiled ones follow the old quirks
+	if (m_BlockCache)
+		m_BlockCache->Clear();
+	if (m_JIT)
+		m_JIT->Reset();
 	return true;
 }
 
-void Chip8::Instruction0NNN(const Opcode& opcode)
+Chip8::Quirks Chip8::GetQuirks() const
+{
+	return m_Quirks;
+}
+
+bool Chip8::ParseQuirks(const char* text, Quirks& quirks)
 {
-	printf_s("Got an unimplented SYS instruction (Opcode: 0x%X). Skipping...\n", opcode);
+	for (const auto& profile : s_QuirkProfiles)
+	{
+		if (strcmp(text, profile.name) == 0) {
+			quirks = profile.quirks;
+			return true;
+		}
+	}
+	char* end = nullptr;
+	unsigned long mask = strtoul(text, &end, 0);
+	if (end == text || *end != '\0' || mask >= s_HandlerTables.size())
+		return false;
+	quirks = static_cast<Quirks>(mask);
+	return true;
 }
 
-void Chip8::Instruction00E0(const Opcode& opcode)
+const char* Chip8::GetQuirkName(const Quirk& quirk)
 {
-	if (!m_Peripherals->ClearScreen())
-		printf_s("Failed to clear the screen! %s\n", SDL_GetError());
+	switch (quirk)
+	{
+	case SHIFT_VX:
+		return "shift_vx";
+	case LOAD_STORE_INCREMENT:
+		return "load_store_increment";
+	case SPRITE_WRAP:
+		return "sprite_wrap";
+	case JUMP_VX:
+		return "jump_vx";
+	default:
+		return "unknown";
+	}
 }
 
-void Chip8::Instruction00EE(const Opcode& opcode)
+#ifdef MOTE_PROFILE
+ExecutionProfile& Chip8::GetProfile()
 {
-	m_PC = static_cast<Address>(m_SP->pop());
+	return *m_Profile;
 }
+#endif // MOTE_PROFILE
 
-void Chip8::Instruction1NNN(const Opcode& opcode)
+#ifdef MOTE_TRACE
+void Chip8::SetTracer(Tracer* tracer)
 {
-	m_PC = ExtractAddress(opcode);
+	m_Tracer = tracer;
 }
+#endif // MOTE_TRACE
 
-void Chip8::Instruction2NNN(const Opcode& opcode)
+void Chip8::Seed(const uint32_t& seed)
 {
-	m_SP->push(m_PC);
-	m_PC = ExtractAddress(opcode);
+	m_RNG.Seed(seed);
 }
 
-void Chip8::Instruction3XNN(const Opcode& opcode)
+uint64_t Chip8::GetStateHash() const
 {
-	if (GetRegisterValue(opcode, false) == ExtractByte(opcode))
+	uint64_t hash = Hash::Fnv1a(m_V.data(), m_V.size());
+	hash = Hash::Fnv1aValue(m_I, hash);
+	hash = Hash::Fnv1aValue(m_PC, hash);
+	hash = Hash::Fnv1aValue(m_Delay, hash);
+	hash = Hash::Fnv1aValue(m_Sound, hash);
+	hash = Hash::Fnv1aValue(m_StackDepth, hash);
+	hash = Hash::Fnv1a(m_Stack.data(), m_StackDepth * sizeof(Address), hash);
+	return Hash::Fnv1a(m_Memory.data(), m_Memory.size(), hash);
+}
+
+size_t Chip8::GetSaveStateSize() const
+{
+	return sizeof(SaveStateHeader) + sizeof(m_RNG) + RAM_SIZE;
+}
+
+size_t Chip8::SaveState(Byte* buffer, const size_t& capacity) const
+{
+	static_assert(std::is_trivially_copyable<Random>::value, "The RNG is saved as raw bytes");
+	size_t size = GetSaveStateSize();
+	if (capacity < size)
+		return 0;
+
+	SaveStateHeader header;
+	header.magic = SAVE_STATE_MAGIC;
+	header.version = SAVE_STATE_VERSION;
+	header.rngSize = static_cast<uint16_t>(sizeof(m_RNG));
+	header.ramSize = static_cast<uint32_t>(RAM_SIZE);
+	header.v = m_V;
+	header.i = m_I;
+	header.pc = m_PC;
+	header.programEnd = m_ProgramEnd;
+	header.stackDepth = m_StackDepth;
+	header.stack = m_Stack;
+	header.delay = m_Delay;
+	header.sound = m_Sound;
+	header.display = m_Display.GetRows();
+
+	std::memcpy(buffer, &header, sizeof(header));
+	std::memcpy(buffer + sizeof(header), &m_RNG, sizeof(m_RNG));
+	std::memcpy(buffer + sizeof(header) + sizeof(m_RNG), m_Memory.data(), RAM_SIZE);
+	return size;
+}
+
+bool Chip8::LoadState(const Byte* data, const size_t& size)
+{
+	SaveStateHeader header;
+	if (size != GetSaveStateSize())
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != SAVE_STATE_MAGIC || header.version != SAVE_STATE_VERSION
+		|| header.rngSize != sizeof(m_RNG) || header.ramSize != RAM_SIZE || header.stackDepth > STACK_SIZE)
+		return false;
+
+	m_V = header.v;
+	m_I = header.i;
+	m_PC = header.pc;
+	m_ProgramEnd = header.programEnd;
+	m_StackDepth = static_cast<Byte>(header.stackDepth);
+	m_Stack = header.stack;
+	PROFILE(GetCalls().SetDepth(header.stackDepth));
+	m_Delay = header.delay;
+	m_Sound = header.sound;
+	m_Display.SetRows(header.display);
+	std::memcpy(&m_RNG, data + sizeof(header), sizeof(m_RNG));
+
+	// Only the changed span of RAM is copied and only the blocks over it are
+	// retranslated, snapshots of the same run usually differ in a few bytes
+	const Byte* ram = data + sizeof(header) + sizeof(m_RNG);
+	size_t first = 0;
+	size_t last = RAM_SIZE;
+	if (std::memcmp(m_Memory.data(), ram, last) != 0) {
+		while (m_Memory[first] == ram[first])
+			first++;
+		while (m_Memory[last - 1] == ram[last - 1])
+			last--;
+		std::memcpy(m_Memory.data() + first, ram + first, last - first);
+		if (m_BlockCache)
+			m_BlockCache->Invalidate(static_cast<Address>(first), last - first);
+	}
+	return true;
+}
+
+const char* Chip8::GetInstructionName(const InstructionId& id)
+{
+	return s_InstructionNames[static_cast<size_t>(id)];
+}
+
+Chip8::Instruction Chip8::MakeInstruction(const Opcode& opcode)
+{
+	return {
+		opcode,
+		ExtractAddress(opcode),
+		static_cast<Byte>(ExtractRegisterId(opcode, false)),
+		static_cast<Byte>(ExtractRegisterId(opcode, true)),
+		ExtractNibble(opcode),
+		ExtractByte(opcode)
+	};
+}
+
+void Chip8::InstructionUnknown(const Instruction& instruction)
+{
+	LOG(WARNING, "Unknown instruction 0x%X! Skipping...", instruction.opcode);
+}
+
+void Chip8::Instruction0NNN(const Instruction& instruction)
+{
+	LOG(NOTICE, "Got an unimplemented SYS instruction (Opcode: 0x%X). Skipping...", instruction.opcode);
+}
+
+void Chip8::Instruction00E0(const Instruction& instruction)
+{
+	m_Display.Clear();
+}
+
+void Chip8::Instruction00EE(const Instruction& instruction)
+{
+	if (m_StackDepth == 0)
+		throw std::underflow_error("Stack underflow!");
+	m_PC = m_Stack[--m_StackDepth];
+}
+
+void Chip8::Instruction1NNN(const Instruction& instruction)
+{
+	m_PC = instruction.nnn;
+}
+
+void Chip8::Instruction2NNN(const Instruction& instruction)
+{
+	if (m_StackDepth == STACK_SIZE)
+		throw std::overflow_error("Stack overflow!");
+	m_Stack[m_StackDepth++] = m_PC;
+	m_PC = instruction.nnn;
+}
+
+void Chip8::Instruction3XNN(const Instruction& instruction)
+{
+	if (m_V[instruction.x] == instruction.nn)
 		m_PC += INSTRUCTION_SIZE; // Skip 1 instruction
 }
 
-void Chip8::Instruction4XNN(const Opcode& opcode)
+void Chip8::Instruction4XNN(const Instruction& instruction)
 {
-	if (GetRegisterValue(opcode, false) != ExtractByte(opcode))
+	if (m_V[instruction.x] != instruction.nn)
 		m_PC += INSTRUCTION_SIZE; // Skip 1 instruction
 }
 
-void Chip8::Instruction5XY0(const Opcode& opcode)
+void Chip8::Instruction5XY0(const Instruction& instruction)
 {
-	if (GetRegisterValue(opcode, false) == GetRegisterValue(opcode, true))
+	if (m_V[instruction.x] == m_V[instruction.y])
 		m_PC += INSTRUCTION_SIZE; // Skip 1 instruction
 }
 
-void Chip8::Instruction6XNN(const Opcode& opcode)
+void Chip8::Instruction6XNN(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) = ExtractByte(opcode);
+	m_V[instruction.x] = instruction.nn;
 }
 
-void Chip8::Instruction7XNN(const Opcode& opcode)
+void Chip8::Instruction7XNN(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) += ExtractByte(opcode);
+	m_V[instruction.x] += instruction.nn;
 }
 
-void Chip8::Instruction8XY0(const Opcode& opcode)
+void Chip8::Instruction8XY0(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) = GetRegisterValue(opcode, true);
+	m_V[instruction.x] = m_V[instruction.y];
 }
 
-void Chip8::Instruction8XY1(const Opcode& opcode)
+void Chip8::Instruction8XY1(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) |= GetRegisterValue(opcode, true);
+	m_V[instruction.x] |= m_V[instruction.y];
 }
 
-void Chip8::Instruction8XY2(const Opcode& opcode)
+void Chip8::Instruction8XY2(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) &= GetRegisterValue(opcode, true);
+	m_V[instruction.x] &= m_V[instruction.y];
 }
 
-void Chip8::Instruction8XY3(const Opcode& opcode)
+void Chip8::Instruction8XY3(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) ^= GetRegisterValue(opcode, true);
+	m_V[instruction.x] ^= m_V[instruction.y];
 }
 
-void Chip8::Instruction8XY4(const Opcode& opcode)
+void Chip8::Instruction8XY4(const Instruction& instruction)
 {
-	size_t lhs = ExtractRegisterId(opcode, false);
-	int result = static_cast<int>(m_V.at(lhs)) + static_cast<int>(GetRegisterValue(opcode, true));
+	size_t lhs = instruction.x;
+	int result = static_cast<int>(m_V[lhs]) + static_cast<int>(m_V[instruction.y]);
 
 	// Store the result of the addition
-	m_V.at(lhs) = static_cast<Byte>(result & 0xFF);
+	m_V[lhs] = static_cast<Byte>(result & 0xFF);
 	// Store the carry
-	m_V.at(0xF) = static_cast<Byte>(result & 0xF00);
+	m_V[0xF] = static_cast<Byte>(result & 0xF00);
 }
 
-void Chip8::Instruction8XY5(const Opcode& opcode)
+void Chip8::Instruction8XY5(const Instruction& instruction)
 {
-	size_t lhs = ExtractRegisterId(opcode, false);
-	int result = static_cast<int>(m_V.at(lhs)) - static_cast<int>(GetRegisterValue(opcode, true));
+	size_t lhs = instruction.x;
+	int result = static_cast<int>(m_V[lhs]) - static_cast<int>(m_V[instruction.y]);
 
 	// Store the result of the subtraction
-	m_V.at(lhs) = static_cast<Byte>(result & 0xFF);
+	m_V[lhs] = static_cast<Byte>(result & 0xFF);
 	// Store the borrow (0 on borrow)
-	m_V.at(0xF) = (result < 0) ? 0 : 1;
+	m_V[0xF] = (result < 0) ? 0 : 1;
 }
 
-void Chip8::Instruction8XY6(const Opcode& opcode)
+template<Chip8::Quirks Q>
+void Chip8::Instruction8XY6(const Instruction& instruction)
 {
-	size_t lhs = ExtractRegisterId(opcode, false);
-	// Store the LSB in V[F]
-	m_V.at(0xF) = m_V.at(lhs) & 1;
-	// Right shift the register by 1 bit
-	m_V.at(lhs) >>= 1;
+	size_t lhs = instruction.x;
+	if constexpr ((Q & SHIFT_VX) != 0) {
+		// Store the LSB in V[F]
+		m_V[0xF] = m_V[lhs] & 1;
+		// Right shift the register by 1 bit
+		m_V[lhs] >>= 1;
+	}
+	else {
+		Register8 value = m_V[instruction.y];
+		m_V[lhs] = value >> 1;
+		m_V[0xF] = value & 1;
+	}
 }
 
-void Chip8::Instruction8XY7(const Opcode& opcode)
+void Chip8::Instruction8XY7(const Instruction& instruction)
 {
-	size_t lhs = ExtractRegisterId(opcode, false);
-	int result = static_cast<int>(GetRegisterValue(opcode, true)) - static_cast<int>(m_V.at(lhs));
+	size_t lhs = instruction.x;
+	int result = static_cast<int>(m_V[instruction.y]) - static_cast<int>(m_V[lhs]);
 
 	// Store the result of the subtraction
-	m_V.at(lhs) = static_cast<Byte>(result & 0xFF);
+	m_V[lhs] = static_cast<Byte>(result & 0xFF);
 	// Store the borrow (0 on borrow)
-	m_V.at(0xF) = (result < 0) ? 0 : 1;
+	m_V[0xF] = (result < 0) ? 0 : 1;
 }
 
-void Chip8::Instruction8XYE(const Opcode& opcode)
+template<Chip8::Quirks Q>
+void Chip8::Instruction8XYE(const Instruction& instruction)
 {
-	size_t lhs = ExtractRegisterId(opcode, false);
-	// Store the MSB in V[F]
-	m_V.at(0xF) = m_V.at(lhs) & 0x80;
-	// Left shift the register by 1 bit
-	m_V.at(lhs) <<= 1;
+	size_t lhs = instruction.x;
+	if constexpr ((Q & SHIFT_VX) != 0) {
+		// Store the MSB in V[F]
+		m_V[0xF] = m_V[lhs] >> 7;
+		// Left shift the register by 1 bit
+		m_V[lhs] <<= 1;
+	}
+	else {
+		Register8 value = m_V[instruction.y];
+		m_V[lhs] = static_cast<Register8>(value << 1);
+		m_V[0xF] = value >> 7;
+	}
 }
 
-void Chip8::Instruction9XY0(const Opcode& opcode)
+void Chip8::Instruction9XY0(const Instruction& instruction)
 {
-	if (GetRegisterValue(opcode, false) != GetRegisterValue(opcode, true))
+	if (m_V[instruction.x] != m_V[instruction.y])
 		m_PC += INSTRUCTION_SIZE; // Skip 1 instruction
 }
 
-void Chip8::InstructionANNN(const Opcode& opcode)
+void Chip8::InstructionANNN(const Instruction& instruction)
 {
-	m_I = ExtractAddress(opcode);
+	m_I = instruction.nnn;
 }
 
-void Chip8::InstructionBNNN(const Opcode& opcode)
+template<Chip8::Quirks Q>
+void Chip8::InstructionBNNN(const Instruction& instruction)
 {
-	m_PC = ExtractAddress(opcode) + static_cast<Address>(m_V.at(0));
+	if constexpr ((Q & JUMP_VX) != 0)
+		m_PC = instruction.nnn + static_cast<Address>(m_V[instruction.x]);
+	else
+		m_PC = instruction.nnn + static_cast<Address>(m_V[0]);
 }
 
-void Chip8::InstructionCXNN(const Opcode& opcode)
+void Chip8::InstructionCXNN(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) = GenerateByte() & ExtractByte(opcode);
+	m_V[instruction.x] = m_RNG.NextByte() & instruction.nn;
 }
 
-void Chip8::InstructionDXYN(const Opcode& opcode)
+template<Chip8::Quirks Q>
+void Chip8::InstructionDXYN(const Instruction& instruction)
 {
-	uint8_t x = GetRegisterValue(opcode, false);
-	uint8_t y = GetRegisterValue(opcode, true);
-	uint8_t w = 8;
-	uint8_t h = ExtractNibble(opcode);
-
-	SDL_Surface* surface = m_Peripherals->GetSurface(1);
-	uint32_t* pixels = reinterpret_cast<uint32_t*>(surface->pixels);
-	uint32_t xor_val = -1; // Intentional underflow
-
-	SDL_LockSurface(surface);
-	bool collision = false;
-	for (size_t i = 0; i < h; i++)
-	{
-		Byte sprite = m_RAM->at(m_I + i);
-		for (size_t j = 0; j < w; j++)
-		{
-			Byte b = sprite >> (w - j - 1) & 0x1;
-			size_t index = ((i + y) * surface->w + j + x);
-			if (!collision && (pixels[index] & xor_val))
-				collision = true;
-			pixels[index] ^= b ? xor_val : 0;
-		}
+	Address base = m_I & ADDRESS_MASK;
+	const Byte* sprite = m_Memory.data() + base;
+	std::array<Byte, 16> wrapped;
+	if (base + instruction.n > RAM_SIZE) {
+		for (size_t i = 0; i < instruction.n; i++)
+			wrapped[i] = MemoryAt(base + i);
+		sprite = wrapped.data();
 	}
-	SDL_UnlockSurface(surface);
+	bool collision;
+	if constexpr ((Q & SPRITE_WRAP) != 0)
+		collision = m_Display.DrawWrapped(m_V[instruction.x], m_V[instruction.y], sprite, instruction.n);
+	else
+		collision = m_Display.Draw(m_V[instruction.x], m_V[instruction.y], sprite, instruction.n);
 	m_V[0xF] = collision ? 1 : 0;
-	/*
-	SDL_Rect r = { GetRegisterValue(opcode, false), GetRegisterValue(opcode, true), 8, ExtractNibble(opcode) };
-	// ToDo(Ivan): This is absolutely wrong! Fix it!
-	if (!m_Peripherals->FillRect(&r, 255, 255, 255))
-		printf_s("Failed to draw rect! %s", SDL_GetError());
-	*/
 }
 
-void Chip8::InstructionEX9E(const Opcode& opcode)
+void Chip8::InstructionEX9E(const Instruction& instruction)
 {
-	if(m_Peripherals->IsKeyPressed(GetRegisterValue(opcode, false)))
+	if(m_Peripherals->IsKeyPressed(m_V[instruction.x]))
 		m_PC += INSTRUCTION_SIZE; // Skip 1 instruction
 }
 
-void Chip8::InstructionEXA1(const Opcode& opcode)
+void Chip8::InstructionEXA1(const Instruction& instruction)
 {
-	if (!m_Peripherals->IsKeyPressed(GetRegisterValue(opcode, false)))
+	if (!m_Peripherals->IsKeyPressed(m_V[instruction.x]))
 		m_PC += INSTRUCTION_SIZE; // Skip 1 instruction
 }
 
-void Chip8::InstructionFX07(const Opcode& opcode)
+void Chip8::InstructionFX07(const Instruction& instruction)
 {
-	m_V.at(ExtractRegisterId(opcode, false)) = m_Delay;
+	m_V[instruction.x] = m_Delay;
+	PROFILE(ReadDelayTimer(m_Delay));
 }
 
-void Chip8::InstructionFX0A(const Opcode& opcode)
+void Chip8::InstructionFX0A(const Instruction& instruction)
 {
-	while (!m_Peripherals->IsKeyPressed(GetRegisterValue(opcode, false)))
-		SDL_Delay(16); // Wait 16ms(1 frame) and try again
+	// Waiting is a state, not a loop: rewind and retry the instruction on the
+	// next cycle, so the timers keep running and the caller keeps control
+	if (!m_Peripherals->IsKeyPressed(m_V[instruction.x]))
+		m_PC -= INSTRUCTION_SIZE;
 }
 
-void Chip8::InstructionFX15(const Opcode& opcode)
+void Chip8::InstructionFX15(const Instruction& instruction)
 {
-	m_Delay = GetRegisterValue(opcode, false);
+	m_Delay = m_V[instruction.x];
 }
 
-void Chip8::InstructionFX18(const Opcode& opcode)
+void Chip8::InstructionFX18(const Instruction& instruction)
 {
-	m_Sound = GetRegisterValue(opcode, false);
+	m_Sound = m_V[instruction.x];
 }
 
-void Chip8::InstructionFX1E(const Opcode& opcode)
+void Chip8::InstructionFX1E(const Instruction& instruction)
 {
-	m_I += GetRegisterValue(opcode, false);
+	m_I += m_V[instruction.x];
 }
 
-void Chip8::InstructionFX29(const Opcode& opcode)
+void Chip8::InstructionFX29(const Instruction& instruction)
 {
 	// This is probably not going to work if there are custom sprites stored
 	// (if this is even possible)
-	Address memoryOffset = GetRegisterValue(opcode, false) * 5;
+	Address memoryOffset = m_V[instruction.x] * 5;
 	/* ToDo(Ivan): probably can add bounds check here */
 	m_I = memoryOffset;
 }
 
-void Chip8::InstructionFX33(const Opcode& opcode)
+void Chip8::InstructionFX33(const Instruction& instruction)
 {
-	Byte value = GetRegisterValue(opcode, false);
-	m_RAM->at(m_I) = value / 100;
-	m_RAM->at(m_I + 1) = value / 10 % 10;
-	m_RAM->at(m_I + 2) = value % 10;
+	Byte value = m_V[instruction.x];
+	MemoryAt(m_I) = value / 100;
+	MemoryAt(m_I + 1) = value / 10 % 10;
+	MemoryAt(m_I + 2) = value % 10;
+	InvalidateCode(m_I, 3);
 }
 
-void Chip8::InstructionFX55(const Opcode& opcode)
+template<Chip8::Quirks Q>
+void Chip8::InstructionFX55(const Instruction& instruction)
 {
-	size_t endRegister = ExtractRegisterId(opcode, false);
-	
-	for (size_t i = 0; i < endRegister; i++)
-		m_RAM->at(m_I + i) = m_V.at(i);
+	size_t count = instruction.x + 1; // VX included
+
+	for (size_t i = 0; i < count; i++)
+		MemoryAt(m_I + i) = m_V[i];
+	InvalidateCode(m_I, count);
+	if constexpr ((Q & LOAD_STORE_INCREMENT) != 0)
+		m_I += static_cast<Register16>(count);
 }
 
-void Chip8::InstructionFX65(const Opcode& opcode)
+template<Chip8::Quirks Q>
+void Chip8::InstructionFX65(const Instruction& instruction)
 {
-	size_t endRegister = ExtractRegisterId(opcode, false);
+	size_t count = instruction.x + 1; // VX included
 
-	for (size_t i = 0; i < endRegister; i++)
-		m_V.at(i) = m_RAM->at(m_I + i);
+	for (size_t i = 0; i < count; i++)
+		m_V[i] = MemoryAt(m_I + i);
+	if constexpr ((Q & LOAD_STORE_INCREMENT) != 0)
+		m_I += static_cast<Register16>(count);
 }
 
 inline Chip8::Address Chip8::ExtractAddress(const Opcode& opcode)
@@ -334,46 +842,124 @@ inline size_t Chip8::ExtractRegisterId(const Opcode& opcode, const bool rhs)
 	return (opcode >> (rhs ? 4 : 8)) & 0xF;
 }
 
-inline Chip8::Register8 Chip8::GetRegisterValue(const Opcode& opcode, const bool rhs)
+inline Byte& Chip8::MemoryAt(const size_t& addr)
 {
-	return m_V.at(ExtractRegisterId(opcode, rhs));
+	return m_Memory[addr & ADDRESS_MASK];
 }
 
-inline Byte Chip8::GenerateByte()
+inline void Chip8::InvalidateCode(const Address& addr, const size_t& size)
 {
-	std::uniform_int_distribution<std::mt19937::result_type> dist(0, 255);
-	return static_cast<Byte>(dist(m_RNG));
+	if (!m_BlockCache)
+		return;
+	Address start = addr & ADDRESS_MASK;
+	size_t head = std::min(size, RAM_SIZE - start);
+	m_BlockCache->Invalidate(start, head);
+	if (head < size)
+		m_BlockCache->Invalidate(0, size - head);
 }
 
 inline void Chip8::InitFonts()
 {
-	Memory m = {
-		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-		0x20, 0x60, 0x20, 0x20, 0x70, // 1
-		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-	};
+	std::copy(FONT.begin(), FONT.end(), m_Memory.begin());
+}
 
-	std::copy(m.begin(), m.end(), m_RAM->begin());
+inline CPU::Opcode Chip8::FetchOpcode(const Address& addr)
+{
+	return MemoryAt(addr) << 8 | MemoryAt(addr + 1);
 }
 
 inline bool Chip8::ReadInsruction(Opcode & opcode)
 {
 	if(m_PC > m_ProgramEnd)
 		return false;
-	opcode = m_RAM->at(m_PC) << 8 | m_RAM->at(m_PC + 1);
+	opcode = FetchOpcode(m_PC);
 	m_PC += INSTRUCTION_SIZE; // Move to the next instruction
 	return true;
 }
+
+#ifdef MOTE_TRACE
+inline void Chip8::TraceInstruction(const Address& pc, const Opcode& opcode, const Register16& i)
+{
+	InstructionId id = s_DecodeTable[opcode];
+	Byte reg = Tracer::GetWrittenRegister(id, static_cast<Byte>(ExtractRegisterId(opcode, false)));
+	if (reg == Tracer::NO_REGISTER && m_I != i)
+		reg = Tracer::REGISTER_I; // FX55 with LOAD_STORE_INCREMENT
+	uint16_t value = reg == Tracer::REGISTER_I ? m_I : reg == Tracer::NO_REGISTER ? 0 : m_V[reg];
+	Address address = Tracer::TouchesMemory(id) ? static_cast<Address>(i & ADDRESS_MASK) : Tracer::NO_ADDRESS;
+	m_Tracer->Append(pc, opcode, address, reg, value, m_V[0xF]);
+}
+#endif // MOTE_TRACE
+
+std::unique_ptr<Chip8::Block> Chip8::DecodeBlock(const Address& start)
+{
+	std::unique_ptr<Block> block(new Block());
+	block->start = start;
+
+	Address addr = start;
+	while (addr <= m_ProgramEnd && block->code.size() < MAX_BLOCK_SIZE)
+	{
+		Opcode opcode = FetchOpcode(addr);
+		InstructionId id = s_DecodeTable[opcode];
+		block->code.push_back({ (*m_Handlers)[static_cast<size_t>(id)], MakeInstruction(opcode) });
+		addr += INSTRUCTION_SIZE;
+		if (EndsBlock(id))
+			break;
+	}
+	block->end = addr;
+	if (m_AOT)
+		m_AOT->Attach(*block);
+	return block;
+}
+
+Chip8::Block* Chip8::TranslateBlock(const Address& start)
+{
+	return m_BlockCache->Insert(DecodeBlock(start));
+}
+
+inline bool Chip8::BackOffIdleCheck()
+{
+	if (m_IdleCountdown == 0)
+		return false;
+	m_IdleCountdown--;
+	return true;
+}
+
+size_t Chip8::SkipIdleLoop(const size_t& budget)
+{
+	// Run one iteration with the real handlers and put the registers back
+	// afterwards. Nothing else can change: the timers only tick and the keys
+	// only change between Run calls.
+	const std::array<Register8, 16> v = m_V;
+	const Register16 i = m_I;
+	const Address head = m_PC;
+	size_t length = 0;
+	bool idle = false;
+	while (length < MAX_IDLE_LOOP && m_PC <= m_ProgramEnd)
+	{
+		Opcode opcode = FetchOpcode(m_PC);
+		InstructionId id = s_DecodeTable[opcode];
+		if (!IsRegisterOnly(id) && id != InstructionId::OP_FX07 && id != InstructionId::OP_FX0A
+			&& id != InstructionId::OP_EX9E && id != InstructionId::OP_EXA1)
+			break;
+		m_PC += INSTRUCTION_SIZE;
+		(this->*(*m_Handlers)[static_cast<size_t>(id)])(MakeInstruction(opcode));
+		length++;
+		if (m_PC == head) {
+			idle = m_V == v && m_I == i;
+			break;
+		}
+	}
+	m_V = v;
+	m_I = i;
+	m_PC = head;
+
+	if (!idle) {
+		m_IdleCountdown = m_IdleBackoff;
+		m_IdleBackoff = std::min<uint16_t>(m_IdleBackoff * 2, MAX_IDLE_BACKOFF);
+		return 0;
+	}
+	m_IdleBackoff = 1;
+	size_t skipped = budget / length * length;
+	m_IdleCycles += skipped;
+	return skipped;
+}
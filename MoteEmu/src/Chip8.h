@@ -4,32 +4,196 @@
 #include <array>
 #include <unordered_map>
 #include <memory>
-#include <random>
+#include <utility>
 
 #include "CPU.h"
-
+#include "BlockCache.h"
+#include "Random.h"
+
+class Chip8JIT;
+class Chip8AOT;
+#ifdef MOTE_PROFILE
+class ExecutionProfile;
+#endif // MOTE_PROFILE
+#ifdef MOTE_TRACE
+class Tracer;
+#endif // MOTE_TRACE
+
+// The machine state is kept in the object itself: registers, stack, timers,
+// display, RNG and the 4 KB of RAM (the memory handed over by the VM isn't
+// used), about 4.5 KB in all. Addresses are masked to 12 bits, so memory
+// accesses can't fail.
 class Chip8 : public CPU
 {
+	friend class Chip8JIT;
 public:
 	typedef Byte Register8;
 	typedef uint16_t Address;
 	typedef uint16_t OpcodeMask;
 	typedef Address Register16;
 	typedef Byte Timer;
-	typedef std::unordered_map<OpcodeMask, void (Chip8::*)(const Opcode&)> InstructionMap;
+
+	// One identifier per instruction handler. The decode table maps every
+	// possible 16-bit opcode to one of these.
+	enum class InstructionId : Byte {
+		UNKNOWN,
+		OP_0NNN, OP_00E0, OP_00EE, OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0,
+		OP_6XNN, OP_7XNN, OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5,
+		OP_8XY6, OP_8XY7, OP_8XYE, OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN,
+		OP_EX9E, OP_EXA1, OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29,
+		OP_FX33, OP_FX55, OP_FX65,
+		COUNT
+	};
+	typedef std::array<InstructionId, 0x10000> DecodeTable;
+
+	// An opcode with its operands already extracted
+	struct Instruction {
+		Opcode opcode;
+		Address nnn;
+		Byte x;
+		Byte y;
+		Byte n;
+		Byte nn;
+	};
+	typedef void (Chip8::*InstructionHandler)(const Instruction&);
+	typedef std::array<InstructionHandler, static_cast<size_t>(InstructionId::COUNT)> HandlerTable;
+#ifdef MOTE_MAP_DISPATCH
+	typedef std::unordered_map<OpcodeMask, InstructionId> InstructionMap;
+#endif // MOTE_MAP_DISPATCH
+
+	// Behaviours that differ between CHIP-8 interpreters, a set bit picks the
+	// alternative. The handlers they affect are templates on the whole set and
+	// every combination gets its own handler table, so nothing branches on them
+	// while running.
+	enum Quirk : uint32_t {
+		SHIFT_VX = 1 << 0,             // 8XY6/8XYE shift VX in place instead of storing VY shifted into VX
+		LOAD_STORE_INCREMENT = 1 << 1, // FX55/FX65 leave I past the last register instead of unchanged
+		SPRITE_WRAP = 1 << 2,          // Sprites wrap around the screen edges instead of being clipped
+		JUMP_VX = 1 << 3               // BNNN jumps to XNN plus VX instead of NNN plus V0
+	};
+	typedef uint32_t Quirks;
+	static constexpr const size_t QUIRK_COUNT = 4;
+	static constexpr const Quirks DEFAULT_QUIRKS = SHIFT_VX;
+
+	// Compiled prefix of a block: takes pointers to V, I and PC, returns the instructions executed
+	typedef uint32_t (*NativeCode)(Register8* v, Register16* i, Address* pc);
+
+	// A predecoded basic block, used by the cached interpreter and the JIT
+	struct CachedInstruction {
+		InstructionHandler handler;
+		Instruction instruction;
+	};
+	struct Block {
+		Address start;
+		Address end;
+		std::vector<CachedInstruction> code;
+		NativeCode native = nullptr;
+		uint16_t nativeLength = 0;
+		uint16_t executions = 0;
+	};
+	typedef BlockCache<Block> InstructionCache;
+
+	enum class ExecutionMode {
+		INTERPRETER, // Fetch and decode every instruction
+		CACHED,      // Run predecoded basic blocks
+		JIT          // Compile hot blocks to native code, x86-64 only
+	};
 
 	static constexpr const Address NULLPTR = 0;
 	static constexpr const Byte INSTRUCTION_SIZE = 2;
 	static constexpr const Address USER_SPACE_ADDR = 0x200;
-	
+	static constexpr const size_t RAM_SIZE = 0x1000;
+	static constexpr const Address ADDRESS_MASK = RAM_SIZE - 1;
+	static constexpr const size_t STACK_SIZE = 16; // In return addresses
+	static constexpr const size_t MAX_BLOCK_SIZE = 64; // In instructions
+	static constexpr const size_t MAX_IDLE_LOOP = 16; // In instructions
+	static constexpr const uint16_t MAX_IDLE_BACKOFF = 256; // Backward jumps
+	static constexpr const uint32_t SAVE_STATE_MAGIC = 0x54533843; // "C8ST"
+	static constexpr const uint16_t SAVE_STATE_VERSION = 3; // 2: stack outside of RAM, xorshift RNG, 3: 8XYE sets VF to 0 or 1
+	// 4x5 sprites of the hex digits, loaded at address 0
+	static const std::array<Byte, 80> FONT;
 
 	Chip8();
 	~Chip8();
 
 	void Init() override;
 	void Reset() override;
-	void LoadProgram(const Memory& mem) override;
+	using CPU::LoadProgram;
+	bool LoadProgram(const Byte* program, const size_t& size) override;
+	size_t GetMaxProgramSize() const override;
 	bool ExecuteInstruction() override;
+	size_t Run(const size_t& cycles) override;
+	void TickTimers() override;
+	const Display& GetDisplay() const override;
+
+	// Returns false if the mode isn't available on this host
+	bool SetExecutionMode(const ExecutionMode& mode);
+	ExecutionMode GetExecutionMode() const;
+	const InstructionCache::Stats& GetCacheStats() const;
+	// Translates the block at start (e.g. out of a ROMCatalog) instead of
+	// waiting for it to be reached. It is decoded from memory like any other
+	// block, `count` is the length the caller expects. Returns false in the
+	// interpreter, if start is outside the program or if the block came out
+	// with another length, which then isn't kept.
+	bool Precompile(const Address& start, const size_t& count);
+	// The JIT exists only in ExecutionMode::JIT
+	Chip8JIT* GetJIT() const;
+	// Runs the blocks a Chip8AOT module compiled for the loaded program as
+	// native code (nullptr stops), in the modes that translate blocks. Returns
+	// false if the module was made for another ROM or other quirks. Loading a
+	// program drops it.
+	bool SetAOT(const Chip8AOT* module);
+	// Instructions run by the module's code, the JIT counts its own
+	uint64_t GetAOTInstructions() const;
+	// Fast-forwards loops that only wait for the delay timer or a key to the
+	// end of the Run call, when the timers tick and the keys may change next.
+	// The state afterwards is the one running the loop out would leave. On by
+	// default; tracing and profile builds always run the loops.
+	void SetIdleSkipping(const bool& enabled);
+	// Instructions skipped that way, counted as executed
+	uint64_t GetIdleCycles() const;
+	// Switches to the handlers specialized for the quirks, dropping translated
+	// blocks. Returns false if a bit isn't a Quirk.
+	bool SetQuirks(const Quirks& quirks);
+	Quirks GetQuirks() const;
+	// Accepts the name of a platform (default, vip, schip or xochip) or a mask of Quirk bits
+	static bool ParseQuirks(const char* text, Quirks& quirks);
+	static const char* GetQuirkName(const Quirk& quirk);
+
+#ifdef MOTE_PROFILE
+	// Instruction counters, PC heatmap and call tree since the program was loaded, only in builds with the "profile" premake option
+	ExecutionProfile& GetProfile();
+#endif // MOTE_PROFILE
+#ifdef MOTE_TRACE
+	// Appends every instruction executed from now on to the tracer (nullptr
+	// stops), only in builds with the "trace" premake option. The JIT's native
+	// code isn't run while tracing, the cached interpreter runs its blocks.
+	void SetTracer(Tracer* tracer);
+#endif // MOTE_TRACE
+
+	// Makes CXNN reproducible, the generator is seeded randomly otherwise
+	void Seed(const uint32_t& seed) override;
+	// Fingerprint of the registers, timers and memory, equal states give equal hashes
+	uint64_t GetStateHash() const;
+
+	size_t GetSaveStateSize() const override;
+	// Writes a snapshot of the whole machine to `buffer`: registers, stack,
+	// timers, RNG, RAM and display. Doesn't allocate, so it is cheap enough to
+	// take every frame. Returns the bytes written, 0 if `capacity` is too small.
+	size_t SaveState(Byte* buffer, const size_t& capacity) const override;
+	// Restores a snapshot taken by SaveState. Returns false, leaving the machine
+	// untouched, if it isn't a snapshot of this version.
+	bool LoadState(const Byte* data, const size_t& size) override;
+
+	// Maps an opcode to the id of the instruction that handles it
+	static constexpr InstructionId Decode(const Opcode& opcode);
+	// Opcode pattern of an instruction, e.g. "8XY4"
+	static const char* GetInstructionName(const InstructionId& id);
+	// True for the instructions after which the next PC isn't known statically (or memory was written)
+	static constexpr bool EndsBlock(const InstructionId& id);
+	// True for the instructions that only read and write V, I and PC, the ones compiled to native code
+	static constexpr bool IsRegisterOnly(const InstructionId& id);
+	static Instruction MakeInstruction(const Opcode& opcode);
 
 private:
 	/* 
@@ -43,114 +207,124 @@ private:
 		- I : 16bit register (For memory address) (Similar to void pointer)
 	*/
 
+	// Reports opcodes that don't decode to any instruction.
+	void InstructionUnknown(const Instruction& instruction);
+
 	// Calls RCA 1802 program at address NNN. Not necessary for most ROMs.
-	void Instruction0NNN(const Opcode& opcode);
+	void Instruction0NNN(const Instruction& instruction);
 
 	// Clears the screen.
-	void Instruction00E0(const Opcode& opcode);
+	void Instruction00E0(const Instruction& instruction);
 
 	// Returns from a subroutine.
-	void Instruction00EE(const Opcode& opcode);
+	void Instruction00EE(const Instruction& instruction);
 
 	// Jumps to address NNN.
-	void Instruction1NNN(const Opcode& opcode);
+	void Instruction1NNN(const Instruction& instruction);
 
 	// Calls subroutine at NNN.
-	void Instruction2NNN(const Opcode& opcode);
+	void Instruction2NNN(const Instruction& instruction);
 
 	// Skips the next instruction if VX equals NN.
 	// (Usually the next instruction is a jump to skip a code block)
-	void Instruction3XNN(const Opcode& opcode);
+	void Instruction3XNN(const Instruction& instruction);
 
 	// Skips the next instruction if VX doesn't equal NN.
 	// (Usually the next instruction is a jump to skip a code block)
-	void Instruction4XNN(const Opcode& opcode);
+	void Instruction4XNN(const Instruction& instruction);
 
 	// Skips the next instruction if VX equals VY.
 	// (Usually the next instruction is a jump to skip a code block)
-	void Instruction5XY0(const Opcode& opcode);
+	void Instruction5XY0(const Instruction& instruction);
 
 	// Sets VX to NN.
-	void Instruction6XNN(const Opcode& opcode);
+	void Instruction6XNN(const Instruction& instruction);
 
 	// Adds NN to VX. (Carry flag is not changed)
-	void Instruction7XNN(const Opcode& opcode);
+	void Instruction7XNN(const Instruction& instruction);
 
 	// Sets VX to the value of VY.
-	void Instruction8XY0(const Opcode& opcode);
+	void Instruction8XY0(const Instruction& instruction);
 
 	// Sets VX to VX or VY. (Bitwise OR operation)
-	void Instruction8XY1(const Opcode& opcode);
+	void Instruction8XY1(const Instruction& instruction);
 
 	// Sets VX to VX and VY. (Bitwise AND operation)
-	void Instruction8XY2(const Opcode& opcode);
+	void Instruction8XY2(const Instruction& instruction);
 
 	// Sets VX to VX xor VY.
-	void Instruction8XY3(const Opcode& opcode);
+	void Instruction8XY3(const Instruction& instruction);
 
 	// Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
-	void Instruction8XY4(const Opcode& opcode);
+	void Instruction8XY4(const Instruction& instruction);
 
 	// VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
-	void Instruction8XY5(const Opcode& opcode);
+	void Instruction8XY5(const Instruction& instruction);
 
-	// Stores the least significant bit of VX in VF and then shifts VX to the right by 1.
-	void Instruction8XY6(const Opcode& opcode);
+	// Stores the least significant bit of VY in VF and then VY shifted to the right by 1 in VX.
+	// (SHIFT_VX: shifts VX itself)
+	template<Quirks Q>
+	void Instruction8XY6(const Instruction& instruction);
 
 	// Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
-	void Instruction8XY7(const Opcode& opcode);
+	void Instruction8XY7(const Instruction& instruction);
 
-	// Stores the most significant bit of VX in VF and then shifts VX to the left by 1.
-	void Instruction8XYE(const Opcode& opcode);
+	// Stores the most significant bit of VY in VF and then VY shifted to the left by 1 in VX.
+	// (SHIFT_VX: shifts VX itself)
+	template<Quirks Q>
+	void Instruction8XYE(const Instruction& instruction);
 
 	// Skips the next instruction if VX doesn't equal VY.
 	// (Usually the next instruction is a jump to skip a code block)
-	void Instruction9XY0(const Opcode& opcode);
+	void Instruction9XY0(const Instruction& instruction);
 
 	// Sets I to the address NNN.
-	void InstructionANNN(const Opcode& opcode);
+	void InstructionANNN(const Instruction& instruction);
 
-	// Jumps to the address NNN plus V0.
-	void InstructionBNNN(const Opcode& opcode);
+	// Jumps to the address NNN plus V0. (JUMP_VX: XNN plus VX)
+	template<Quirks Q>
+	void InstructionBNNN(const Instruction& instruction);
 
 	// Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN.
-	void InstructionCXNN(const Opcode& opcode);
+	void InstructionCXNN(const Instruction& instruction);
 
 	/* Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels
 	and a height of N pixels. Each row of 8 pixels is read as bit-coded
-	starting from memory location I; I value doesnt change after the
+	starting from memory location I (wrapping at the end of RAM); I value doesnt change after the
 	execution of this instruction. As described above, VF is set to 1
 	if any screen pixels are flipped from set to unset when the sprite
-	is drawn, and to 0 if that doesnt happen*/
-	void InstructionDXYN(const Opcode& opcode);
+	is drawn, and to 0 if that doesnt happen. The start position wraps
+	around the screen, the sprite is clipped at its edges (SPRITE_WRAP: wraps too).*/
+	template<Quirks Q>
+	void InstructionDXYN(const Instruction& instruction);
 
 	// Skips the next instruction if the key stored in VX is pressed.
 	// (Usually the next instruction is a jump to skip a code block)
-	void InstructionEX9E(const Opcode& opcode);
+	void InstructionEX9E(const Instruction& instruction);
 
 	// Skips the next instruction if the key stored in VX isn't pressed.
 	// (Usually the next instruction is a jump to skip a code block)
-	void InstructionEXA1(const Opcode& opcode);
+	void InstructionEXA1(const Instruction& instruction);
 
 	// Sets VX to the value of the delay timer.
-	void InstructionFX07(const Opcode& opcode);
+	void InstructionFX07(const Instruction& instruction);
 
-	// A key press is awaited, and then stored in VX.
-	// (Blocking Operation. All instruction halted until next key event)
-	void InstructionFX0A(const Opcode& opcode);
+	// Waits until the key stored in VX is pressed. VX isn't written.
+	// (Not blocking: the PC is rewound and the instruction retried on the next cycle)
+	void InstructionFX0A(const Instruction& instruction);
 
 	// Sets the delay timer to VX.
-	void InstructionFX15(const Opcode& opcode);
+	void InstructionFX15(const Instruction& instruction);
 
 	// Sets the sound timer to VX.
-	void InstructionFX18(const Opcode& opcode);
+	void InstructionFX18(const Instruction& instruction);
 
 	// Adds VX to I.
-	void InstructionFX1E(const Opcode& opcode);
+	void InstructionFX1E(const Instruction& instruction);
 
 	// Sets I to the location of the sprite for the character in VX. 
 	// Characters 0-F (in hexadecimal) are represented by a 4x5 font.
-	void InstructionFX29(const Opcode& opcode);
+	void InstructionFX29(const Instruction& instruction);
 
 	/* Stores the binary-coded decimal representation of VX, with the
 	most significant of three digits at the address in I, the middle
@@ -158,75 +332,214 @@ private:
 	(In other words, take the decimal representation of VX, place the
 	hundreds digit in memory at location in I, the tens digit at location
 	I+1, and the ones digit at location I+2.)*/
-	void InstructionFX33(const Opcode& opcode);
+	void InstructionFX33(const Instruction& instruction);
 
 	// Stores V0 to VX (including VX) in memory starting at address I. 
 	// The offset from I is increased by 1 for each value written, but I itself is left unmodified.
-	void InstructionFX55(const Opcode& opcode);
+	// (LOAD_STORE_INCREMENT: I ends up at I + X + 1)
+	template<Quirks Q>
+	void InstructionFX55(const Instruction& instruction);
 
 	// Fills V0 to VX (including VX) with values from memory starting at address I.
 	// The offset from I is increased by 1 for each value written, but I itself is left unmodified.
-	void InstructionFX65(const Opcode& opcode);
+	// (LOAD_STORE_INCREMENT: I ends up at I + X + 1)
+	template<Quirks Q>
+	void InstructionFX65(const Instruction& instruction);
 
 	// Helper methods for the instructions
 
-	inline Address ExtractAddress(const Opcode& opcode);
-	inline Byte ExtractByte(const Opcode& opcode);
-	inline Byte ExtractNibble(const Opcode& opcode);
-	inline size_t ExtractRegisterId(const Opcode& opcode, const bool rhs);
-	inline Register8 GetRegisterValue(const Opcode& opcode, const bool rhs);
-	inline Byte GenerateByte();
+	static inline Address ExtractAddress(const Opcode& opcode);
+	static inline Byte ExtractByte(const Opcode& opcode);
+	static inline Byte ExtractNibble(const Opcode& opcode);
+	static inline size_t ExtractRegisterId(const Opcode& opcode, const bool rhs);
+	inline Byte& MemoryAt(const size_t& addr); // Masked to 12 bits
+	// Drops the translated blocks over [addr, addr + size), wrapping at the end of RAM
+	inline void InvalidateCode(const Address& addr, const size_t& size);
+
+	// Fixed part of a save state, followed by the RNG state and RAM.
+	// Values are in the host's byte order.
+	struct SaveStateHeader {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t rngSize;
+		uint32_t ramSize;
+		std::array<Register8, 16> v;
+		Register16 i;
+		Address pc;
+		Address programEnd;
+		uint16_t stackDepth;
+		std::array<Address, STACK_SIZE> stack;
+		Timer delay;
+		Timer sound;
+		Display::Rows display;
+	};
 
 	// Other methods
 
 	inline void InitFonts();
+	inline Opcode FetchOpcode(const Address& addr);
 	inline bool ReadInsruction(Opcode& opcode);
+#ifdef MOTE_TRACE
+	// Called after the instruction at `pc` executed, `i` is I before it
+	inline void TraceInstruction(const Address& pc, const Opcode& opcode, const Register16& i);
+#endif // MOTE_TRACE
+	// Decodes the block at start, up to the first instruction that ends a block
+	std::unique_ptr<Block> DecodeBlock(const Address& start);
+	Block* TranslateBlock(const Address& start);
+	// Called when the PC went back to `m_PC`. If the loop starting there comes
+	// back to it within MAX_IDLE_LOOP instructions with V and I unchanged, and
+	// only reads registers, the delay timer and the keys on the way, it goes
+	// on like that for the rest of the budget: returns the instructions of the
+	// whole iterations that fit, leaving the state as it is. 0 otherwise.
+	size_t SkipIdleLoop(const size_t& budget);
+	// Most backward jumps close loops that do work: after a failed check the
+	// next ones are ignored, twice as many each time. True if this one is.
+	inline bool BackOffIdleCheck();
 
 private:
+	// Hot state first, it fits in one cache line
 	std::array<Register8, 16> m_V = {0};
 	Register16 m_I = 0;
 	Address m_PC = USER_SPACE_ADDR;
 	Address m_ProgramEnd = USER_SPACE_ADDR;
-	CPU::Stack<int16_t>* m_SP = nullptr;
+	Byte m_StackDepth = 0;
 	Timer m_Delay = 0;
 	Timer m_Sound = 0;
-	std::mt19937 m_RNG;
-	const std::array<OpcodeMask, 4> m_OpcodeMasks = { 0xFFFF, 0xF000, 0xF00F, 0xF0FF };
-	const InstructionMap m_Instructions = {
-		{ 0x0000, &Chip8::Instruction0NNN },
-		{ 0x00E0, &Chip8::Instruction00E0 },
-		{ 0x00EE, &Chip8::Instruction00EE },
-		{ 0x1000, &Chip8::Instruction1NNN },
-		{ 0x2000, &Chip8::Instruction2NNN },
-		{ 0x3000, &Chip8::Instruction3XNN },
-		{ 0x4000, &Chip8::Instruction4XNN },
-		{ 0x5000, &Chip8::Instruction5XY0 },
-		{ 0x6000, &Chip8::Instruction6XNN },
-		{ 0x7000, &Chip8::Instruction7XNN },
-		{ 0x8000, &Chip8::Instruction8XY0 },
-		{ 0x8001, &Chip8::Instruction8XY1 },
-		{ 0x8002, &Chip8::Instruction8XY2 },
-		{ 0x8003, &Chip8::Instruction8XY3 },
-		{ 0x8004, &Chip8::Instruction8XY4 },
-		{ 0x8005, &Chip8::Instruction8XY5 },
-		{ 0x8006, &Chip8::Instruction8XY6 },
-		{ 0x8007, &Chip8::Instruction8XY7 },
-		{ 0x800E, &Chip8::Instruction8XYE },
-		{ 0x9000, &Chip8::Instruction9XY0 },
-		{ 0xA000, &Chip8::InstructionANNN },
-		{ 0xB000, &Chip8::InstructionBNNN },
-		{ 0xC000, &Chip8::InstructionCXNN },
-		{ 0xD000, &Chip8::InstructionDXYN },
-		{ 0xE09E, &Chip8::InstructionEX9E },
-		{ 0xE0A1, &Chip8::InstructionEXA1 },
-		{ 0xF007, &Chip8::InstructionFX07 },
-		{ 0xF00A, &Chip8::InstructionFX0A },
-		{ 0xF015, &Chip8::InstructionFX15 },
-		{ 0xF018, &Chip8::InstructionFX18 },
-		{ 0xF01E, &Chip8::InstructionFX1E },
-		{ 0xF029, &Chip8::InstructionFX29 },
-		{ 0xF033, &Chip8::InstructionFX33 },
-		{ 0xF055, &Chip8::InstructionFX55 },
-		{ 0xF065, &Chip8::InstructionFX65 }
-	};
+	Random m_RNG;
+	const HandlerTable* m_Handlers = s_HandlerTables[DEFAULT_QUIRKS];
+	std::array<Address, STACK_SIZE> m_Stack = {0};
+	Display m_Display;
+	std::array<Byte, RAM_SIZE> m_Memory = {0};
+
+	ExecutionMode m_ExecutionMode = ExecutionMode::INTERPRETER;
+	Quirks m_Quirks = DEFAULT_QUIRKS;
+	std::unique_ptr<InstructionCache> m_BlockCache; // Only in the modes that translate blocks, the lookup table alone is 32 KB
+	std::unique_ptr<Chip8JIT> m_JIT;
+	const Chip8AOT* m_AOT = nullptr;
+	uint64_t m_AOTInstructions = 0;
+	bool m_IdleSkipping = true;
+	uint16_t m_IdleBackoff = 1;   // Backward jumps ignored after the next failed check
+	uint16_t m_IdleCountdown = 0; // Backward jumps left to ignore
+	uint64_t m_IdleCycles = 0;
+#ifdef MOTE_PROFILE
+	std::unique_ptr<ExecutionProfile> m_Profile;
+#endif // MOTE_PROFILE
+#ifdef MOTE_TRACE
+	Tracer* m_Tracer = nullptr;
+#endif // MOTE_TRACE
+
+	// Handlers indexed by InstructionId, one table per combination of quirks
+	template<Quirks Q>
+	static const HandlerTable s_Handlers;
+	template<size_t... Q>
+	static constexpr std::array<const HandlerTable*, sizeof...(Q)> MakeHandlerTables(std::index_sequence<Q...>);
+	// s_Handlers indexed by the quirks
+	static const std::array<const HandlerTable*, 1 << QUIRK_COUNT> s_HandlerTables;
+	static const DecodeTable s_DecodeTable;
+
+#ifdef MOTE_MAP_DISPATCH
+	// Most specific masks go first so that e.g. 8XY4 is not taken for 8XY0
+	static const std::array<OpcodeMask, 4> s_OpcodeMasks;
+	static const InstructionMap s_Instructions;
+#endif // MOTE_MAP_DISPATCH
 };
+
+constexpr Chip8::InstructionId Chip8::Decode(const Opcode& opcode)
+{
+	switch (opcode & 0xF000)
+	{
+	case 0x0000:
+		if (opcode == 0x00E0)
+			return InstructionId::OP_00E0;
+		if (opcode == 0x00EE)
+			return InstructionId::OP_00EE;
+		return InstructionId::OP_0NNN;
+	case 0x1000: return InstructionId::OP_1NNN;
+	case 0x2000: return InstructionId::OP_2NNN;
+	case 0x3000: return InstructionId::OP_3XNN;
+	case 0x4000: return InstructionId::OP_4XNN;
+	case 0x5000: return (opcode & 0xF) == 0 ? InstructionId::OP_5XY0 : InstructionId::UNKNOWN;
+	case 0x6000: return InstructionId::OP_6XNN;
+	case 0x7000: return InstructionId::OP_7XNN;
+	case 0x8000:
+		switch (opcode & 0xF)
+		{
+		case 0x0: return InstructionId::OP_8XY0;
+		case 0x1: return InstructionId::OP_8XY1;
+		case 0x2: return InstructionId::OP_8XY2;
+		case 0x3: return InstructionId::OP_8XY3;
+		case 0x4: return InstructionId::OP_8XY4;
+		case 0x5: return InstructionId::OP_8XY5;
+		case 0x6: return InstructionId::OP_8XY6;
+		case 0x7: return InstructionId::OP_8XY7;
+		case 0xE: return InstructionId::OP_8XYE;
+		default: return InstructionId::UNKNOWN;
+		}
+	case 0x9000: return (opcode & 0xF) == 0 ? InstructionId::OP_9XY0 : InstructionId::UNKNOWN;
+	case 0xA000: return InstructionId::OP_ANNN;
+	case 0xB000: return InstructionId::OP_BNNN;
+	case 0xC000: return InstructionId::OP_CXNN;
+	case 0xD000: return InstructionId::OP_DXYN;
+	case 0xE000:
+		switch (opcode & 0xFF)
+		{
+		case 0x9E: return InstructionId::OP_EX9E;
+		case 0xA1: return InstructionId::OP_EXA1;
+		default: return InstructionId::UNKNOWN;
+		}
+	case 0xF000:
+		switch (opcode & 0xFF)
+		{
+		case 0x07: return InstructionId::OP_FX07;
+		case 0x0A: return InstructionId::OP_FX0A;
+		case 0x15: return InstructionId::OP_FX15;
+		case 0x18: return InstructionId::OP_FX18;
+		case 0x1E: return InstructionId::OP_FX1E;
+		case 0x29: return InstructionId::OP_FX29;
+		case 0x33: return InstructionId::OP_FX33;
+		case 0x55: return InstructionId::OP_FX55;
+		case 0x65: return InstructionId::OP_FX65;
+		default: return InstructionId::UNKNOWN;
+		}
+	default:
+		return InstructionId::UNKNOWN;
+	}
+}
+
+constexpr bool Chip8::EndsBlock(const InstructionId& id)
+{
+	switch (id)
+	{
+	case InstructionId::OP_00EE:
+	case InstructionId::OP_1NNN:
+	case InstructionId::OP_2NNN:
+	case InstructionId::OP_3XNN:
+	case InstructionId::OP_4XNN:
+	case InstructionId::OP_5XY0:
+	case InstructionId::OP_9XY0:
+	case InstructionId::OP_BNNN:
+	case InstructionId::OP_EX9E:
+	case InstructionId::OP_EXA1:
+	case InstructionId::OP_FX0A: // May rewind PC while waiting
+	case InstructionId::OP_FX33: // Writes to memory
+	case InstructionId::OP_FX55:
+		return true;
+	default:
+		return false;
+	}
+}
+
+constexpr bool Chip8::IsRegisterOnly(const InstructionId& id)
+{
+	switch (id)
+	{
+	case InstructionId::OP_1NNN: case InstructionId::OP_3XNN: case InstructionId::OP_4XNN: case InstructionId::OP_5XY0:
+	case InstructionId::OP_6XNN: case InstructionId::OP_7XNN: case InstructionId::OP_8XY0: case InstructionId::OP_8XY1:
+	case InstructionId::OP_8XY2: case InstructionId::OP_8XY3: case InstructionId::OP_8XY4: case InstructionId::OP_8XY5:
+	case InstructionId::OP_8XY6: case InstructionId::OP_8XY7: case InstructionId::OP_8XYE: case InstructionId::OP_9XY0:
+	case InstructionId::OP_ANNN: case InstructionId::OP_BNNN: case InstructionId::OP_FX1E: case InstructionId::OP_FX29:
+		return true;
+	default:
+		return false;
+	}
+}
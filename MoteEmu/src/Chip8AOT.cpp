@@ -0,0 +1,335 @@
+#include "Chip8AOT.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#include "Hash.h"
+#include "ROMCatalog.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+typedef Chip8::InstructionId Id;
+
+Chip8AOT::Chip8AOT()
+{
+}
+
+Chip8AOT::~Chip8AOT()
+{
+	Close();
+}
+
+Chip8AOT::Error Chip8AOT::Open(const char* filename)
+{
+	Close();
+#ifdef _WIN32
+	HMODULE library = LoadLibraryA(filename);
+	if (library == nullptr)
+		return Error::OPEN_FAILED;
+	m_Library = library;
+	EntryPoint entry = reinterpret_cast<EntryPoint>(GetProcAddress(library, ENTRY_POINT));
+#else
+	// Without a slash dlopen would search the library path instead of the working directory
+	std::string path = filename;
+	if (path.find('/') == std::string::npos)
+		path = "./" + path;
+	m_Library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (m_Library == nullptr)
+		return Error::OPEN_FAILED;
+	EntryPoint entry = reinterpret_cast<EntryPoint>(dlsym(m_Library, ENTRY_POINT));
+#endif
+	const Module* module = entry != nullptr ? entry() : nullptr;
+	if (module == nullptr || module->magic != MAGIC) {
+		Close();
+		return Error::NOT_A_MODULE;
+	}
+	if (module->version != VERSION) {
+		Close();
+		return Error::VERSION_MISMATCH;
+	}
+	m_Module = module;
+	return Error::NONE;
+}
+
+void Chip8AOT::Close()
+{
+	m_Module = nullptr;
+	if (m_Library == nullptr)
+		return;
+#ifdef _WIN32
+	FreeLibrary(static_cast<HMODULE>(m_Library));
+#else
+	dlclose(m_Library);
+#endif
+	m_Library = nullptr;
+}
+
+bool Chip8AOT::IsOpen() const
+{
+	return m_Module != nullptr;
+}
+
+const Chip8AOT::Module& Chip8AOT::GetModule() const
+{
+	return *m_Module;
+}
+
+bool Chip8AOT::Attach(Chip8::Block& block) const
+{
+	const BlockEntry* begin = m_Module->blocks;
+	const BlockEntry* end = begin + m_Module->blockCount;
+	const BlockEntry* entry = std::lower_bound(begin, end, block.start,
+		[](const BlockEntry& lhs, const Chip8::Address& start) { return lhs.start < start; });
+	if (entry == end || entry->start != block.start || entry->length > block.code.size())
+		return false;
+	for (size_t i = 0; i < entry->length; i++)
+	{
+		if (block.code[i].instruction.opcode != entry->opcodes[i])
+			return false; // The ROM changed its code since
+	}
+	block.native = entry->code;
+	block.nativeLength = entry->length;
+	return true;
+}
+
+const char* Chip8AOT::GetErrorName(const Error& error)
+{
+	switch (error)
+	{
+	case Error::NONE:
+		return "none";
+	case Error::OPEN_FAILED:
+		return "can't be loaded";
+	case Error::NOT_A_MODULE:
+		return "isn't a MoteAOT module";
+	case Error::VERSION_MISMATCH:
+		return "was made by another version";
+	default:
+		return "unknown";
+	}
+}
+
+static std::string Hex(const uint32_t& value, const int& digits)
+{
+	char buffer[16];
+	snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+	return buffer;
+}
+
+// Statements on the locals vN and i that do what the interpreter's handler
+// does, in the same order (VF may be X or Y as well)
+static std::string TranslateInstruction(const Id& id, const CPU::Opcode& opcode, const Chip8::Quirks& quirks)
+{
+	std::string x = "v" + std::to_string(opcode >> 8 & 0xF);
+	std::string y = "v" + std::to_string(opcode >> 4 & 0xF);
+	std::string nn = Hex(opcode & 0xFF, 2);
+	std::string nnn = Hex(opcode & 0xFFF, 3);
+	switch (id)
+	{
+	case Id::OP_6XNN:
+		return x + " = " + nn + ";";
+	case Id::OP_7XNN:
+		return x + " = (uint8_t)(" + x + " + " + nn + ");";
+	case Id::OP_8XY0:
+		return x + " = " + y + ";";
+	case Id::OP_8XY1:
+		return x + " |= " + y + ";";
+	case Id::OP_8XY2:
+		return x + " &= " + y + ";";
+	case Id::OP_8XY3:
+		return x + " ^= " + y + ";";
+	case Id::OP_8XY4:
+		return "{ int r = " + x + " + " + y + "; " + x + " = (uint8_t)(r & 0xFF); v15 = (uint8_t)(r & 0xF00); }";
+	case Id::OP_8XY5:
+		return "{ int r = " + x + " - " + y + "; " + x + " = (uint8_t)(r & 0xFF); v15 = r < 0 ? 0 : 1; }";
+	case Id::OP_8XY7:
+		return "{ int r = " + y + " - " + x + "; " + x + " = (uint8_t)(r & 0xFF); v15 = r < 0 ? 0 : 1; }";
+	case Id::OP_8XY6:
+		if (quirks & Chip8::SHIFT_VX)
+			return "v15 = " + x + " & 1; " + x + " >>= 1;";
+		return "{ uint8_t t = " + y + "; " + x + " = t >> 1; v15 = t & 1; }";
+	case Id::OP_8XYE:
+		if (quirks & Chip8::SHIFT_VX)
+			return "v15 = " + x + " >> 7; " + x + " = (uint8_t)(" + x + " << 1);";
+		return "{ uint8_t t = " + y + "; " + x + " = (uint8_t)(t << 1); v15 = t >> 7; }";
+	case Id::OP_ANNN:
+		return "i = " + nnn + ";";
+	case Id::OP_FX1E:
+		return "i = (uint16_t)(i + " + x + ");";
+	case Id::OP_FX29:
+		return "i = (uint16_t)(" + x + " * 5);";
+	default:
+		return "";
+	}
+}
+
+// The statement storing the PC after the last instruction of the prefix
+static std::string TranslateExit(const Id& id, const CPU::Opcode& opcode, const Chip8::Address& next, const Chip8::Quirks& quirks)
+{
+	std::string x = "v" + std::to_string(opcode >> 8 & 0xF);
+	std::string y = "v" + std::to_string(opcode >> 4 & 0xF);
+	std::string nn = Hex(opcode & 0xFF, 2);
+	std::string nnn = Hex(opcode & 0xFFF, 3);
+	std::string skip = Hex(next + Chip8::INSTRUCTION_SIZE, 3) + " : " + Hex(next, 3);
+	switch (id)
+	{
+	case Id::OP_1NNN:
+		return "*pc = " + nnn + ";";
+	case Id::OP_BNNN:
+		return "*pc = (uint16_t)(" + nnn + " + " + ((quirks & Chip8::JUMP_VX) ? x : "v0") + ");";
+	case Id::OP_3XNN:
+		return "*pc = " + x + " == " + nn + " ? " + skip + ";";
+	case Id::OP_4XNN:
+		return "*pc = " + x + " != " + nn + " ? " + skip + ";";
+	case Id::OP_5XY0:
+		return "*pc = " + x + " == " + y + " ? " + skip + ";";
+	case Id::OP_9XY0:
+		return "*pc = " + x + " != " + y + " ? " + skip + ";";
+	default: // Not a jump or skip, continue after it
+		return "*pc = " + Hex(next, 3) + ";";
+	}
+}
+
+// Registers read (bit 16 is I) and written by an instruction
+static void GetRegisters(const Id& id, const CPU::Opcode& opcode, const Chip8::Quirks& quirks, uint32_t& read, uint32_t& written)
+{
+	uint32_t x = 1u << (opcode >> 8 & 0xF);
+	uint32_t y = 1u << (opcode >> 4 & 0xF);
+	const uint32_t vf = 1u << 0xF;
+	const uint32_t i = 1u << 16;
+	switch (id)
+	{
+	case Id::OP_6XNN:
+		written |= x;
+		break;
+	case Id::OP_7XNN:
+		read |= x;
+		written |= x;
+		break;
+	case Id::OP_8XY0: case Id::OP_8XY1: case Id::OP_8XY2: case Id::OP_8XY3:
+		read |= x | y;
+		written |= x;
+		break;
+	case Id::OP_8XY4: case Id::OP_8XY5: case Id::OP_8XY6: case Id::OP_8XY7: case Id::OP_8XYE:
+		read |= x | y;
+		written |= x | vf;
+		break;
+	case Id::OP_3XNN: case Id::OP_4XNN: case Id::OP_FX29:
+		read |= x;
+		written |= id == Id::OP_FX29 ? i : 0;
+		break;
+	case Id::OP_5XY0: case Id::OP_9XY0:
+		read |= x | y;
+		break;
+	case Id::OP_ANNN:
+		written |= i;
+		break;
+	case Id::OP_FX1E:
+		read |= x | i;
+		written |= i;
+		break;
+	case Id::OP_BNNN:
+		read |= (quirks & Chip8::JUMP_VX) ? x : 1u;
+		break;
+	default:
+		break;
+	}
+}
+
+size_t Chip8AOT::Generate(const Byte* rom, const size_t& size, const Chip8::Quirks& quirks, std::ostream& out)
+{
+	ROMCatalog catalog;
+	ROMCatalog::Entry analysis = catalog.Lookup(rom, size);
+
+	// The memory as LoadProgram leaves it, the way ROMCatalog analyzed it
+	std::array<Byte, Chip8::RAM_SIZE> memory = { 0 };
+	std::copy(Chip8::FONT.begin(), Chip8::FONT.end(), memory.begin());
+	std::copy_n(rom, std::min(size, Chip8::RAM_SIZE - Chip8::USER_SPACE_ADDR), memory.begin() + Chip8::USER_SPACE_ADDR);
+
+	std::vector<ROMCatalog::BlockInfo> blocks(analysis.blocks, analysis.blocks + analysis.blockCount);
+	std::sort(blocks.begin(), blocks.end(),
+		[](const ROMCatalog::BlockInfo& lhs, const ROMCatalog::BlockInfo& rhs) { return lhs.start < rhs.start; });
+
+	out << "// Generated by MoteAOT, compile as a shared library and load with MoteEmuCLI --aot\n";
+	out << "#include <stdint.h>\n\n";
+	out << "#ifdef _WIN32\n#define MOTE_AOT_EXPORT extern \"C\" __declspec(dllexport)\n";
+	out << "#else\n#define MOTE_AOT_EXPORT extern \"C\" __attribute__((visibility(\"default\")))\n#endif\n\n";
+	out << "typedef uint32_t (*NativeCode)(uint8_t* v, uint16_t* i, uint16_t* pc);\n";
+	out << "struct BlockEntry { uint16_t start; uint16_t length; const uint16_t* opcodes; NativeCode code; };\n";
+	out << "struct Module { uint32_t magic; uint32_t version; uint64_t romHash; uint32_t quirks; uint32_t blockCount; const BlockEntry* blocks; };\n";
+
+	std::vector<std::string> table;
+	for (const ROMCatalog::BlockInfo& block : blocks)
+	{
+		// The register-only prefix, as the JIT would compile it
+		std::vector<CPU::Opcode> opcodes;
+		std::vector<Id> ids;
+		for (size_t n = 0; n < block.length; n++)
+		{
+			size_t addr = block.start + n * Chip8::INSTRUCTION_SIZE;
+			CPU::Opcode opcode = memory[addr & Chip8::ADDRESS_MASK] << 8 | memory[(addr + 1) & Chip8::ADDRESS_MASK];
+			Id id = Chip8::Decode(opcode);
+			if (!Chip8::IsRegisterOnly(id))
+				break;
+			opcodes.push_back(opcode);
+			ids.push_back(id);
+		}
+		if (opcodes.empty())
+			continue;
+
+		uint32_t read = 0;
+		uint32_t written = 0;
+		for (size_t n = 0; n < opcodes.size(); n++)
+			GetRegisters(ids[n], opcodes[n], quirks, read, written);
+		std::string name = Hex(block.start, 3).substr(2);
+		out << "\nstatic const uint16_t s_Opcodes" << name << "[] = {";
+		for (size_t n = 0; n < opcodes.size(); n++)
+			out << (n == 0 ? " " : ", ") << Hex(opcodes[n], 4);
+		out << " };\n";
+		out << "static uint32_t Block" << name << "(uint8_t* v, uint16_t* ip, uint16_t* pc)\n{\n";
+		for (size_t r = 0; r < 16; r++)
+		{
+			if ((read | written) >> r & 1)
+				out << "\tuint8_t v" << r << " = v[" << r << "];\n";
+		}
+		if ((read | written) >> 16 & 1)
+			out << "\tuint16_t i = *ip;\n";
+		for (size_t n = 0; n < opcodes.size(); n++)
+		{
+			if (!Chip8::EndsBlock(ids[n]))
+				out << "\t" << TranslateInstruction(ids[n], opcodes[n], quirks) << "\n";
+		}
+		for (size_t r = 0; r < 16; r++)
+		{
+			if (written >> r & 1)
+				out << "\tv[" << r << "] = v" << r << ";\n";
+		}
+		if (written >> 16 & 1)
+			out << "\t*ip = i;\n";
+		Chip8::Address next = static_cast<Chip8::Address>(block.start + opcodes.size() * Chip8::INSTRUCTION_SIZE);
+		out << "\t" << TranslateExit(ids.back(), opcodes.back(), next, quirks) << "\n";
+		out << "\treturn " << opcodes.size() << ";\n}\n";
+		table.push_back("{ " + Hex(block.start, 3) + ", " + std::to_string(opcodes.size()) + ", s_Opcodes" + name + ", Block" + name + " }");
+	}
+
+	out << "\nstatic const BlockEntry s_Blocks[] = {\n";
+	for (const std::string& entry : table)
+		out << "\t" << entry << ",\n";
+	if (table.empty())
+		out << "\t{ 0, 0, 0, 0 }\n"; // No empty arrays in C++, blockCount stays 0
+	out << "};\n";
+	char romHash[32];
+	snprintf(romHash, sizeof(romHash), "0x%016llXull", static_cast<unsigned long long>(Hash::Fnv1a(rom, size)));
+	out << "static const Module s_Module = { " << Hex(MAGIC, 8) << "u, " << VERSION << "u, " << romHash << ", "
+		<< quirks << "u, " << table.size() << "u, s_Blocks };\n\n";
+	out << "MOTE_AOT_EXPORT const Module* " << ENTRY_POINT << "()\n{\n\treturn &s_Module;\n}\n";
+	return table.size();
+}
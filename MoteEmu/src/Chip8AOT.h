@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ostream>
+
+#include "Chip8.h"
+
+// Ahead-of-time translation of a ROM into a shared library. Generate writes
+// C++ source with one function per statically reachable block (the blocks a
+// ROMCatalog finds) that runs the block's register-only prefix, the same
+// instructions the JIT compiles. MoteAOT compiles it with the host compiler,
+// Open loads the result and Chip8::SetAOT hands it to a machine, whose cached
+// and JIT modes then run those prefixes natively from the first execution.
+//
+// Blocks are matched by start address and opcodes when they're translated,
+// so blocks the module doesn't know (BNNN targets, code the ROM wrote) and
+// blocks whose instructions changed are simply interpreted.
+class Chip8AOT
+{
+public:
+	static constexpr const uint32_t MAGIC = 0x54414338; // "C8AT"
+	static constexpr const uint32_t VERSION = 2; // 2: 8XYE sets VF to 0 or 1
+	static constexpr const char* ENTRY_POINT = "MoteAOTGetModule";
+
+	// The module's ABI, also declared by the generated source
+	struct BlockEntry {
+		uint16_t start;
+		uint16_t length;          // Instructions run by `code`
+		const uint16_t* opcodes;  // The `length` opcodes it was compiled from
+		Chip8::NativeCode code;
+	};
+	struct Module {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t romHash;         // Hash::Fnv1a of the ROM
+		uint32_t quirks;
+		uint32_t blockCount;
+		const BlockEntry* blocks; // Sorted by start
+	};
+	typedef const Module* (*EntryPoint)();
+
+	enum class Error { NONE, OPEN_FAILED, NOT_A_MODULE, VERSION_MISMATCH };
+
+	Chip8AOT();
+	~Chip8AOT();
+	Chip8AOT(const Chip8AOT&) = delete;
+	Chip8AOT& operator=(const Chip8AOT&) = delete;
+
+	// Loads a module built from Generate's output. Machines using the
+	// previous module have to drop it first.
+	Error Open(const char* filename);
+	void Close();
+	bool IsOpen() const;
+	// Only valid while a module is open
+	const Module& GetModule() const;
+
+	// Gives the block the module's code if the module has a block with the
+	// same start and opcodes. Returns false otherwise.
+	bool Attach(Chip8::Block& block) const;
+
+	// Writes the module's source, returns the number of blocks compiled
+	static size_t Generate(const Byte* rom, const size_t& size, const Chip8::Quirks& quirks, std::ostream& out);
+	static const char* GetErrorName(const Error& error);
+private:
+	void* m_Library = nullptr;
+	const Module* m_Module = nullptr;
+};
@@ -0,0 +1,375 @@
+#include "Chip8JIT.h"
+
+#include <stdio.h>
+
+typedef Chip8::InstructionId Id;
+typedef X64Emitter::Register Reg;
+typedef X64Emitter::Alu Alu;
+typedef X64Emitter::Condition Cond;
+
+// Host registers that can hold V registers, the rest is reserved:
+// RAX, RCX, RDX scratch, RBX holds I, R13-R15 the state pointers
+static const Reg s_HostRegisters[] = {
+	Reg::RSI, Reg::RDI, Reg::R8, Reg::R9, Reg::R10, Reg::R11, Reg::R12, Reg::RBP
+};
+// Callee saved on either ABI (plus RSI/RDI on Windows), pushed by every block
+static const Reg s_SavedRegisters[] = {
+	Reg::RBX, Reg::RBP, Reg::RSI, Reg::RDI, Reg::R12, Reg::R13, Reg::R14, Reg::R15
+};
+
+// Returns the mask of V registers a compilable instruction touches
+static uint16_t TouchedRegisters(const Id& id, const Chip8::Instruction& instruction, const Chip8::Quirks& quirks)
+{
+	uint16_t x = 1 << instruction.x;
+	uint16_t y = 1 << instruction.y;
+	switch (id)
+	{
+	case Id::OP_3XNN:
+	case Id::OP_4XNN:
+	case Id::OP_6XNN:
+	case Id::OP_7XNN:
+	case Id::OP_FX1E:
+	case Id::OP_FX29:
+		return x;
+	case Id::OP_5XY0:
+	case Id::OP_9XY0:
+	case Id::OP_8XY0:
+	case Id::OP_8XY1:
+	case Id::OP_8XY2:
+	case Id::OP_8XY3:
+		return x | y;
+	case Id::OP_8XY4:
+	case Id::OP_8XY5:
+	case Id::OP_8XY6:
+	case Id::OP_8XY7:
+	case Id::OP_8XYE:
+		return x | y | 1 << 0xF;
+	case Id::OP_BNNN:
+		return (quirks & Chip8::JUMP_VX) ? x : 1 << 0;
+	default:
+		return 0;
+	}
+}
+
+static size_t BitCount(uint16_t mask)
+{
+	size_t count = 0;
+	for (; mask; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+Chip8JIT::Chip8JIT(Chip8& chip8)
+	:m_Chip8(chip8), m_CodeCache(CODE_CACHE_SIZE)
+{
+}
+
+Chip8JIT::~Chip8JIT()
+{
+}
+
+bool Chip8JIT::IsSupported()
+{
+#ifdef MOTE_JIT_SUPPORTED
+	return true;
+#else
+	return false;
+#endif // MOTE_JIT_SUPPORTED
+}
+
+size_t Chip8JIT::Execute(Chip8::Block& block, const size_t& budget)
+{
+	if (block.native == nullptr) {
+		if (block.executions >= HOT_THRESHOLD || ++block.executions < HOT_THRESHOLD || !Compile(block))
+			return 0;
+	}
+	if (block.nativeLength > budget)
+		return 0;
+	if (m_CrossCheck)
+		return ExecuteChecked(block);
+
+	size_t executed = block.native(m_Chip8.m_V.data(), &m_Chip8.m_I, &m_Chip8.m_PC);
+	m_Stats.nativeInstructions += executed;
+	return executed;
+}
+
+void Chip8JIT::Reset()
+{
+	m_CodeCache.Clear();
+}
+
+void Chip8JIT::SetCrossCheck(const bool& enabled)
+{
+	m_CrossCheck = enabled;
+}
+
+const Chip8JIT::Stats& Chip8JIT::GetStats() const
+{
+	return m_Stats;
+}
+
+bool Chip8JIT::Compile(Chip8::Block& block)
+{
+#ifdef MOTE_JIT_SUPPORTED
+	bool usesI = false;
+	size_t length = Allocate(block, m_RegisterMap, usesI);
+	if (length == 0)
+		return false;
+
+	m_Emitter.Clear();
+	m_WrittenV = 0;
+	m_WrittenI = false;
+
+	// Prologue: save registers, keep the state pointers and load the used state
+	for (const Reg& reg : s_SavedRegisters)
+		m_Emitter.Push(reg);
+#ifdef _WIN32
+	m_Emitter.Mov64(Reg::R15, Reg::RCX);
+	m_Emitter.Mov64(Reg::R14, Reg::RDX);
+	m_Emitter.Mov64(Reg::R13, Reg::R8);
+#else
+	m_Emitter.Mov64(Reg::R15, Reg::RDI);
+	m_Emitter.Mov64(Reg::R14, Reg::RSI);
+	m_Emitter.Mov64(Reg::R13, Reg::RDX);
+#endif // _WIN32
+	for (size_t v = 0; v < m_RegisterMap.size(); v++)
+	{
+		if (m_RegisterMap[v] >= 0)
+			m_Emitter.Load8(Host(v), Reg::R15, static_cast<int8_t>(v));
+	}
+	if (usesI)
+		m_Emitter.Load16(Reg::RBX, Reg::R14);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		const Chip8::Instruction& instruction = block.code[i].instruction;
+		Id id = Chip8::Decode(instruction.opcode);
+		Chip8::Address next = static_cast<Chip8::Address>(block.start + (i + 1) * Chip8::INSTRUCTION_SIZE);
+		if (!Chip8::EndsBlock(id))
+			EmitInstruction(id, instruction);
+		if (Chip8::EndsBlock(id) || i + 1 == length)
+			EmitExit(id, instruction, next, length);
+	}
+
+	const std::vector<uint8_t>& code = m_Emitter.GetCode();
+	void* native = m_CodeCache.Commit(code.data(), code.size());
+	if (native == nullptr) {
+		// Out of space: throw away all code and let the blocks get hot again
+		m_Stats.cacheFlushes++;
+		m_CodeCache.Clear();
+		m_Chip8.m_BlockCache->Clear();
+		return false;
+	}
+	block.native = reinterpret_cast<Chip8::NativeCode>(native);
+	block.nativeLength = static_cast<uint16_t>(length);
+	m_Stats.compiledBlocks++;
+	return true;
+#else
+	return false;
+#endif // MOTE_JIT_SUPPORTED
+}
+
+size_t Chip8JIT::Allocate(const Chip8::Block& block, RegisterMap& map, bool& usesI)
+{
+	uint16_t used = 0;
+	size_t length = 0;
+	for (const Chip8::CachedInstruction& entry : block.code)
+	{
+		Id id = Chip8::Decode(entry.instruction.opcode);
+		if (!Chip8::IsRegisterOnly(id))
+			break;
+		uint16_t registers = used | TouchedRegisters(id, entry.instruction, m_Chip8.m_Quirks);
+		if (BitCount(registers) > HOST_REGISTER_COUNT)
+			break;
+		used = registers;
+		usesI |= id == Id::OP_FX1E;
+		length++;
+	}
+
+	int8_t slot = 0;
+	for (size_t v = 0; v < map.size(); v++)
+		map[v] = (used >> v & 1) ? slot++ : -1;
+	return length;
+}
+
+void Chip8JIT::EmitInstruction(const Id& id, const Chip8::Instruction& instruction)
+{
+	Reg vx = Host(instruction.x);
+	Reg vy = Host(instruction.y);
+	Reg vf = Host(0xF);
+	switch (id)
+	{
+	case Id::OP_6XNN:
+		m_Emitter.Mov8(vx, instruction.nn);
+		break;
+	case Id::OP_7XNN:
+		m_Emitter.Alu8(Alu::ADD, vx, instruction.nn);
+		break;
+	case Id::OP_8XY0:
+		m_Emitter.Mov8(vx, vy);
+		break;
+	case Id::OP_8XY1:
+		m_Emitter.Alu8(Alu::OR, vx, vy);
+		break;
+	case Id::OP_8XY2:
+		m_Emitter.Alu8(Alu::AND, vx, vy);
+		break;
+	case Id::OP_8XY3:
+		m_Emitter.Alu8(Alu::XOR, vx, vy);
+		break;
+	case Id::OP_8XY4:
+		// Matches the interpreter, which stores (result & 0xF00) truncated to a byte
+		m_Emitter.Alu8(Alu::ADD, vx, vy);
+		m_Emitter.Mov8(vf, 0);
+		break;
+	case Id::OP_8XY5:
+	case Id::OP_8XY7:
+		// VF = no borrow, written after VX as in the interpreter
+		m_Emitter.Mov8(Reg::RAX, id == Id::OP_8XY5 ? vx : vy);
+		m_Emitter.Alu8(Alu::SUB, Reg::RAX, id == Id::OP_8XY5 ? vy : vx);
+		m_Emitter.Setcc(Cond::AE, Reg::RCX);
+		m_Emitter.Mov8(vx, Reg::RAX);
+		m_Emitter.Mov8(vf, Reg::RCX);
+		break;
+	case Id::OP_8XY6:
+	case Id::OP_8XYE:
+		// With SHIFT_VX, VF first, then VX shifted in place. Otherwise VY shifted into VX, then VF
+		m_Emitter.Mov8(Reg::RAX, (m_Chip8.m_Quirks & Chip8::SHIFT_VX) ? vx : vy);
+		if (!(m_Chip8.m_Quirks & Chip8::SHIFT_VX))
+			m_Emitter.Mov8(vx, Reg::RAX);
+		// The bit shifted out, as 0 or 1
+		if (id == Id::OP_8XY6)
+			m_Emitter.Alu8(Alu::AND, Reg::RAX, 0x01);
+		else
+			m_Emitter.Shr8(Reg::RAX, 7);
+		if (m_Chip8.m_Quirks & Chip8::SHIFT_VX)
+			m_Emitter.Mov8(vf, Reg::RAX);
+		if (id == Id::OP_8XY6)
+			m_Emitter.Shr8(vx);
+		else
+			m_Emitter.Shl8(vx);
+		if (!(m_Chip8.m_Quirks & Chip8::SHIFT_VX))
+			m_Emitter.Mov8(vf, Reg::RAX);
+		break;
+	case Id::OP_ANNN:
+		m_Emitter.Mov32(Reg::RBX, instruction.nnn);
+		m_WrittenI = true;
+		break;
+	case Id::OP_FX1E:
+		m_Emitter.Movzx8(Reg::RAX, vx);
+		m_Emitter.Add32(Reg::RBX, Reg::RAX);
+		m_WrittenI = true;
+		break;
+	case Id::OP_FX29:
+		m_Emitter.Movzx8(Reg::RBX, vx);
+		m_Emitter.Imul32(Reg::RBX, Reg::RBX, 5);
+		m_WrittenI = true;
+		break;
+	default:
+		break;
+	}
+
+	switch (id)
+	{
+	case Id::OP_6XNN: case Id::OP_7XNN: case Id::OP_8XY0: case Id::OP_8XY1:
+	case Id::OP_8XY2: case Id::OP_8XY3:
+		m_WrittenV |= 1 << instruction.x;
+		break;
+	case Id::OP_8XY4: case Id::OP_8XY5: case Id::OP_8XY6: case Id::OP_8XY7:
+	case Id::OP_8XYE:
+		m_WrittenV |= 1 << instruction.x | 1 << 0xF;
+		break;
+	default:
+		break;
+	}
+}
+
+void Chip8JIT::EmitExit(const Id& id, const Chip8::Instruction& instruction, const Chip8::Address& next, const size_t& length)
+{
+	// Write back the state that changed
+	for (size_t v = 0; v < m_RegisterMap.size(); v++)
+	{
+		if (m_WrittenV >> v & 1)
+			m_Emitter.Store8(Reg::R15, static_cast<int8_t>(v), Host(v));
+	}
+	if (m_WrittenI)
+		m_Emitter.Store16(Reg::R14, Reg::RBX);
+
+	// Store the next PC
+	switch (id)
+	{
+	case Id::OP_1NNN:
+		m_Emitter.Store16(Reg::R13, instruction.nnn);
+		break;
+	case Id::OP_BNNN:
+		m_Emitter.Movzx8(Reg::RDX, Host((m_Chip8.m_Quirks & Chip8::JUMP_VX) ? instruction.x : 0));
+		m_Emitter.Add32(Reg::RDX, instruction.nnn);
+		m_Emitter.Store16(Reg::R13, Reg::RDX);
+		break;
+	case Id::OP_3XNN:
+	case Id::OP_4XNN:
+	case Id::OP_5XY0:
+	case Id::OP_9XY0:
+		m_Emitter.Mov32(Reg::RDX, next);
+		m_Emitter.Mov32(Reg::RCX, next + Chip8::INSTRUCTION_SIZE);
+		if (id == Id::OP_3XNN || id == Id::OP_4XNN)
+			m_Emitter.Alu8(Alu::CMP, Host(instruction.x), instruction.nn);
+		else
+			m_Emitter.Alu8(Alu::CMP, Host(instruction.x), Host(instruction.y));
+		m_Emitter.Cmov32((id == Id::OP_3XNN || id == Id::OP_5XY0) ? Cond::E : Cond::NE, Reg::RDX, Reg::RCX);
+		m_Emitter.Store16(Reg::R13, Reg::RDX);
+		break;
+	default: // Not a jump or skip, continue after it
+		m_Emitter.Store16(Reg::R13, next);
+		break;
+	}
+
+	// Epilogue
+	m_Emitter.Mov32(Reg::RAX, static_cast<uint32_t>(length));
+	for (size_t i = sizeof(s_SavedRegisters) / sizeof(s_SavedRegisters[0]); i > 0; i--)
+		m_Emitter.Pop(s_SavedRegisters[i - 1]);
+	m_Emitter.Ret();
+}
+
+size_t Chip8JIT::ExecuteChecked(Chip8::Block& block)
+{
+	std::array<Chip8::Register8, 16> v = m_Chip8.m_V;
+	Chip8::Register16 i = m_Chip8.m_I;
+	Chip8::Address pc = m_Chip8.m_PC;
+
+	size_t executed = block.native(m_Chip8.m_V.data(), &m_Chip8.m_I, &m_Chip8.m_PC);
+	m_Stats.nativeInstructions += executed;
+	std::array<Chip8::Register8, 16> nativeV = m_Chip8.m_V;
+	Chip8::Register16 nativeI = m_Chip8.m_I;
+	Chip8::Address nativePC = m_Chip8.m_PC;
+
+	// Replay the same instructions through the interpreter. They only touch registers.
+	m_Chip8.m_V = v;
+	m_Chip8.m_I = i;
+	m_Chip8.m_PC = pc;
+	for (size_t n = 0; n < executed; n++)
+	{
+		const Chip8::CachedInstruction& entry = block.code[n];
+		m_Chip8.m_PC += Chip8::INSTRUCTION_SIZE;
+		(m_Chip8.*entry.handler)(entry.instruction);
+	}
+
+	if (nativeV != m_Chip8.m_V || nativeI != m_Chip8.m_I || nativePC != m_Chip8.m_PC) {
+		m_Stats.mismatches++;
+		printf("JIT mismatch in block 0x%03X (%u instructions): PC 0x%03X/0x%03X, I 0x%03X/0x%03X\n",
+			block.start, static_cast<unsigned>(executed), nativePC, m_Chip8.m_PC, nativeI, m_Chip8.m_I);
+		for (size_t n = 0; n < v.size(); n++)
+		{
+			if (nativeV[n] != m_Chip8.m_V[n])
+				printf("  V%X: native 0x%02X, interpreter 0x%02X\n", static_cast<unsigned>(n), nativeV[n], m_Chip8.m_V[n]);
+		}
+	}
+	// The interpreter's state is kept either way
+	return executed;
+}
+
+X64Emitter::Register Chip8JIT::Host(const size_t& v) const
+{
+	int8_t slot = m_RegisterMap[v];
+	return slot >= 0 ? s_HostRegisters[slot] : Reg::RAX;
+}
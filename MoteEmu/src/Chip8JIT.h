@@ -0,0 +1,64 @@
+#pragma once
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MOTE_JIT_SUPPORTED
+#endif
+
+#include "Chip8.h"
+#include "CodeCache.h"
+#include "X64Emitter.h"
+
+// Translates hot Chip8 basic blocks into x86-64 code. Only the prefix of a
+// block made of register-only instructions is compiled; the rest of the block
+// is left to the cached interpreter. Within native code the used V registers
+// and I live in host registers and PC is tracked statically.
+class Chip8JIT
+{
+public:
+	static constexpr const size_t CODE_CACHE_SIZE = 256 * 1024;
+	static constexpr const uint16_t HOT_THRESHOLD = 4; // Executions before a block is compiled
+
+	struct Stats {
+		uint64_t compiledBlocks = 0;
+		uint64_t nativeInstructions = 0;
+		uint64_t cacheFlushes = 0;
+		uint64_t mismatches = 0; // Only counted in cross-check mode
+	};
+
+	explicit Chip8JIT(Chip8& chip8);
+	~Chip8JIT();
+
+	// Runs the compiled prefix of the block (compiling it once it's hot).
+	// Returns the number of instructions executed natively, 0 if the
+	// whole block should be interpreted.
+	size_t Execute(Chip8::Block& block, const size_t& budget);
+	// Drops all compiled code
+	void Reset();
+
+	// Runs every native block through the interpreter as well and compares the results
+	void SetCrossCheck(const bool& enabled);
+	const Stats& GetStats() const;
+
+	static bool IsSupported();
+private:
+	static constexpr const size_t HOST_REGISTER_COUNT = 8;
+	typedef std::array<int8_t, 16> RegisterMap; // V index -> host register slot (-1 if unused)
+
+	bool Compile(Chip8::Block& block);
+	size_t Allocate(const Chip8::Block& block, RegisterMap& map, bool& usesI);
+	void EmitInstruction(const Chip8::InstructionId& id, const Chip8::Instruction& instruction);
+	void EmitExit(const Chip8::InstructionId& id, const Chip8::Instruction& instruction, const Chip8::Address& next, const size_t& length);
+	size_t ExecuteChecked(Chip8::Block& block);
+	X64Emitter::Register Host(const size_t& v) const;
+
+	Chip8& m_Chip8;
+	CodeCache m_CodeCache;
+	X64Emitter m_Emitter;
+	Stats m_Stats;
+	bool m_CrossCheck = false;
+
+	// Compilation state of the current block
+	RegisterMap m_RegisterMap;
+	uint16_t m_WrittenV = 0; // Bit N set if VN was written
+	bool m_WrittenI = false;
+};
@@ -0,0 +1,458 @@
+#include "Chip8Lockstep.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+typedef Chip8::InstructionId Id;
+
+// Blends a and b by a lane mask (0xFF takes a, 0 takes b) without branching
+static inline Byte Select(const Byte& mask, const Byte& a, const Byte& b)
+{
+	return static_cast<Byte>((a & mask) | (b & ~mask));
+}
+
+static inline Chip8::Address Select(const Byte& mask, const Chip8::Address& a, const Chip8::Address& b)
+{
+	Chip8::Address wide = static_cast<Chip8::Address>(static_cast<int8_t>(mask)); // 0xFF -> 0xFFFF
+	return static_cast<Chip8::Address>((a & wide) | (b & ~wide));
+}
+
+static inline bool IsPressed(const uint16_t& keys, const Byte& key)
+{
+	return key < 16 && (keys >> key) & 1;
+}
+
+double Chip8Lockstep::Stats::AverageGroupSize() const
+{
+	return groups ? static_cast<double>(steps) / groups : 0.0;
+}
+
+Chip8Lockstep::Chip8Lockstep(const size_t& lanes)
+	:m_Lanes(lanes), m_Stride((lanes + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN)
+{
+	m_V.assign(16 * m_Stride, 0);
+	m_I.assign(m_Stride, 0);
+	m_PC.assign(m_Stride, Chip8::USER_SPACE_ADDR);
+	m_Delay.assign(m_Stride, 0);
+	m_Sound.assign(m_Stride, 0);
+	m_StackDepth.assign(m_Stride, 0);
+	m_Stack.assign(m_Lanes * Chip8::STACK_SIZE, 0);
+	m_Keys.assign(m_Stride, 0);
+	m_Executed.assign(m_Stride, 0);
+	m_Errors.assign(m_Stride, nullptr);
+	m_RNG.resize(m_Lanes);
+	m_RAM.assign(m_Lanes * RAM_SIZE, 0);
+	m_Display.resize(m_Lanes);
+	m_Pending.assign(m_Stride, 0);
+	m_Mask.assign(m_Stride, 0);
+	m_Group.reserve(m_Lanes);
+	std::random_device seeder;
+	for (Random& rng : m_RNG)
+		rng.Seed(seeder());
+}
+
+Chip8Lockstep::~Chip8Lockstep()
+{
+}
+
+bool Chip8Lockstep::LoadProgram(const Byte* rom, const size_t& size)
+{
+	if (size + Chip8::USER_SPACE_ADDR > RAM_SIZE)
+		return false;
+	std::fill(m_V.begin(), m_V.end(), 0);
+	std::fill(m_I.begin(), m_I.end(), Chip8::NULLPTR);
+	std::fill(m_PC.begin(), m_PC.end(), Chip8::USER_SPACE_ADDR);
+	std::fill(m_Delay.begin(), m_Delay.end(), 0);
+	std::fill(m_Sound.begin(), m_Sound.end(), 0);
+	std::fill(m_StackDepth.begin(), m_StackDepth.end(), 0);
+	std::fill(m_Stack.begin(), m_Stack.end(), 0);
+	std::fill(m_Executed.begin(), m_Executed.end(), 0);
+	std::fill(m_Errors.begin(), m_Errors.end(), nullptr);
+	for (size_t lane = 0; lane < m_Lanes; lane++)
+	{
+		m_Display[lane].Clear();
+		Byte* ram = RAM(lane);
+		std::fill_n(ram, RAM_SIZE, 0);
+		std::copy(Chip8::FONT.begin(), Chip8::FONT.end(), ram);
+		std::copy_n(rom, size, ram + Chip8::USER_SPACE_ADDR);
+	}
+	m_ProgramEnd = static_cast<Address>(Chip8::USER_SPACE_ADDR + size);
+	m_Cycles = 0;
+	m_FrameBase = 0;
+	m_Frame = 0;
+	return true;
+}
+
+bool Chip8Lockstep::LoadProgram(const Memory& rom)
+{
+	return LoadProgram(rom.data(), rom.size());
+}
+
+void Chip8Lockstep::Seed(const size_t& lane, const uint32_t& seed)
+{
+	m_RNG[lane].Seed(seed);
+}
+
+void Chip8Lockstep::SetKeyState(const size_t& lane, const uint16_t& keys)
+{
+	m_Keys[lane] = keys;
+}
+
+void Chip8Lockstep::SetInstructionsPerSecond(const uint32_t& ips)
+{
+	// Starts a new frame, like Scheduler::SetInstructionsPerSecond
+	m_IPS = std::max(ips, 1u);
+	m_FrameBase = m_Cycles;
+	m_Frame = 0;
+}
+
+size_t Chip8Lockstep::Run(const size_t& cycles)
+{
+	size_t executed = 0;
+	for (size_t cycle = 0; cycle < cycles; cycle++)
+	{
+		size_t pending = 0;
+		for (size_t lane = 0; lane < m_Lanes; lane++)
+		{
+			m_Pending[lane] = IsRunnable(lane) ? 0xFF : 0;
+			pending += m_Pending[lane] & 1;
+		}
+		if (pending == 0)
+			break;
+
+		// Every running lane executes one instruction per step. The lanes are
+		// grouped by PC and opcode (RAM may differ), one group at a time.
+		size_t leader = 0;
+		bool first = true;
+		while (pending > 0)
+		{
+			while (!m_Pending[leader])
+				leader++;
+			Address pc = m_PC[leader];
+			CPU::Opcode opcode = FetchOpcode(leader);
+
+			m_Group.clear();
+			for (size_t lane = leader; lane < m_Lanes; lane++)
+			{
+				bool member = m_Pending[lane] && m_PC[lane] == pc && FetchOpcode(lane) == opcode;
+				m_Mask[lane] = member ? 0xFF : 0;
+				if (member)
+					m_Group.push_back(lane);
+			}
+			for (size_t lane = 0; lane < leader; lane++)
+				m_Mask[lane] = 0;
+			pending -= m_Group.size();
+			if (first && pending > 0)
+				m_Stats.divergent++;
+			first = false;
+
+			const Byte* mask = m_Mask.data();
+			Byte* remaining = m_Pending.data();
+			Address* pcs = m_PC.data();
+			Dense([&](const size_t& lane) {
+				remaining[lane] &= ~mask[lane];
+				pcs[lane] += mask[lane] & Chip8::INSTRUCTION_SIZE; // Move to the next instruction
+			});
+			for (size_t lane : m_Group)
+				m_Executed[lane]++;
+
+			Execute(Chip8::Decode(opcode), Chip8::MakeInstruction(opcode));
+			m_Stats.groups++;
+			m_Stats.steps += m_Group.size();
+			executed += m_Group.size();
+		}
+
+		m_Cycles++;
+		while (m_Cycles - m_FrameBase == Scheduler::FrameEnd(m_Frame, m_IPS))
+		{
+			TickTimers();
+			m_Frame++;
+		}
+	}
+	return executed;
+}
+
+size_t Chip8Lockstep::GetLaneCount() const
+{
+	return m_Lanes;
+}
+
+uint64_t Chip8Lockstep::GetExecuted(const size_t& lane) const
+{
+	return m_Executed[lane];
+}
+
+const char* Chip8Lockstep::GetError(const size_t& lane) const
+{
+	return m_Errors[lane];
+}
+
+uint64_t Chip8Lockstep::GetStateHash(const size_t& lane) const
+{
+	std::array<Byte, 16> v;
+	for (size_t i = 0; i < v.size(); i++)
+		v[i] = m_V[i * m_Stride + lane];
+	uint64_t hash = Hash::Fnv1a(v.data(), v.size());
+	hash = Hash::Fnv1aValue(m_I[lane], hash);
+	hash = Hash::Fnv1aValue(m_PC[lane], hash);
+	hash = Hash::Fnv1aValue(m_Delay[lane], hash);
+	hash = Hash::Fnv1aValue(m_Sound[lane], hash);
+	hash = Hash::Fnv1aValue(m_StackDepth[lane], hash);
+	hash = Hash::Fnv1a(&m_Stack[lane * Chip8::STACK_SIZE], m_StackDepth[lane] * sizeof(Address), hash);
+	return Hash::Fnv1a(RAM(lane), RAM_SIZE, hash);
+}
+
+const Display& Chip8Lockstep::GetDisplay(const size_t& lane) const
+{
+	return m_Display[lane];
+}
+
+const Chip8Lockstep::Stats& Chip8Lockstep::GetStats() const
+{
+	return m_Stats;
+}
+
+void Chip8Lockstep::Execute(const InstructionId& id, const Chip8::Instruction& instruction)
+{
+	const Byte* mask = m_Mask.data();
+	Byte* vx = Register(instruction.x);
+	Byte* vy = Register(instruction.y);
+	Byte* vf = Register(0xF);
+	Address* pc = m_PC.data();
+	Address* regI = m_I.data();
+	const Byte nn = instruction.nn;
+	const Address nnn = instruction.nnn;
+
+	switch (id)
+	{
+	case Id::UNKNOWN:
+	case Id::OP_0NNN:
+		// Chip8 only reports these
+		break;
+	case Id::OP_00E0:
+		Sparse([&](const size_t& lane) { m_Display[lane].Clear(); });
+		break;
+	case Id::OP_00EE:
+		Sparse([&](const size_t& lane) { Pop(lane); });
+		break;
+	case Id::OP_1NNN:
+		Dense([&](const size_t& lane) { pc[lane] = Select(mask[lane], nnn, pc[lane]); });
+		break;
+	case Id::OP_2NNN:
+		Sparse([&](const size_t& lane) {
+			Push(lane, pc[lane]);
+			if (m_Errors[lane] == nullptr)
+				pc[lane] = nnn;
+		});
+		break;
+	case Id::OP_3XNN:
+		Dense([&](const size_t& lane) { pc[lane] += mask[lane] & (vx[lane] == nn ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_4XNN:
+		Dense([&](const size_t& lane) { pc[lane] += mask[lane] & (vx[lane] != nn ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_5XY0:
+		Dense([&](const size_t& lane) { pc[lane] += mask[lane] & (vx[lane] == vy[lane] ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_6XNN:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], nn, vx[lane]); });
+		break;
+	case Id::OP_7XNN:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] + nn), vx[lane]); });
+		break;
+	case Id::OP_8XY0:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], vy[lane], vx[lane]); });
+		break;
+	case Id::OP_8XY1:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] | vy[lane]), vx[lane]); });
+		break;
+	case Id::OP_8XY2:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] & vy[lane]), vx[lane]); });
+		break;
+	case Id::OP_8XY3:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] ^ vy[lane]), vx[lane]); });
+		break;
+	// The flag writes below follow the order of the Chip8 handlers, which matters when X or Y is F
+	case Id::OP_8XY4:
+		Dense([&](const size_t& lane) {
+			Byte sum = static_cast<Byte>(vx[lane] + vy[lane]);
+			vx[lane] = Select(mask[lane], sum, vx[lane]);
+			vf[lane] = Select(mask[lane], static_cast<Byte>(0), vf[lane]); // Chip8 stores (result & 0xF00) as a byte
+		});
+		break;
+	case Id::OP_8XY5:
+		Dense([&](const size_t& lane) {
+			Byte noBorrow = vx[lane] >= vy[lane] ? 1 : 0;
+			vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] - vy[lane]), vx[lane]);
+			vf[lane] = Select(mask[lane], noBorrow, vf[lane]);
+		});
+		break;
+	case Id::OP_8XY6:
+		Dense([&](const size_t& lane) {
+			vf[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] & 1), vf[lane]);
+			vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] >> 1), vx[lane]);
+		});
+		break;
+	case Id::OP_8XY7:
+		Dense([&](const size_t& lane) {
+			Byte noBorrow = vy[lane] >= vx[lane] ? 1 : 0;
+			vx[lane] = Select(mask[lane], static_cast<Byte>(vy[lane] - vx[lane]), vx[lane]);
+			vf[lane] = Select(mask[lane], noBorrow, vf[lane]);
+		});
+		break;
+	case Id::OP_8XYE:
+		Dense([&](const size_t& lane) {
+			vf[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] >> 7), vf[lane]);
+			vx[lane] = Select(mask[lane], static_cast<Byte>(vx[lane] << 1), vx[lane]);
+		});
+		break;
+	case Id::OP_9XY0:
+		Dense([&](const size_t& lane) { pc[lane] += mask[lane] & (vx[lane] != vy[lane] ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_ANNN:
+		Dense([&](const size_t& lane) { regI[lane] = Select(mask[lane], nnn, regI[lane]); });
+		break;
+	case Id::OP_BNNN: {
+		const Byte* v0 = Register(0);
+		Dense([&](const size_t& lane) { pc[lane] = Select(mask[lane], static_cast<Address>(nnn + v0[lane]), pc[lane]); });
+		break;
+	}
+	case Id::OP_CXNN:
+		Sparse([&](const size_t& lane) { vx[lane] = m_RNG[lane].NextByte() & nn; });
+		break;
+	case Id::OP_DXYN:
+		Sparse([&](const size_t& lane) { Draw(lane, instruction); });
+		break;
+	case Id::OP_EX9E:
+		Dense([&](const size_t& lane) { pc[lane] += mask[lane] & (IsPressed(m_Keys[lane], vx[lane]) ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_EXA1:
+		Dense([&](const size_t& lane) { pc[lane] += mask[lane] & (!IsPressed(m_Keys[lane], vx[lane]) ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_FX07:
+		Dense([&](const size_t& lane) { vx[lane] = Select(mask[lane], m_Delay[lane], vx[lane]); });
+		break;
+	case Id::OP_FX0A:
+		// Input can't change during Run, so the instruction is retried on the next step like in Chip8
+		Dense([&](const size_t& lane) { pc[lane] -= mask[lane] & (!IsPressed(m_Keys[lane], vx[lane]) ? Chip8::INSTRUCTION_SIZE : 0); });
+		break;
+	case Id::OP_FX15:
+		Dense([&](const size_t& lane) { m_Delay[lane] = Select(mask[lane], vx[lane], m_Delay[lane]); });
+		break;
+	case Id::OP_FX18:
+		Dense([&](const size_t& lane) { m_Sound[lane] = Select(mask[lane], vx[lane], m_Sound[lane]); });
+		break;
+	case Id::OP_FX1E:
+		Dense([&](const size_t& lane) { regI[lane] = Select(mask[lane], static_cast<Address>(regI[lane] + vx[lane]), regI[lane]); });
+		break;
+	case Id::OP_FX29:
+		Dense([&](const size_t& lane) { regI[lane] = Select(mask[lane], static_cast<Address>(vx[lane] * 5), regI[lane]); });
+		break;
+	case Id::OP_FX33:
+		Sparse([&](const size_t& lane) {
+			Byte digits[] = { static_cast<Byte>(vx[lane] / 100), static_cast<Byte>(vx[lane] / 10 % 10), static_cast<Byte>(vx[lane] % 10) };
+			for (size_t i = 0; i < 3; i++)
+				RAM(lane)[(regI[lane] + i) & Chip8::ADDRESS_MASK] = digits[i];
+		});
+		break;
+	case Id::OP_FX55:
+		Sparse([&](const size_t& lane) {
+			for (size_t i = 0; i <= instruction.x; i++)
+				RAM(lane)[(regI[lane] + i) & Chip8::ADDRESS_MASK] = Register(i)[lane];
+		});
+		break;
+	case Id::OP_FX65:
+		Sparse([&](const size_t& lane) {
+			for (size_t i = 0; i <= instruction.x; i++)
+				Register(i)[lane] = RAM(lane)[(regI[lane] + i) & Chip8::ADDRESS_MASK];
+		});
+		break;
+	default:
+		break;
+	}
+}
+
+void Chip8Lockstep::TickTimers()
+{
+	// Only the lanes that made it through every step so far reach the frame boundary
+	Byte* delay = m_Delay.data();
+	Byte* sound = m_Sound.data();
+	for (size_t lane = 0; lane < m_Lanes; lane++)
+	{
+		bool tick = m_Executed[lane] == m_Cycles && m_Errors[lane] == nullptr;
+		delay[lane] -= tick && delay[lane] > 0;
+		sound[lane] -= tick && sound[lane] > 0;
+	}
+}
+
+template<typename Fn>
+inline void Chip8Lockstep::Dense(Fn fn)
+{
+	for (size_t lane = 0; lane < m_Stride; lane++)
+		fn(lane);
+}
+
+template<typename Fn>
+inline void Chip8Lockstep::Sparse(Fn fn)
+{
+	for (size_t lane : m_Group)
+		fn(lane);
+}
+
+inline Byte* Chip8Lockstep::Register(const size_t& index)
+{
+	return &m_V[index * m_Stride];
+}
+
+inline Byte* Chip8Lockstep::RAM(const size_t& lane)
+{
+	return &m_RAM[lane * RAM_SIZE];
+}
+
+inline const Byte* Chip8Lockstep::RAM(const size_t& lane) const
+{
+	return &m_RAM[lane * RAM_SIZE];
+}
+
+inline bool Chip8Lockstep::IsRunnable(const size_t& lane) const
+{
+	return m_Errors[lane] == nullptr && m_PC[lane] <= m_ProgramEnd;
+}
+
+inline CPU::Opcode Chip8Lockstep::FetchOpcode(const size_t& lane) const
+{
+	const Byte* ram = RAM(lane);
+	return ram[m_PC[lane] & Chip8::ADDRESS_MASK] << 8 | ram[(m_PC[lane] + 1) & Chip8::ADDRESS_MASK];
+}
+
+inline void Chip8Lockstep::Fail(const size_t& lane, const char* error)
+{
+	m_Errors[lane] = error;
+}
+
+inline void Chip8Lockstep::Push(const size_t& lane, const Address& value)
+{
+	if (m_StackDepth[lane] == Chip8::STACK_SIZE)
+		return Fail(lane, "Stack overflow!");
+	m_Stack[lane * Chip8::STACK_SIZE + m_StackDepth[lane]++] = value;
+}
+
+inline void Chip8Lockstep::Pop(const size_t& lane)
+{
+	if (m_StackDepth[lane] == 0)
+		return Fail(lane, "Stack underflow!");
+	m_PC[lane] = m_Stack[lane * Chip8::STACK_SIZE + --m_StackDepth[lane]];
+}
+
+inline void Chip8Lockstep::Draw(const size_t& lane, const Chip8::Instruction& instruction)
+{
+	// Rows past the end of RAM wrap around, like in Chip8
+	Address base = m_I[lane] & Chip8::ADDRESS_MASK;
+	std::array<Byte, 16> sprite;
+	for (size_t i = 0; i < instruction.n; i++)
+		sprite[i] = RAM(lane)[(base + i) & Chip8::ADDRESS_MASK];
+	bool collision = m_Display[lane].Draw(Register(instruction.x)[lane], Register(instruction.y)[lane], sprite.data(), instruction.n);
+	Register(0xF)[lane] = collision ? 1 : 0;
+}
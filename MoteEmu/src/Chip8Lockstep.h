@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+
+#include "Chip8.h"
+#include "Scheduler.h"
+
+// Runs many copies of one program side by side, e.g. with different seeds or
+// input. The machine state is kept as structure of arrays (one array per
+// register, indexed by lane) and every instruction is executed for all lanes
+// that are at the same PC at once. Register-only instructions are branch free
+// loops over the lane arrays that the compiler vectorizes (SSE2 by default,
+// AVX2 with the "avx2" premake option); lanes outside the current group are
+// masked out. Lanes whose PCs diverge are regrouped on every step.
+// Each lane behaves exactly like a fresh Chip8 (with Chip8::DEFAULT_QUIRKS) on
+// a HeadlessVM, including the timer ticks at the Scheduler's frame boundaries.
+class Chip8Lockstep
+{
+public:
+	typedef Chip8::Address Address;
+	static constexpr const size_t RAM_SIZE = Chip8::RAM_SIZE;
+	static constexpr const size_t LANE_ALIGN = 32; // Lane arrays are padded to a whole AVX2 register of bytes
+
+	struct Stats {
+		uint64_t steps = 0;     // Instructions executed by all lanes together
+		uint64_t groups = 0;    // Times an instruction was dispatched to a group of lanes
+		uint64_t divergent = 0; // Rounds in which the running lanes were at more than one PC
+
+		double AverageGroupSize() const;
+	};
+
+	explicit Chip8Lockstep(const size_t& lanes);
+	~Chip8Lockstep();
+
+	// Resets every lane and loads the same program into all of them.
+	// Returns false, leaving the lanes untouched, if it doesn't fit into memory.
+	bool LoadProgram(const Byte* rom, const size_t& size);
+	bool LoadProgram(const Memory& rom);
+	void Seed(const size_t& lane, const uint32_t& seed);
+	// Bit N set means key N is held down
+	void SetKeyState(const size_t& lane, const uint16_t& keys);
+	// Sets where the frame boundaries fall, see Scheduler
+	void SetInstructionsPerSecond(const uint32_t& ips);
+	// Executes up to `cycles` instructions on every lane. Returns the number
+	// of instructions executed by all lanes together.
+	size_t Run(const size_t& cycles);
+
+	size_t GetLaneCount() const;
+	uint64_t GetExecuted(const size_t& lane) const;
+	// Set once the lane hit what would be an exception in Chip8, the lane stops then
+	const char* GetError(const size_t& lane) const;
+	// Same value as Chip8::GetStateHash of the equivalent machine
+	uint64_t GetStateHash(const size_t& lane) const;
+	const Display& GetDisplay(const size_t& lane) const;
+	const Stats& GetStats() const;
+private:
+	typedef Chip8::InstructionId InstructionId;
+
+	void Execute(const InstructionId& id, const Chip8::Instruction& instruction);
+	void TickTimers();
+
+	// Calls fn for every lane, grouped or not. fn must blend its results with the mask.
+	template<typename Fn>
+	inline void Dense(Fn fn);
+	// Calls fn for the lanes of the current group, for instructions that touch memory
+	template<typename Fn>
+	inline void Sparse(Fn fn);
+
+	inline Byte* Register(const size_t& index);
+	inline Byte* RAM(const size_t& lane);
+	inline const Byte* RAM(const size_t& lane) const;
+	inline bool IsRunnable(const size_t& lane) const;
+	inline CPU::Opcode FetchOpcode(const size_t& lane) const;
+	inline void Fail(const size_t& lane, const char* error);
+	inline void Push(const size_t& lane, const Address& value);
+	inline void Pop(const size_t& lane);
+	inline void Draw(const size_t& lane, const Chip8::Instruction& instruction);
+
+	size_t m_Lanes;
+	size_t m_Stride; // m_Lanes rounded up to LANE_ALIGN
+	Address m_ProgramEnd = Chip8::USER_SPACE_ADDR;
+	uint32_t m_IPS = Scheduler::DEFAULT_IPS;
+	uint64_t m_Cycles = 0;     // Steps since the program was loaded
+	uint64_t m_FrameBase = 0;  // m_Cycles at the last change of speed
+	uint64_t m_Frame = 0;      // Frames since then
+
+	// Lane arrays
+	std::vector<Byte> m_V; // Register-major, VN of lane L is at [N * m_Stride + L]
+	std::vector<Address> m_I;
+	std::vector<Address> m_PC;
+	std::vector<Byte> m_Delay;
+	std::vector<Byte> m_Sound;
+	std::vector<Byte> m_StackDepth;
+	std::vector<Address> m_Stack; // Lane-major, Chip8::STACK_SIZE entries per lane
+	std::vector<uint16_t> m_Keys;
+	std::vector<uint64_t> m_Executed;
+	std::vector<const char*> m_Errors;
+	std::vector<Random> m_RNG;
+	std::vector<Display> m_Display;
+	std::vector<Byte> m_RAM; // Lane-major, RAM_SIZE bytes per lane
+
+	// Scheduling state of the current step
+	std::vector<Byte> m_Pending; // 0xFF for lanes that haven't executed this step yet
+	std::vector<Byte> m_Mask;    // 0xFF for lanes in the current group
+	std::vector<size_t> m_Group; // Indices of the lanes in the current group
+	Stats m_Stats;
+};
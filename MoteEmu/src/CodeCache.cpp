@@ -0,0 +1,77 @@
+#include "CodeCache.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+CodeCache::CodeCache(const size_t& size)
+	:m_Size(size)
+{
+#ifdef _WIN32
+	m_Memory = static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	m_Memory = memory != MAP_FAILED ? static_cast<uint8_t*>(memory) : nullptr;
+#endif
+	if (m_Memory == nullptr || !Protect(false)) {
+		m_Memory = nullptr;
+		m_Size = 0;
+	}
+}
+
+CodeCache::~CodeCache()
+{
+	if (m_Memory == nullptr)
+		return;
+#ifdef _WIN32
+	VirtualFree(m_Memory, 0, MEM_RELEASE);
+#else
+	munmap(m_Memory, m_Size);
+#endif
+}
+
+void* CodeCache::Commit(const uint8_t* code, const size_t& size)
+{
+	// Keep every block 16-byte aligned
+	size_t start = (m_Used + 15) & ~static_cast<size_t>(15);
+	if (m_Memory == nullptr || start + size > m_Size || !Protect(true))
+		return nullptr;
+	memcpy(m_Memory + start, code, size);
+	m_Used = start + size;
+	if (!Protect(false))
+		return nullptr;
+#ifdef _WIN32
+	FlushInstructionCache(GetCurrentProcess(), m_Memory + start, size);
+#endif
+	return m_Memory + start;
+}
+
+void CodeCache::Clear()
+{
+	m_Used = 0;
+}
+
+size_t CodeCache::GetUsed() const
+{
+	return m_Used;
+}
+
+size_t CodeCache::GetSize() const
+{
+	return m_Size;
+}
+
+bool CodeCache::Protect(const bool& writable)
+{
+#ifdef _WIN32
+	DWORD old;
+	return VirtualProtect(m_Memory, m_Size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old) != 0;
+#else
+	return mprotect(m_Memory, m_Size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator over a region of executable memory. The region is kept
+// read+execute and only made writable while new code is copied into it.
+class CodeCache
+{
+public:
+	explicit CodeCache(const size_t& size);
+	~CodeCache();
+
+	// Copies the code into the cache. Returns nullptr if it's full (or unavailable).
+	void* Commit(const uint8_t* code, const size_t& size);
+	// Forgets all committed code
+	void Clear();
+
+	size_t GetUsed() const;
+	size_t GetSize() const;
+private:
+	bool Protect(const bool& writable);
+
+	uint8_t* m_Memory = nullptr;
+	size_t m_Size = 0;
+	size_t m_Used = 0;
+};
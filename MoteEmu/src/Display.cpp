@@ -0,0 +1,37 @@
+#include "Display.h"
+
+void Display::Clear()
+{
+	m_Rows.fill(0);
+}
+
+const Display::Rows& Display::GetRows() const
+{
+	return m_Rows;
+}
+
+void Display::Expand(uint32_t* pixels, const size_t& pitch, const uint32_t& on, const uint32_t& off) const
+{
+	for (size_t y = 0; y < HEIGHT; y++)
+	{
+		Row row = m_Rows[y];
+		uint32_t* line = pixels + y * pitch;
+		for (size_t x = 0; x < WIDTH; x++)
+			line[x] = (row >> (WIDTH - 1 - x)) & 1 ? on : off;
+	}
+}
+
+void Display::SetRows(const Rows& rows)
+{
+	m_Rows = rows;
+}
+
+bool Display::operator==(const Display& other) const
+{
+	return m_Rows == other.m_Rows;
+}
+
+bool Display::operator!=(const Display& other) const
+{
+	return m_Rows != other.m_Rows;
+}
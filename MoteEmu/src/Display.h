@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+// The 64x32 monochrome screen as a packed bitplane: one 64-bit word per row,
+// the most significant bit is the leftmost pixel. Drawing a sprite row is a
+// shift and an XOR, the whole screen is 256 bytes. Pixels are expanded to
+// colors only when a frame is presented.
+class Display
+{
+public:
+	static constexpr const size_t WIDTH = 64;
+	static constexpr const size_t HEIGHT = 32;
+	typedef uint64_t Row;
+	typedef std::array<Row, HEIGHT> Rows;
+
+	// XORs an 8 pixel wide sprite of `height` rows onto the screen. The start
+	// position wraps around the screen, the sprite itself is clipped at the
+	// edges. Returns true if any lit pixel was turned off.
+	inline bool Draw(size_t x, size_t y, const uint8_t* sprite, const size_t& height);
+	// Same as Draw, but the parts of the sprite past an edge reappear at the opposite one
+	inline bool DrawWrapped(size_t x, size_t y, const uint8_t* sprite, const size_t& height);
+	void Clear();
+
+	inline bool IsSet(const size_t& x, const size_t& y) const;
+	const Rows& GetRows() const;
+	void SetRows(const Rows& rows);
+	// Writes one 32-bit color per pixel, `pitch` is in pixels
+	void Expand(uint32_t* pixels, const size_t& pitch, const uint32_t& on, const uint32_t& off) const;
+
+	bool operator==(const Display& other) const;
+	bool operator!=(const Display& other) const;
+private:
+	Rows m_Rows = { 0 };
+};
+
+inline bool Display::Draw(size_t x, size_t y, const uint8_t* sprite, const size_t& height)
+{
+	x %= WIDTH;
+	y %= HEIGHT;
+	Row collision = 0;
+	for (size_t i = 0; i < height && y + i < HEIGHT; i++)
+	{
+		// Bits shifted out at the right edge are dropped, which clips the sprite
+		Row row = static_cast<Row>(sprite[i]) << (WIDTH - 8) >> x;
+		collision |= m_Rows[y + i] & row;
+		m_Rows[y + i] ^= row;
+	}
+	return collision != 0;
+}
+
+inline bool Display::DrawWrapped(size_t x, size_t y, const uint8_t* sprite, const size_t& height)
+{
+	x %= WIDTH;
+	y %= HEIGHT;
+	Row collision = 0;
+	for (size_t i = 0; i < height; i++)
+	{
+		// Rotated instead of shifted, so the bits leaving at the right come back at the left
+		Row row = static_cast<Row>(sprite[i]) << (WIDTH - 8);
+		if (x != 0)
+			row = row >> x | row << (WIDTH - x);
+		Row& target = m_Rows[(y + i) % HEIGHT];
+		collision |= target & row;
+		target ^= row;
+	}
+	return collision != 0;
+}
+
+inline bool Display::IsSet(const size_t& x, const size_t& y) const
+{
+	return (m_Rows[y] >> (WIDTH - 1 - x)) & 1;
+}
@@ -0,0 +1,141 @@
+#include "ExecutionProfile.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdio.h>
+
+double ExecutionProfile::Counters::TimerWaitFraction() const
+{
+	return instructions ? static_cast<double>(timerWait) / instructions : 0.0;
+}
+
+ExecutionProfile::ExecutionProfile()
+	:m_Calls(Chip8::USER_SPACE_ADDR)
+{
+	Reset();
+}
+
+ExecutionProfile::~ExecutionProfile()
+{
+}
+
+void ExecutionProfile::Reset()
+{
+	m_Counters = Counters();
+	m_Handlers.fill(0);
+	m_Families.fill(0);
+	m_Hits.fill(0);
+	m_Waiting = false;
+	m_Calls.Reset();
+}
+
+const ExecutionProfile::Counters& ExecutionProfile::GetCounters() const
+{
+	return m_Counters;
+}
+
+CallProfile& ExecutionProfile::GetCalls()
+{
+	return m_Calls;
+}
+
+const CallProfile& ExecutionProfile::GetCalls() const
+{
+	return m_Calls;
+}
+
+uint64_t ExecutionProfile::GetHandlerCount(const InstructionId& id) const
+{
+	return m_Handlers[static_cast<size_t>(id)];
+}
+
+uint64_t ExecutionProfile::GetFamilyCount(const size_t& family) const
+{
+	return m_Families[family];
+}
+
+uint64_t ExecutionProfile::GetHits(const Address& address) const
+{
+	return m_Hits[address % ADDRESS_SPACE];
+}
+
+void ExecutionProfile::WriteJson(std::ostream& out) const
+{
+	char hex[8];
+	out << "{\n";
+	out << "  \"instructions\": " << m_Counters.instructions << ",\n";
+	out << "  \"frames\": " << m_Counters.frames << ",\n";
+	out << "  \"draws\": " << m_Counters.draws << ",\n";
+	out << "  \"sprite_rows\": " << m_Counters.spriteRows << ",\n";
+	out << "  \"clears\": " << m_Counters.clears << ",\n";
+	out << "  \"timer_wait\": " << m_Counters.timerWait << ",\n";
+	out << "  \"timer_wait_fraction\": " << m_Counters.TimerWaitFraction() << ",\n";
+
+	out << "  \"handlers\": {";
+	const char* separator = "\n";
+	for (size_t id = 0; id < m_Handlers.size(); id++)
+	{
+		out << separator << "    \"" << Chip8::GetInstructionName(static_cast<InstructionId>(id)) << "\": " << m_Handlers[id];
+		separator = ",\n";
+	}
+	out << "\n  },\n";
+
+	out << "  \"families\": {";
+	separator = "\n";
+	for (size_t family = 0; family < m_Families.size(); family++)
+	{
+		snprintf(hex, sizeof(hex), "%X", static_cast<unsigned>(family));
+		out << separator << "    \"" << hex << "\": " << m_Families[family];
+		separator = ",\n";
+	}
+	out << "\n  },\n";
+
+	out << "  \"pc_hits\": {";
+	separator = "\n";
+	for (size_t address = 0; address < m_Hits.size(); address++)
+	{
+		if (m_Hits[address] == 0)
+			continue;
+		snprintf(hex, sizeof(hex), "0x%03X", static_cast<unsigned>(address));
+		out << separator << "    \"" << hex << "\": " << m_Hits[address];
+		separator = ",\n";
+	}
+	out << "\n  }\n}\n";
+}
+
+void ExecutionProfile::WriteCsv(std::ostream& out) const
+{
+	char hex[8];
+	out << "section,key,count\n";
+	out << "counter,instructions," << m_Counters.instructions << "\n";
+	out << "counter,frames," << m_Counters.frames << "\n";
+	out << "counter,draws," << m_Counters.draws << "\n";
+	out << "counter,sprite_rows," << m_Counters.spriteRows << "\n";
+	out << "counter,clears," << m_Counters.clears << "\n";
+	out << "counter,timer_wait," << m_Counters.timerWait << "\n";
+	for (size_t id = 0; id < m_Handlers.size(); id++)
+		out << "handler," << Chip8::GetInstructionName(static_cast<InstructionId>(id)) << "," << m_Handlers[id] << "\n";
+	for (size_t family = 0; family < m_Families.size(); family++)
+	{
+		snprintf(hex, sizeof(hex), "%X", static_cast<unsigned>(family));
+		out << "family," << hex << "," << m_Families[family] << "\n";
+	}
+	for (size_t address = 0; address < m_Hits.size(); address++)
+	{
+		snprintf(hex, sizeof(hex), "0x%03X", static_cast<unsigned>(address));
+		out << "pc," << hex << "," << m_Hits[address] << "\n";
+	}
+}
+
+bool ExecutionProfile::Save(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+		return false;
+	size_t length = std::strlen(filename);
+	if (length >= 4 && std::strcmp(filename + length - 4, ".csv") == 0)
+		WriteCsv(file);
+	else
+		WriteJson(file);
+	return file.good();
+}
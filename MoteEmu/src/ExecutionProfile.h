@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <ostream>
+
+#include "Chip8.h"
+#include "CallProfile.h"
+
+// Where a Chip8 program spends its instructions: executions per handler and
+// per opcode family (the top nibble), hits per address, sprite draws, screen
+// clears and the instructions spent polling the delay timer. Only compiled in
+// with the "profile" premake option (MOTE_PROFILE), the hooks in Chip8 are
+// empty macros otherwise.
+// An instruction counts as a timer wait from an FX07 that read a non-zero
+// delay timer until the first instruction that isn't FX07, a skip or a jump,
+// which covers the usual "read timer, skip if zero, jump back" loops.
+// The counts per subroutine are kept by the CallProfile.
+class ExecutionProfile
+{
+public:
+	typedef Chip8::Address Address;
+	typedef Chip8::InstructionId InstructionId;
+	static constexpr const size_t ADDRESS_SPACE = 0x1000;
+	static constexpr const size_t FAMILIES = 16;
+
+	struct Counters {
+		uint64_t instructions = 0;
+		uint64_t frames = 0;     // Timer ticks
+		uint64_t draws = 0;      // DXYN
+		uint64_t spriteRows = 0; // Sum of N over all draws
+		uint64_t clears = 0;     // 00E0
+		uint64_t timerWait = 0;  // Instructions spent polling the delay timer
+
+		double TimerWaitFraction() const;
+	};
+
+	ExecutionProfile();
+	~ExecutionProfile();
+
+	void Reset();
+
+	// Called before the instruction at `pc` executes
+	inline void Record(const Address& pc, const CPU::Opcode& opcode, const InstructionId& id);
+	// Called by FX07 with the value it read
+	inline void ReadDelayTimer(const Byte& value);
+	inline void TickTimers();
+
+	const Counters& GetCounters() const;
+	CallProfile& GetCalls();
+	const CallProfile& GetCalls() const;
+	uint64_t GetHandlerCount(const InstructionId& id) const;
+	uint64_t GetFamilyCount(const size_t& family) const;
+	uint64_t GetHits(const Address& address) const;
+
+	// Can be called at any point of a run. JSON lists only the addresses that were hit.
+	void WriteJson(std::ostream& out) const;
+	// One "section,key,count" row per counter, handler, family and hit address
+	void WriteCsv(std::ostream& out) const;
+	// CSV if the file name ends in .csv, JSON otherwise. Returns false if the file can't be opened.
+	bool Save(const char* filename) const;
+private:
+	// The instructions a timer wait loop is made of, FX07 itself is decided by ReadDelayTimer
+	static inline bool IsPolling(const InstructionId& id);
+
+	Counters m_Counters;
+	std::array<uint64_t, static_cast<size_t>(InstructionId::COUNT)> m_Handlers;
+	std::array<uint64_t, FAMILIES> m_Families;
+	std::array<uint64_t, ADDRESS_SPACE> m_Hits;
+	bool m_Waiting = false;
+	CallProfile m_Calls;
+};
+
+inline void ExecutionProfile::Record(const Address& pc, const CPU::Opcode& opcode, const InstructionId& id)
+{
+	m_Counters.instructions++;
+	m_Handlers[static_cast<size_t>(id)]++;
+	m_Families[opcode >> 12]++;
+	m_Hits[pc % ADDRESS_SPACE]++;
+	m_Calls.Count();
+
+	switch (id)
+	{
+	case InstructionId::OP_DXYN:
+		m_Counters.draws++;
+		m_Counters.spriteRows += opcode & 0xF;
+		break;
+	case InstructionId::OP_00E0:
+		m_Counters.clears++;
+		break;
+	case InstructionId::OP_2NNN:
+		m_Calls.Call(opcode & 0xFFF);
+		break;
+	case InstructionId::OP_00EE:
+		m_Calls.Return();
+		break;
+	default:
+		break;
+	}
+
+	if (!IsPolling(id))
+		m_Waiting = false;
+	else if (m_Waiting)
+		m_Counters.timerWait++;
+}
+
+inline void ExecutionProfile::ReadDelayTimer(const Byte& value)
+{
+	if (value == 0)
+		m_Waiting = false;
+	else if (!m_Waiting) {
+		m_Waiting = true;
+		m_Counters.timerWait++; // This FX07 starts the wait
+	}
+}
+
+inline void ExecutionProfile::TickTimers()
+{
+	m_Counters.frames++;
+}
+
+inline bool ExecutionProfile::IsPolling(const InstructionId& id)
+{
+	switch (id)
+	{
+	case InstructionId::OP_FX07:
+	case InstructionId::OP_1NNN:
+	case InstructionId::OP_3XNN:
+	case InstructionId::OP_4XNN:
+	case InstructionId::OP_5XY0:
+	case InstructionId::OP_9XY0:
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a, used to fingerprint machine state and ROM contents.
+// Hashes can be chained by passing the previous result as `hash`.
+namespace Hash
+{
+	static constexpr const uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+	static constexpr const uint64_t FNV_PRIME = 0x100000001B3ull;
+
+	inline uint64_t Fnv1a(const void* data, const size_t& size, uint64_t hash = FNV_OFFSET)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	// Hashes the object representation of a trivially copyable value
+	template<typename T>
+	inline uint64_t Fnv1aValue(const T& value, const uint64_t& hash = FNV_OFFSET)
+	{
+		return Fnv1a(&value, sizeof(T), hash);
+	}
+}
@@ -0,0 +1,35 @@
+#include "HeadlessAPI.h"
+
+HeadlessAPI::HeadlessAPI()
+{
+}
+
+HeadlessAPI::~HeadlessAPI()
+{
+}
+
+bool HeadlessAPI::Present(const Display& display)
+{
+	m_Display = display;
+	return true;
+}
+
+bool HeadlessAPI::IsKeyPressed(const Key& key)
+{
+	return key < 16 && (m_Keys >> key) & 1;
+}
+
+const char* HeadlessAPI::GetError() const
+{
+	return "";
+}
+
+void HeadlessAPI::SetKeyState(const uint16_t& keys)
+{
+	m_Keys = keys;
+}
+
+const Display& HeadlessAPI::GetDisplay() const
+{
+	return m_Display;
+}
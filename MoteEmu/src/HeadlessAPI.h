@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Peripherals.h"
+
+// Peripherals without a window. Presenting keeps a copy of the frame, input is
+// whatever was last passed to SetKeyState.
+class HeadlessAPI : public Peripherals
+{
+public:
+	HeadlessAPI();
+	~HeadlessAPI();
+
+	bool Present(const Display& display) override;
+	bool IsKeyPressed(const Key& key) override;
+	const char* GetError() const override;
+
+	// Bit N set means key N is held down
+	void SetKeyState(const uint16_t& keys);
+	// The last presented frame
+	const Display& GetDisplay() const;
+private:
+	Display m_Display;
+	uint16_t m_Keys = 0;
+};
@@ -0,0 +1,54 @@
+#include "HeadlessVM.h"
+
+HeadlessVM::HeadlessVM(CPU* processor, const size_t& RAMSize)
+	:m_RAM(RAMSize), m_CPU(processor), m_Scheduler(processor)
+{
+	m_CPU->UseMemory(&m_RAM);
+	m_CPU->UsePeripherals(&m_Peripherals);
+	m_CPU->Init();
+}
+
+HeadlessVM::~HeadlessVM()
+{
+}
+
+ROMLoader::Error HeadlessVM::Load(const char* filename)
+{
+	ROMLoader::Error error = ROMLoader::Load(filename, *m_CPU);
+	if (error == ROMLoader::Error::NONE)
+		m_Scheduler.Reset();
+	return error;
+}
+
+ROMLoader::Error HeadlessVM::Load(const ROMImage& rom)
+{
+	ROMLoader::Error error = ROMLoader::Load(rom, *m_CPU);
+	if (error == ROMLoader::Error::NONE)
+		m_Scheduler.Reset();
+	return error;
+}
+
+bool HeadlessVM::Load(const Memory& rom)
+{
+	if (!m_CPU->LoadProgram(rom))
+		return false;
+	m_Scheduler.Reset();
+	return true;
+}
+
+size_t HeadlessVM::Run(const size_t& cycles)
+{
+	size_t executed = m_Scheduler.Run(cycles);
+	m_Peripherals.Present(m_CPU->GetDisplay());
+	return executed;
+}
+
+Scheduler& HeadlessVM::GetScheduler()
+{
+	return m_Scheduler;
+}
+
+HeadlessAPI& HeadlessVM::GetPeripherals()
+{
+	return m_Peripherals;
+}
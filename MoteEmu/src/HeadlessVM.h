@@ -0,0 +1,33 @@
+#pragma once
+
+#include "HeadlessAPI.h"
+#include "CPU.h"
+#include "ROMLoader.h"
+#include "Scheduler.h"
+
+// Counterpart of VM that runs a program without a window, as fast as the host allows
+class HeadlessVM
+{
+public:
+	// RAMSize is the memory handed to CPUs without memory of their own (Chip8 has its own)
+	explicit HeadlessVM(CPU* processor, const size_t& RAMSize = 0);
+	~HeadlessVM();
+
+	// Loading resets the machine, unless it fails
+	ROMLoader::Error Load(const char* filename);
+	ROMLoader::Error Load(const ROMImage& rom);
+	bool Load(const Memory& rom);
+	// Executes up to `cycles` instructions and returns how many were executed.
+	// Returns less than requested only if the program ran off its end.
+	// The timers tick at every frame boundary of emulated time on the way and
+	// the display is presented to the peripherals afterwards.
+	size_t Run(const size_t& cycles);
+
+	HeadlessAPI& GetPeripherals();
+	Scheduler& GetScheduler();
+private:
+	Memory m_RAM;
+	HeadlessAPI m_Peripherals;
+	CPU* m_CPU;
+	Scheduler m_Scheduler;
+};
@@ -0,0 +1,314 @@
+#include "Log.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <stdio.h>
+
+std::atomic<uint8_t> Log::s_MinSeverity{ static_cast<uint8_t>(Log::Severity::NOTICE) };
+std::atomic<uint32_t> Log::s_RateLimit{ Log::DEFAULT_RATE_LIMIT };
+std::atomic<uint64_t> Log::s_Clock{ 0 };
+
+// Every site ever constructed, pushed at the front
+static std::atomic<Log::Site*> s_Sites{ nullptr };
+
+// Owns the queue and the writer thread. Created on the first message and
+// destroyed with the other statics, writing whatever is still queued.
+class LogWriter
+{
+public:
+	static constexpr const size_t CAPACITY = 1024; // Entries, a power of 2
+
+	LogWriter();
+	~LogWriter();
+
+	// Any thread. Returns false if the queue is full.
+	bool Push(const Log::Entry& entry);
+	void Flush();
+	Log::Stats GetStats() const;
+	void CountDropped();
+private:
+	// Bounded multi-producer queue: a slot's sequence tells producers and the
+	// consumer whose turn it is, so neither side ever takes a lock
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		Log::Entry entry;
+	};
+
+	void Run();
+	bool Pop(Log::Entry& entry);
+	void WriteEntry(const Log::Entry& entry);
+	// Reports what the rate limit held back since the sites' last messages
+	void WriteSuppressed();
+
+	std::unique_ptr<Slot[]> m_Slots;
+	alignas(64) std::atomic<uint64_t> m_Enqueued{ 0 };
+	alignas(64) std::atomic<uint64_t> m_Dequeued{ 0 }; // Written by the writer thread only
+	std::atomic<uint64_t> m_Flushed{ 0 };              // Entries before it reached stderr, for Flush
+	std::atomic<uint64_t> m_Written{ 0 };
+	std::atomic<uint64_t> m_Suppressed{ 0 };
+	std::atomic<uint64_t> m_Dropped{ 0 };
+	std::atomic<bool> m_Stop{ false };
+	std::chrono::steady_clock::time_point m_Start;
+	std::string m_Line;
+	std::thread m_Thread;
+};
+
+static LogWriter& GetWriter()
+{
+	static LogWriter writer;
+	return writer;
+}
+
+LogWriter::LogWriter()
+	:m_Slots(new Slot[CAPACITY]), m_Start(std::chrono::steady_clock::now())
+{
+	for (size_t i = 0; i < CAPACITY; i++)
+		m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+	m_Thread = std::thread(&LogWriter::Run, this);
+}
+
+LogWriter::~LogWriter()
+{
+	m_Stop.store(true, std::memory_order_release);
+	m_Thread.join();
+}
+
+bool LogWriter::Push(const Log::Entry& entry)
+{
+	uint64_t position = m_Enqueued.load(std::memory_order_relaxed);
+	while (true)
+	{
+		Slot& slot = m_Slots[position & (CAPACITY - 1)];
+		uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence == position) {
+			if (m_Enqueued.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				slot.entry = entry;
+				slot.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (sequence < position)
+			return false; // Not consumed yet since the last lap
+		else
+			position = m_Enqueued.load(std::memory_order_relaxed);
+	}
+}
+
+bool LogWriter::Pop(Log::Entry& entry)
+{
+	uint64_t position = m_Dequeued.load(std::memory_order_relaxed);
+	Slot& slot = m_Slots[position & (CAPACITY - 1)];
+	if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+		return false;
+	entry = slot.entry;
+	slot.sequence.store(position + CAPACITY, std::memory_order_release);
+	m_Dequeued.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+void LogWriter::Flush()
+{
+	uint64_t target = m_Enqueued.load(std::memory_order_acquire);
+	while (m_Flushed.load(std::memory_order_acquire) < target)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+Log::Stats LogWriter::GetStats() const
+{
+	Log::Stats stats;
+	stats.written = m_Written.load(std::memory_order_relaxed);
+	stats.dropped = m_Dropped.load(std::memory_order_relaxed);
+	stats.suppressed = m_Suppressed.load(std::memory_order_relaxed);
+	for (const Log::Site* site = s_Sites.load(std::memory_order_acquire); site != nullptr; site = site->next)
+		stats.suppressed += site->suppressed.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void LogWriter::CountDropped()
+{
+	m_Dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LogWriter::Run()
+{
+	Log::Entry entry;
+	while (true)
+	{
+		bool stopping = m_Stop.load(std::memory_order_acquire);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_Start;
+		Log::s_Clock.store(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+
+		bool wrote = false;
+		while (Pop(entry))
+		{
+			WriteEntry(entry);
+			wrote = true;
+		}
+		if (wrote) {
+			fflush(stderr);
+			// Popping freed the slots, only now are their entries written
+			m_Flushed.store(m_Dequeued.load(std::memory_order_relaxed), std::memory_order_release);
+		}
+		else if (stopping)
+			break;
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	WriteSuppressed();
+}
+
+// Formats the entry with its own printf subset: each conversion is handed to
+// snprintf on its own, with the length modifier the captured type needs
+void LogWriter::WriteEntry(const Log::Entry& entry)
+{
+	m_Line = "[";
+	m_Line += Log::GetSeverityName(entry.site->severity);
+	m_Line += "] ";
+	size_t argument = 0;
+	char buffer[128];
+	for (const char* c = entry.site->format; *c != '\0'; c++)
+	{
+		if (*c != '%') {
+			m_Line += *c;
+			continue;
+		}
+		if (c[1] == '%') {
+			m_Line += '%';
+			c++;
+			continue;
+		}
+		std::string spec = "%";
+		for (c++; *c != '\0' && strchr("-+ #0123456789.", *c) != nullptr; c++)
+			spec += *c;
+		while (*c != '\0' && strchr("hlLzjt", *c) != nullptr)
+			c++;
+		if (*c == '\0')
+			break;
+		if (argument >= entry.argumentCount) {
+			m_Line += "<?>";
+			continue;
+		}
+		const Log::Argument& value = entry.arguments[argument++];
+		bool isFloat = value.type == Log::ArgumentType::FLOAT;
+		switch (*c)
+		{
+		case 'd': case 'i':
+			snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(),
+				isFloat ? static_cast<long long>(value.d) : static_cast<long long>(value.i));
+			break;
+		case 'u': case 'x': case 'X': case 'o':
+			snprintf(buffer, sizeof(buffer), (spec + "ll" + *c).c_str(),
+				isFloat ? static_cast<unsigned long long>(value.d) : static_cast<unsigned long long>(value.u));
+			break;
+		case 'c':
+			snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), static_cast<int>(value.i));
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+			snprintf(buffer, sizeof(buffer), (spec + *c).c_str(),
+				isFloat ? value.d : value.type == Log::ArgumentType::SIGNED ? static_cast<double>(value.i) : static_cast<double>(value.u));
+			break;
+		case 's':
+			snprintf(buffer, sizeof(buffer), (spec + "s").c_str(),
+				value.type == Log::ArgumentType::TEXT ? entry.text + value.text : "<?>");
+			break;
+		default:
+			snprintf(buffer, sizeof(buffer), "<?>");
+			break;
+		}
+		m_Line += buffer;
+	}
+	if (entry.suppressed != 0) {
+		snprintf(buffer, sizeof(buffer), " (%llu more since the last one)", static_cast<unsigned long long>(entry.suppressed));
+		m_Line += buffer;
+	}
+	m_Line += '\n';
+	fwrite(m_Line.data(), 1, m_Line.size(), stderr);
+	m_Written.fetch_add(1, std::memory_order_relaxed);
+	m_Suppressed.fetch_add(entry.suppressed, std::memory_order_relaxed);
+}
+
+void LogWriter::WriteSuppressed()
+{
+	for (Log::Site* site = s_Sites.load(std::memory_order_acquire); site != nullptr; site = site->next)
+	{
+		uint64_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+		if (suppressed == 0)
+			continue;
+		fprintf(stderr, "[%s] %llu more of \"%s\"\n", Log::GetSeverityName(site->severity),
+			static_cast<unsigned long long>(suppressed), site->format);
+		m_Suppressed.fetch_add(suppressed, std::memory_order_relaxed);
+	}
+	fflush(stderr);
+}
+
+Log::Site::Site(const Severity& severity, const char* format)
+	:severity(severity), format(format)
+{
+	next = s_Sites.load(std::memory_order_relaxed);
+	while (!s_Sites.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+	GetWriter(); // Started before any site can log, so it is destroyed after their last message
+}
+
+void Log::SetMinSeverity(const Severity& severity)
+{
+	s_MinSeverity.store(static_cast<uint8_t>(severity), std::memory_order_relaxed);
+}
+
+void Log::SetRateLimit(const uint32_t& messagesPerSecond)
+{
+	s_RateLimit.store(messagesPerSecond, std::memory_order_relaxed);
+}
+
+void Log::Flush()
+{
+	GetWriter().Flush();
+}
+
+Log::Stats Log::GetStats()
+{
+	return GetWriter().GetStats();
+}
+
+const char* Log::GetSeverityName(const Severity& severity)
+{
+	switch (severity)
+	{
+	case Severity::VERBOSE:
+		return "VERBOSE";
+	case Severity::NOTICE:
+		return "NOTICE";
+	case Severity::WARNING:
+		return "WARNING";
+	case Severity::ERROR:
+		return "ERROR";
+	case Severity::CRITICAL:
+		return "CRITICAL";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+void Log::Enqueue(const Entry& entry)
+{
+	LogWriter& writer = GetWriter();
+	if (!writer.Push(entry))
+		writer.CountDropped();
+}
+
+uint16_t Log::CopyText(Entry& entry, const char* text)
+{
+	if (entry.textUsed == TEXT_SIZE)
+		return TEXT_SIZE - 1; // The terminator of the last string, so an empty one
+	uint16_t offset = entry.textUsed;
+	if (text == nullptr)
+		text = "(null)";
+	size_t length = strnlen(text, TEXT_SIZE - 1 - offset);
+	memcpy(entry.text + offset, text, length);
+	entry.text[offset + length] = '\0';
+	entry.textUsed = static_cast<uint8_t>(offset + length + 1);
+	return offset;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Asynchronous logging. LOG copies its format string pointer and arguments
+// into a bounded lock-free queue, a background thread formats them and
+// writes them to stderr. Every LOG statement is a Site with its own rate
+// limit: past Log::SetRateLimit messages per second the rest are only
+// counted, and the count is reported with the site's next message (or when
+// the program ends). A full queue drops messages instead of waiting.
+//
+// The format string has to be a literal. Integers, floating point numbers and
+// C strings are supported (strings are copied, up to TEXT_SIZE bytes in all).
+#define LOG(severity, format, ...) \
+	do { \
+		static Log::Site logSite(Log::Severity::severity, format); \
+		Log::Write(logSite, ##__VA_ARGS__); \
+	} while (0)
+
+class Log
+{
+public:
+	enum class Severity : uint8_t { VERBOSE, NOTICE, WARNING, ERROR, CRITICAL };
+	static constexpr const size_t MAX_ARGUMENTS = 6;
+	static constexpr const size_t TEXT_SIZE = 64;
+	static constexpr const uint32_t DEFAULT_RATE_LIMIT = 10; // Messages per second and site
+
+	// One per LOG statement, registered for the end of program report
+	struct Site {
+		Site(const Severity& severity, const char* format);
+
+		const Severity severity;
+		const char* const format;
+		std::atomic<uint64_t> suppressed{ 0 }; // Since the last message that got through
+		std::atomic<uint64_t> window{ 0 };     // Second of the current rate limit window
+		std::atomic<uint32_t> admitted{ 0 };   // Messages in the current window
+		Site* next = nullptr;
+	};
+
+	struct Stats {
+		uint64_t written = 0;
+		uint64_t suppressed = 0; // Over the rate limit
+		uint64_t dropped = 0;    // The queue was full
+	};
+
+	enum class ArgumentType : uint8_t { SIGNED, UNSIGNED, FLOAT, TEXT };
+	struct Argument {
+		ArgumentType type;
+		union {
+			int64_t i;
+			uint64_t u;
+			double d;
+			uint16_t text; // Offset into Entry::text
+		};
+	};
+	// A message as it travels through the queue
+	struct Entry {
+		const Site* site;
+		uint64_t suppressed;
+		Argument arguments[MAX_ARGUMENTS];
+		uint8_t argumentCount;
+		uint8_t textUsed;
+		char text[TEXT_SIZE];
+	};
+
+	template<typename... Args>
+	static inline void Write(Site& site, const Args&... args);
+
+	// Messages below it are discarded without being counted
+	static void SetMinSeverity(const Severity& severity);
+	static void SetRateLimit(const uint32_t& messagesPerSecond);
+	// Blocks until every message queued so far is written
+	static void Flush();
+	static Stats GetStats();
+	static const char* GetSeverityName(const Severity& severity);
+private:
+	friend class LogWriter;
+
+	// Decides whether a message of the site goes into the queue
+	static inline bool Admit(Site& site);
+	template<typename T>
+	static inline void Capture(Entry& entry, const T& value);
+	static void Enqueue(const Entry& entry);
+	static uint16_t CopyText(Entry& entry, const char* text);
+
+	static std::atomic<uint8_t> s_MinSeverity;
+	static std::atomic<uint32_t> s_RateLimit;
+	// Milliseconds since the writer started, advanced by the writer thread so that Admit never reads the clock
+	static std::atomic<uint64_t> s_Clock;
+};
+
+template<typename... Args>
+inline void Log::Write(Site& site, const Args&... args)
+{
+	static_assert(sizeof...(Args) <= MAX_ARGUMENTS, "Too many arguments for LOG");
+	if (static_cast<uint8_t>(site.severity) < s_MinSeverity.load(std::memory_order_relaxed) || !Admit(site))
+		return;
+	Entry entry;
+	entry.site = &site;
+	entry.suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+	entry.argumentCount = 0;
+	entry.textUsed = 0;
+	(Capture(entry, args), ...);
+	Enqueue(entry);
+}
+
+inline bool Log::Admit(Site& site)
+{
+	uint64_t window = s_Clock.load(std::memory_order_relaxed) / 1000;
+	// Racy between threads of the same site, which at worst lets a few more messages through
+	if (site.window.load(std::memory_order_relaxed) != window) {
+		site.window.store(window, std::memory_order_relaxed);
+		site.admitted.store(0, std::memory_order_relaxed);
+	}
+	if (site.admitted.fetch_add(1, std::memory_order_relaxed) < s_RateLimit.load(std::memory_order_relaxed))
+		return true;
+	site.suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+template<typename T>
+inline void Log::Capture(Entry& entry, const T& value)
+{
+	Argument& argument = entry.arguments[entry.argumentCount++];
+	if constexpr (std::is_convertible<T, const char*>::value) {
+		argument.type = ArgumentType::TEXT;
+		argument.text = CopyText(entry, value);
+	}
+	else if constexpr (std::is_floating_point<T>::value) {
+		argument.type = ArgumentType::FLOAT;
+		argument.d = value;
+	}
+	else if constexpr (std::is_signed<T>::value) {
+		argument.type = ArgumentType::SIGNED;
+		argument.i = value;
+	}
+	else {
+		static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "LOG takes numbers and C strings");
+		argument.type = ArgumentType::UNSIGNED;
+		argument.u = static_cast<uint64_t>(value);
+	}
+}
@@ -0,0 +1,127 @@
+#include "Movie.h"
+
+#include <fstream>
+#include <iterator>
+
+// After the header the file holds runs of (varint frame count, 16-bit little endian key state)
+
+Movie::Movie()
+{
+}
+
+Movie::~Movie()
+{
+}
+
+void Movie::Start(const uint32_t& seed, const uint32_t& ips, const uint64_t& romHash, const uint16_t& quirks)
+{
+	m_Seed = seed;
+	m_IPS = ips;
+	m_ROMHash = romHash;
+	m_Quirks = quirks;
+	m_Frames.clear();
+}
+
+void Movie::Record(const uint64_t& frame, const uint16_t& keys)
+{
+	m_Frames.resize(static_cast<size_t>(frame) + 1);
+	m_Frames.back() = keys;
+}
+
+uint16_t Movie::GetKeys(const uint64_t& frame) const
+{
+	return frame < m_Frames.size() ? m_Frames[static_cast<size_t>(frame)] : 0;
+}
+
+uint64_t Movie::GetFrameCount() const
+{
+	return m_Frames.size();
+}
+
+uint32_t Movie::GetSeed() const
+{
+	return m_Seed;
+}
+
+uint32_t Movie::GetInstructionsPerSecond() const
+{
+	return m_IPS;
+}
+
+uint64_t Movie::GetROMHash() const
+{
+	return m_ROMHash;
+}
+
+uint16_t Movie::GetQuirks() const
+{
+	return m_Quirks;
+}
+
+bool Movie::Save(const char* filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	Header header = { MAGIC, VERSION, m_Quirks, m_Seed, m_IPS, m_ROMHash, m_Frames.size() };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (size_t i = 0; i < m_Frames.size();)
+	{
+		size_t run = 1;
+		while (i + run < m_Frames.size() && m_Frames[i + run] == m_Frames[i])
+			run++;
+		for (size_t value = run; ; value >>= 7)
+		{
+			file.put(static_cast<char>((value & 0x7F) | (value >= 0x80 ? 0x80 : 0)));
+			if (value < 0x80)
+				break;
+		}
+		file.put(static_cast<char>(m_Frames[i] & 0xFF));
+		file.put(static_cast<char>(m_Frames[i] >> 8));
+		i += run;
+	}
+	return file.good();
+}
+
+bool Movie::Load(const char* filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	Header header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MAGIC || header.version != VERSION
+		|| header.frames > MAX_FRAMES)
+		return false;
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	// Grown run by run, so a damaged file can't make it allocate more than it encodes
+	std::vector<uint16_t> frames;
+	for (size_t i = 0; i < data.size();)
+	{
+		uint64_t run = 0;
+		for (size_t shift = 0; i < data.size(); shift += 7)
+		{
+			if (shift > 56)
+				return false; // More than 64 bits
+			run |= static_cast<uint64_t>(data[i] & 0x7F) << shift;
+			if (!(data[i++] & 0x80))
+				break;
+		}
+		if (i + 2 > data.size() || run > header.frames - frames.size())
+			return false;
+		uint16_t keys = static_cast<uint16_t>(data[i] | data[i + 1] << 8);
+		i += 2;
+		frames.insert(frames.end(), static_cast<size_t>(run), keys);
+	}
+	if (frames.size() != header.frames)
+		return false;
+
+	m_Seed = header.seed;
+	m_IPS = header.ips;
+	m_ROMHash = header.romHash;
+	m_Quirks = header.quirks;
+	m_Frames.swap(frames);
+	return true;
+}
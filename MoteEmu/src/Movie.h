@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// An input recording: everything besides the ROM that decides how a run goes.
+// That is the RNG seed, the speed (it decides where the frame boundaries fall),
+// the CPU's quirks and the 16-key state of every frame. The key states are stored run-length
+// encoded, as they rarely change from one frame to the next.
+class Movie
+{
+public:
+	static constexpr const uint32_t MAGIC = 0x564D3843; // "C8MV"
+	static constexpr const uint16_t VERSION = 4; // 2: CXNN draws from Random, 3: quirks, FX55/FX65 include VX, 4: 8XYE sets VF to 0 or 1
+	static constexpr const uint64_t MAX_FRAMES = 60ull * 60 * 60 * 24 * 7; // A week at 60 Hz, longer movies don't load
+
+	Movie();
+	~Movie();
+
+	void Start(const uint32_t& seed, const uint32_t& ips, const uint64_t& romHash, const uint16_t& quirks);
+	// Sets the key state of the given frame, dropping any frames after it (e.g. after a rewind)
+	void Record(const uint64_t& frame, const uint16_t& keys);
+	// Bit N set means key N was held down during the frame. Frames past the end have no keys down.
+	uint16_t GetKeys(const uint64_t& frame) const;
+	uint64_t GetFrameCount() const;
+
+	uint32_t GetSeed() const;
+	uint32_t GetInstructionsPerSecond() const;
+	// Hash::Fnv1a of the ROM the movie was recorded with
+	uint64_t GetROMHash() const;
+	// Chip8::Quirks the movie was recorded with
+	uint16_t GetQuirks() const;
+
+	// Both return false if the file can't be opened (or isn't a valid movie of this version)
+	bool Save(const char* filename) const;
+	bool Load(const char* filename);
+private:
+	struct Header {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t quirks;
+		uint32_t seed;
+		uint32_t ips;
+		uint64_t romHash;
+		uint64_t frames;
+	};
+
+	uint32_t m_Seed = 0;
+	uint32_t m_IPS = 0;
+	uint64_t m_ROMHash = 0;
+	uint16_t m_Quirks = 0;
+	std::vector<uint16_t> m_Frames;
+};
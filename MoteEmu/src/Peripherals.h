@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Display.h"
+
+// Everything a CPU needs from the outside world: a place to show its display
+// and input. SDLAPI implements it for the windowed build, ThreadedAPI for an
+// emulation thread next to the window and HeadlessAPI for runs without a display.
+// None of the calls block, a CPU waiting for input polls on every cycle.
+class Peripherals
+{
+public:
+	typedef uint16_t Key;
+
+	virtual ~Peripherals() {}
+
+	// Shows a finished frame. The CPU draws into its own Display, this is
+	// the only place where it gets converted to the backend's pixel format.
+	virtual bool Present(const Display& display) = 0;
+	virtual bool IsKeyPressed(const Key& key) = 0;
+
+	virtual const char* GetError() const = 0;
+};
@@ -0,0 +1,350 @@
+#include "ROMCatalog.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static constexpr const size_t RECORD_ALIGNMENT = 8;
+
+ROMCatalog::ROMCatalog()
+{
+}
+
+ROMCatalog::~ROMCatalog()
+{
+}
+
+bool ROMCatalog::Open(const char* filename)
+{
+	m_File.reset(new ROMImage());
+	m_SlotCount = 0;
+	m_FileEntries = 0;
+	m_Superseded.clear();
+	m_Added.clear();
+	m_AddedIndex.clear();
+
+	ROMLoader::Error error = ROMLoader::Map(filename, *m_File);
+	if (error == ROMLoader::Error::OPEN_FAILED) {
+		m_File.reset();
+		return true; // Not created yet
+	}
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(m_File->GetData());
+	if (error != ROMLoader::Error::NONE || m_File->GetSize() < sizeof(FileHeader)
+		|| header->magic != MAGIC || header->version != VERSION
+		|| header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0
+		|| sizeof(FileHeader) + static_cast<size_t>(header->slotCount) * sizeof(Slot) > m_File->GetSize()) {
+		m_File.reset();
+		return false;
+	}
+	m_SlotCount = header->slotCount;
+	m_FileEntries = header->entryCount;
+	m_Superseded.assign(m_SlotCount, false);
+	return true;
+}
+
+bool ROMCatalog::Save(const char* filename)
+{
+	// Every record, opened and added, goes into the new file unless an added one replaced it
+	std::vector<std::pair<const Byte*, size_t>> records;
+	const Slot* slots = GetSlots();
+	for (uint32_t i = 0; i < m_SlotCount; i++)
+	{
+		if (slots[i].offset != 0 && !m_Superseded[i] && static_cast<size_t>(slots[i].offset) + slots[i].size <= m_File->GetSize())
+			records.push_back({ m_File->GetData() + slots[i].offset, slots[i].size });
+	}
+	for (const std::vector<Byte>& record : m_Added)
+		records.push_back({ record.data(), record.size() });
+
+	uint32_t slotCount = 16;
+	while (slotCount < records.size() * 2)
+		slotCount *= 2;
+	std::vector<Byte> file(sizeof(FileHeader) + slotCount * sizeof(Slot));
+	FileHeader header = { MAGIC, VERSION, 0, slotCount, static_cast<uint32_t>(records.size()) };
+	std::memcpy(file.data(), &header, sizeof(header));
+	for (const std::pair<const Byte*, size_t>& record : records)
+	{
+		uint64_t hash = reinterpret_cast<const RecordHeader*>(record.first)->hash;
+		Slot* newSlots = reinterpret_cast<Slot*>(file.data() + sizeof(FileHeader));
+		uint32_t slot = static_cast<uint32_t>(hash) & (slotCount - 1);
+		while (newSlots[slot].offset != 0)
+			slot = (slot + 1) & (slotCount - 1);
+		newSlots[slot] = { hash, static_cast<uint32_t>(file.size()), static_cast<uint32_t>(record.second) };
+		file.insert(file.end(), record.first, record.first + record.second); // Invalidates newSlots
+	}
+
+	// Unmapped first, the file may be the one being replaced
+	m_File.reset();
+	m_Added.clear();
+	m_AddedIndex.clear();
+	m_SlotCount = 0;
+	m_FileEntries = 0;
+	m_Superseded.clear();
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+	out.write(reinterpret_cast<const char*>(file.data()), file.size());
+	out.close();
+	if (!out.good())
+		return false;
+	return Open(filename);
+}
+
+bool ROMCatalog::Find(const Byte* rom, const size_t& size, Entry& entry)
+{
+	uint64_t hash = Hash::Fnv1a(rom, size);
+	const Slot* slots = GetSlots();
+	for (uint32_t i = 0, slot = static_cast<uint32_t>(hash) & (m_SlotCount - 1); i < m_SlotCount; i++, slot = (slot + 1) & (m_SlotCount - 1))
+	{
+		if (slots[slot].offset == 0)
+			break;
+		if (slots[slot].hash != hash || m_Superseded[slot] || static_cast<size_t>(slots[slot].offset) + slots[slot].size > m_File->GetSize())
+			continue;
+		if (ParseRecord(m_File->GetData() + slots[slot].offset, slots[slot].size, entry)
+			&& entry.size == size && std::memcmp(entry.rom, rom, size) == 0) {
+			m_Stats.hits++;
+			return true;
+		}
+	}
+	auto range = m_AddedIndex.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const std::vector<Byte>& record = m_Added[it->second];
+		if (ParseRecord(record.data(), record.size(), entry) && entry.size == size && std::memcmp(entry.rom, rom, size) == 0) {
+			m_Stats.hits++;
+			return true;
+		}
+	}
+	m_Stats.misses++;
+	return false;
+}
+
+ROMCatalog::Entry ROMCatalog::Lookup(const Byte* rom, const size_t& size)
+{
+	Entry entry;
+	if (Find(rom, size, entry))
+		return entry;
+	uint64_t hash = Hash::Fnv1a(rom, size);
+	m_Added.push_back(Analyze(rom, size, hash));
+	m_AddedIndex.insert({ hash, m_Added.size() - 1 });
+	ParseRecord(m_Added.back().data(), m_Added.back().size(), entry);
+	return entry;
+}
+
+bool ROMCatalog::SetPlatform(Entry& entry, const Chip8::Quirks& quirks)
+{
+	if (entry.blocks == nullptr || entry.platform == quirks)
+		return false;
+	const Byte* record = reinterpret_cast<const Byte*>(entry.blocks) - sizeof(RecordHeader);
+	std::vector<Byte>* updated = nullptr;
+	auto range = m_AddedIndex.equal_range(entry.hash);
+	for (auto it = range.first; it != range.second && updated == nullptr; ++it)
+	{
+		if (m_Added[it->second].data() == record)
+			updated = &m_Added[it->second];
+	}
+	// The file is mapped read-only, an added copy replaces its record
+	const Slot* slots = GetSlots();
+	for (uint32_t i = 0; i < m_SlotCount && updated == nullptr; i++)
+	{
+		if (slots[i].offset == 0 || m_Superseded[i] || m_File->GetData() + slots[i].offset != record)
+			continue;
+		m_Superseded[i] = true;
+		m_Added.emplace_back(record, record + slots[i].size);
+		m_AddedIndex.insert({ entry.hash, m_Added.size() - 1 });
+		updated = &m_Added.back();
+	}
+	if (updated == nullptr)
+		return false; // Not one of this catalog's entries
+	reinterpret_cast<RecordHeader*>(updated->data())->platform = quirks;
+	ParseRecord(updated->data(), updated->size(), entry);
+	m_Stats.updates++;
+	return true;
+}
+
+size_t ROMCatalog::GetCount() const
+{
+	return m_FileEntries + m_Added.size() - std::count(m_Superseded.begin(), m_Superseded.end(), true);
+}
+
+const ROMCatalog::Stats& ROMCatalog::GetStats() const
+{
+	return m_Stats;
+}
+
+size_t ROMCatalog::Precompile(const Entry& entry, Chip8& chip8)
+{
+	size_t translated = 0;
+	for (size_t i = 0; i < entry.blockCount; i++)
+	{
+		if (!chip8.Precompile(entry.blocks[i].start, entry.blocks[i].length))
+			break; // The entry doesn't describe this program
+		translated++;
+	}
+	return translated;
+}
+
+const char* ROMCatalog::GetQuirkUseName(const QuirkUse& quirk)
+{
+	switch (quirk)
+	{
+	case SHIFT:
+		return "shift";
+	case LOAD_STORE:
+		return "load_store";
+	case JUMP_OFFSET:
+		return "jump_offset";
+	case LOGIC:
+		return "logic";
+	case SPRITE:
+		return "sprite";
+	default:
+		return "unknown";
+	}
+}
+
+// Follows the control flow from the entry point and splits it into blocks
+// the way Chip8::TranslateBlock does, so every block a run starts at a known
+// address is in the result. Targets of BNNN aren't known statically.
+std::vector<Byte> ROMCatalog::Analyze(const Byte* rom, const size_t& size, const uint64_t& hash)
+{
+	typedef Chip8::InstructionId Id;
+
+	// The memory as LoadProgram leaves it
+	std::array<Byte, Chip8::RAM_SIZE> memory = { 0 };
+	std::copy(Chip8::FONT.begin(), Chip8::FONT.end(), memory.begin());
+	size_t romSize = std::min(size, Chip8::RAM_SIZE - Chip8::USER_SPACE_ADDR);
+	std::copy_n(rom, romSize, memory.begin() + Chip8::USER_SPACE_ADDR);
+	size_t programEnd = Chip8::USER_SPACE_ADDR + romSize;
+
+	std::vector<BlockInfo> blocks;
+	size_t instructions = 0;
+	uint32_t quirks = 0;
+	std::vector<bool> visited(programEnd + 1, false);
+	std::vector<size_t> pending = { Chip8::USER_SPACE_ADDR };
+	while (!pending.empty())
+	{
+		size_t start = pending.back();
+		pending.pop_back();
+		if (start > programEnd || visited[start])
+			continue;
+		visited[start] = true;
+
+		size_t addr = start;
+		uint16_t length = 0;
+		Id id = Id::UNKNOWN;
+		while (addr <= programEnd && length < Chip8::MAX_BLOCK_SIZE)
+		{
+			CPU::Opcode opcode = memory[addr & Chip8::ADDRESS_MASK] << 8 | memory[(addr + 1) & Chip8::ADDRESS_MASK];
+			id = Chip8::Decode(opcode);
+			instructions++;
+			length++;
+			addr += Chip8::INSTRUCTION_SIZE;
+			switch (id)
+			{
+			case Id::OP_8XY6: case Id::OP_8XYE:
+				quirks |= SHIFT;
+				break;
+			case Id::OP_FX55: case Id::OP_FX65:
+				quirks |= LOAD_STORE;
+				break;
+			case Id::OP_BNNN:
+				quirks |= JUMP_OFFSET;
+				break;
+			case Id::OP_8XY1: case Id::OP_8XY2: case Id::OP_8XY3:
+				quirks |= LOGIC;
+				break;
+			case Id::OP_DXYN:
+				quirks |= SPRITE;
+				break;
+			default:
+				break;
+			}
+			if (!Chip8::EndsBlock(id))
+				continue;
+
+			Chip8::Address target = opcode & 0x0FFF;
+			switch (id)
+			{
+			case Id::OP_1NNN:
+				pending.push_back(target);
+				break;
+			case Id::OP_2NNN:
+				pending.push_back(addr); // Where 00EE returns to
+				pending.push_back(target);
+				break;
+			case Id::OP_3XNN: case Id::OP_4XNN: case Id::OP_5XY0: case Id::OP_9XY0:
+			case Id::OP_EX9E: case Id::OP_EXA1:
+				pending.push_back(addr + Chip8::INSTRUCTION_SIZE);
+				pending.push_back(addr);
+				break;
+			case Id::OP_FX0A:
+				pending.push_back(addr - Chip8::INSTRUCTION_SIZE); // Retried while waiting
+				pending.push_back(addr);
+				break;
+			case Id::OP_FX33: case Id::OP_FX55:
+				pending.push_back(addr);
+				break;
+			default: // 00EE and BNNN
+				break;
+			}
+			break;
+		}
+		if (!Chip8::EndsBlock(id))
+			pending.push_back(addr); // Split at MAX_BLOCK_SIZE, or past the end
+		blocks.push_back({ static_cast<Chip8::Address>(start), length });
+	}
+
+	RecordHeader header = { hash, static_cast<uint32_t>(size), quirks,
+		static_cast<uint32_t>(blocks.size()), static_cast<uint32_t>(instructions), NO_PLATFORM, 0 };
+	size_t recordSize = sizeof(header) + blocks.size() * sizeof(BlockInfo) + size;
+	std::vector<Byte> record((recordSize + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1), 0);
+	Byte* out = record.data();
+	std::memcpy(out, &header, sizeof(header));
+	out += sizeof(header);
+	std::memcpy(out, blocks.data(), blocks.size() * sizeof(BlockInfo));
+	out += blocks.size() * sizeof(BlockInfo);
+	std::memcpy(out, rom, size);
+	return record;
+}
+
+bool ROMCatalog::ParseRecord(const Byte* data, const size_t& size, Entry& entry)
+{
+	if (size < sizeof(RecordHeader))
+		return false;
+	const RecordHeader* header = reinterpret_cast<const RecordHeader*>(data);
+	size_t blockBytes = static_cast<size_t>(header->blockCount) * sizeof(BlockInfo);
+	if (sizeof(RecordHeader) + blockBytes + header->size > size)
+		return false;
+	const BlockInfo* blocks = reinterpret_cast<const BlockInfo*>(data + sizeof(RecordHeader));
+
+	// Whether the blocks match the program is checked by Chip8::Precompile
+	size_t total = 0;
+	for (uint32_t i = 0; i < header->blockCount; i++)
+	{
+		if (blocks[i].length == 0 || blocks[i].length > Chip8::MAX_BLOCK_SIZE)
+			return false;
+		total += blocks[i].length;
+	}
+	if (total != header->instructionCount)
+		return false;
+	if (header->platform != NO_PLATFORM && header->platform >= (1u << Chip8::QUIRK_COUNT))
+		return false;
+
+	entry.hash = header->hash;
+	entry.size = header->size;
+	entry.quirks = header->quirks;
+	entry.platform = header->platform;
+	entry.blocks = blocks;
+	entry.blockCount = header->blockCount;
+	entry.instructionCount = header->instructionCount;
+	entry.rom = data + sizeof(RecordHeader) + blockBytes;
+	return true;
+}
+
+const ROMCatalog::Slot* ROMCatalog::GetSlots() const
+{
+	if (!m_File)
+		return nullptr;
+	return reinterpret_cast<const Slot*>(m_File->GetData() + sizeof(FileHeader));
+}
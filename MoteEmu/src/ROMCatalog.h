@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Chip8.h"
+#include "ROMLoader.h"
+
+// On-disk index of ROM analyses, keyed by a hash of the ROM contents. Each
+// entry holds the ROM itself, the quirk-sensitive instructions it reaches and
+// its statically reachable basic blocks, so that later runs of the same ROM
+// can skip the analysis and start with their blocks translated (see
+// Precompile). Lookups compare the whole ROM, not just its hash. An entry can
+// also name the quirks its ROM is meant to run with (see SetPlatform).
+//
+// The file is an open-addressing hash table followed by the records and is
+// mapped read-only, so opening it and looking a ROM up are O(1). New entries
+// are kept in memory until Save rewrites the file. Not thread-safe.
+class ROMCatalog
+{
+public:
+	static constexpr const uint32_t MAGIC = 0x43523843; // "C8RC"
+	static constexpr const uint16_t VERSION = 3; // 2: records hold the ROM instead of instruction ids, 3: platform
+	static constexpr const Chip8::Quirks NO_PLATFORM = 0xFFFFFFFF; // The ROM's quirks aren't known
+
+	// Instructions that behave differently between CHIP-8 interpreters,
+	// an entry has the bit set if its ROM can reach one of them
+	enum QuirkUse : uint32_t {
+		SHIFT = 1 << 0,       // 8XY6/8XYE: shift VX or VY
+		LOAD_STORE = 1 << 1,  // FX55/FX65: leave I or increment it
+		JUMP_OFFSET = 1 << 2, // BNNN: offset by V0 or VX
+		LOGIC = 1 << 3,       // 8XY1-8XY3: keep VF or reset it
+		SPRITE = 1 << 4,      // DXYN: clip or wrap at the screen edges
+		QUIRK_USE_COUNT = 5
+	};
+
+	struct BlockInfo {
+		Chip8::Address start;
+		uint16_t length; // In instructions
+	};
+
+	// View of a record, valid until the catalog is saved, reopened or destroyed
+	struct Entry {
+		uint64_t hash = 0;
+		uint32_t size = 0;   // Of the ROM, in bytes
+		uint32_t quirks = 0; // QuirkUse bits
+		Chip8::Quirks platform = NO_PLATFORM; // The quirks the ROM runs with
+		const BlockInfo* blocks = nullptr;
+		size_t blockCount = 0;
+		size_t instructionCount = 0; // Of all blocks
+		const Byte* rom = nullptr;   // The contents the entry was made from
+	};
+
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t updates = 0; // Platforms set
+	};
+
+	ROMCatalog();
+	~ROMCatalog();
+
+	// Maps a catalog file, a missing file is an empty catalog. Returns false
+	// (and starts empty) if the file isn't a catalog of this version, Save
+	// would replace it.
+	bool Open(const char* filename);
+	// Writes the opened and the added entries and reopens the file
+	bool Save(const char* filename);
+
+	// Returns false if the ROM isn't in the catalog
+	bool Find(const Byte* rom, const size_t& size, Entry& entry);
+	// Finds the ROM or analyzes it and adds the result
+	Entry Lookup(const Byte* rom, const size_t& size);
+	// Records the quirks the entry's ROM runs with and points the entry at
+	// the updated record. Returns true if they changed, Save writes them.
+	bool SetPlatform(Entry& entry, const Chip8::Quirks& quirks);
+	size_t GetCount() const;
+	const Stats& GetStats() const;
+
+	// Translates the entry's blocks into the machine's block cache, after its
+	// program was loaded. The blocks are decoded from the machine's memory,
+	// translation stops at the first one that doesn't come out with the
+	// length the entry has. Returns the blocks translated, 0 in the interpreter.
+	static size_t Precompile(const Entry& entry, Chip8& chip8);
+	static const char* GetQuirkUseName(const QuirkUse& quirk);
+
+private:
+	struct FileHeader {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t reserved;
+		uint32_t slotCount; // A power of 2
+		uint32_t entryCount;
+	};
+	// Offset 0 marks an empty slot
+	struct Slot {
+		uint64_t hash;
+		uint32_t offset;
+		uint32_t size;
+	};
+	// Followed by the blocks and the ROM, padded to 8 bytes
+	struct RecordHeader {
+		uint64_t hash;
+		uint32_t size;
+		uint32_t quirks;
+		uint32_t blockCount;
+		uint32_t instructionCount;
+		uint32_t platform;
+		uint32_t reserved;
+	};
+
+	static std::vector<Byte> Analyze(const Byte* rom, const size_t& size, const uint64_t& hash);
+	static bool ParseRecord(const Byte* data, const size_t& size, Entry& entry);
+	const Slot* GetSlots() const;
+
+	std::unique_ptr<ROMImage> m_File;
+	uint32_t m_SlotCount = 0;
+	uint32_t m_FileEntries = 0;
+	// Slots whose record SetPlatform replaced with an added copy
+	std::vector<bool> m_Superseded;
+	// Records added since the file was opened, by hash
+	std::vector<std::vector<Byte>> m_Added;
+	std::unordered_multimap<uint64_t, size_t> m_AddedIndex;
+	Stats m_Stats;
+};
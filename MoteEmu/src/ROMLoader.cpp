@@ -0,0 +1,130 @@
+#include "ROMLoader.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+ROMImage::ROMImage()
+{
+}
+
+ROMImage::~ROMImage()
+{
+	Unmap();
+}
+
+const Byte* ROMImage::GetData() const
+{
+	return m_Data;
+}
+
+size_t ROMImage::GetSize() const
+{
+	return m_Size;
+}
+
+void ROMImage::Unmap()
+{
+#ifdef _WIN32
+	if (m_Data != nullptr)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping != nullptr)
+		CloseHandle(m_Mapping);
+	if (m_File != nullptr)
+		CloseHandle(m_File);
+	m_File = m_Mapping = nullptr;
+#else
+	if (m_Data != nullptr)
+		munmap(const_cast<Byte*>(m_Data), m_Size);
+#endif // _WIN32
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+ROMLoader::Error ROMLoader::Map(const char* filename, ROMImage& image)
+{
+	image.Unmap();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return Error::OPEN_FAILED;
+	image.m_File = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		image.Unmap();
+		return Error::OPEN_FAILED;
+	}
+	if (size.QuadPart == 0)
+		return Error::NONE; // Mapping an empty file fails, an empty image is fine
+	image.m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (image.m_Mapping == nullptr) {
+		image.Unmap();
+		return Error::MAPPING_FAILED;
+	}
+	image.m_Data = static_cast<const Byte*>(MapViewOfFile(image.m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	if (image.m_Data == nullptr) {
+		image.Unmap();
+		return Error::MAPPING_FAILED;
+	}
+	image.m_Size = static_cast<size_t>(size.QuadPart);
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0)
+		return Error::OPEN_FAILED;
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(file);
+		return Error::OPEN_FAILED;
+	}
+	if (info.st_size == 0) {
+		close(file);
+		return Error::NONE; // Mapping an empty file fails, an empty image is fine
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	close(file); // The mapping keeps the file alive
+	if (data == MAP_FAILED)
+		return Error::MAPPING_FAILED;
+	image.m_Data = static_cast<const Byte*>(data);
+	image.m_Size = static_cast<size_t>(info.st_size);
+#endif // _WIN32
+	return Error::NONE;
+}
+
+ROMLoader::Error ROMLoader::Load(const char* filename, CPU& processor)
+{
+	ROMImage image;
+	Error error = Map(filename, image);
+	if (error != Error::NONE)
+		return error;
+	return Load(image, processor);
+}
+
+ROMLoader::Error ROMLoader::Load(const ROMImage& image, CPU& processor)
+{
+	if (!processor.LoadProgram(image.GetData(), image.GetSize()))
+		return Error::TOO_LARGE;
+	return Error::NONE;
+}
+
+const char* ROMLoader::GetErrorName(const Error& error)
+{
+	switch (error)
+	{
+	case Error::NONE:
+		return "no error";
+	case Error::OPEN_FAILED:
+		return "could not open ROM";
+	case Error::MAPPING_FAILED:
+		return "could not map ROM";
+	case Error::TOO_LARGE:
+		return "ROM does not fit into memory";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CPU.h"
+
+// A ROM file mapped read-only into memory. Machines copy it into their RAM
+// straight from the mapping, and one image can be shared by any number of
+// machines (it is never written to).
+class ROMImage
+{
+public:
+	ROMImage();
+	~ROMImage();
+	ROMImage(const ROMImage&) = delete;
+	ROMImage& operator=(const ROMImage&) = delete;
+
+	const Byte* GetData() const;
+	size_t GetSize() const;
+private:
+	friend class ROMLoader;
+	void Unmap();
+
+	const Byte* m_Data = nullptr;
+	size_t m_Size = 0;
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#endif // _WIN32
+};
+
+class ROMLoader
+{
+public:
+	enum class Error {
+		NONE,
+		OPEN_FAILED, // The file doesn't exist or can't be read
+		MAPPING_FAILED,
+		TOO_LARGE    // The ROM doesn't fit into the machine's memory
+	};
+
+	// Maps the file into `image`, replacing what it held before
+	static Error Map(const char* filename, ROMImage& image);
+	// Maps the file and copies it into the CPU's memory, without reading it into a buffer first
+	static Error Load(const char* filename, CPU& processor);
+	static Error Load(const ROMImage& image, CPU& processor);
+
+	static const char* GetErrorName(const Error& error);
+};
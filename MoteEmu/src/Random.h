@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// The random number generator behind CXNN: xorshift32, four bytes of state
+// instead of the 5 KB of std::mt19937, which matters when thousands of
+// machines run side by side and for the size of save states. The seed is
+// mixed first, so that consecutive seeds give unrelated sequences.
+class Random
+{
+public:
+	explicit Random(const uint32_t& seed = 0)
+	{
+		Seed(seed);
+	}
+
+	void Seed(const uint32_t& seed)
+	{
+		// Finalizer of MurmurHash3, a bijection, so only one seed maps to the invalid zero state
+		uint32_t state = seed;
+		state ^= state >> 16;
+		state *= 0x85EBCA6B;
+		state ^= state >> 13;
+		state *= 0xC2B2AE35;
+		state ^= state >> 16;
+		m_State = state != 0 ? state : 0x9E3779B9;
+	}
+
+	inline uint32_t Next()
+	{
+		m_State ^= m_State << 13;
+		m_State ^= m_State >> 17;
+		m_State ^= m_State << 5;
+		return m_State;
+	}
+
+	// The high bits are the better ones of xorshift
+	inline uint8_t NextByte()
+	{
+		return static_cast<uint8_t>(Next() >> 24);
+	}
+private:
+	uint32_t m_State;
+};
@@ -0,0 +1,246 @@
+#include "RewindBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+// A record is one type byte followed by tokens of
+//   varint zero count, varint literal count, literal bytes
+// that rebuild the state XORed with the base (the previous snapshot, or zeros
+// for a keyframe). Short zero runs are kept inside literals, as a token costs more.
+static constexpr const size_t MIN_ZERO_RUN = 3;
+
+static inline Byte* WriteVarint(Byte* out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = static_cast<Byte>(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = static_cast<Byte>(value);
+	return out;
+}
+
+static inline const Byte* ReadVarint(const Byte* in, size_t& value)
+{
+	value = 0;
+	for (size_t shift = 0;; shift += 7)
+	{
+		Byte byte = *in++;
+		value |= static_cast<size_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return in;
+	}
+}
+
+double RewindBuffer::Stats::AverageSnapshotSize() const
+{
+	return pushed ? static_cast<double>(encodedBytes) / pushed : 0.0;
+}
+
+RewindBuffer::RewindBuffer(const size_t& capacity, const size_t& maxSnapshots)
+	:m_Storage(capacity), m_Entries(std::max<size_t>(maxSnapshots, 1))
+{
+}
+
+RewindBuffer::~RewindBuffer()
+{
+}
+
+void RewindBuffer::Clear()
+{
+	m_First = m_End = 0;
+	m_WritePos = 0;
+	m_Used = 0;
+	m_Keyframe = 0;
+}
+
+void RewindBuffer::Push(const Byte* state, const size_t& size, const uint64_t& frame)
+{
+	if (size != m_StateSize) {
+		Clear();
+		m_StateSize = size;
+		m_Newest.resize(size);
+		// Worst case: a token per MIN_ZERO_RUN + 1 bytes, with two varints of at most 10 bytes
+		m_Scratch.resize(1 + size + (size / (MIN_ZERO_RUN + 1) + 1) * 20);
+	}
+	if (m_End - m_First == m_Entries.size())
+		DropOldest();
+
+	bool keyframe = m_Keyframe < m_First || m_Keyframe >= m_End || m_End - m_Keyframe >= KEYFRAME_INTERVAL;
+	size_t encoded = 0;
+	if (!keyframe) {
+		m_Scratch[0] = DELTA;
+		encoded = 1 + Encode(state, m_Newest.data(), size, &m_Scratch[1]);
+		// A big change (e.g. the RNG refilled its state) starts a new chain
+		keyframe = encoded > At(m_Keyframe).size / 2;
+		if (!keyframe) {
+			Reserve(encoded);
+			keyframe = m_Keyframe < m_First; // Dropped to make room
+		}
+	}
+	if (keyframe) {
+		m_Scratch[0] = KEYFRAME;
+		encoded = 1 + Encode(state, nullptr, size, &m_Scratch[1]);
+		if (encoded > m_Storage.size()) {
+			Clear();
+			return;
+		}
+		Reserve(encoded);
+		m_Keyframe = m_End;
+		m_Stats.keyframes++;
+	}
+	std::memcpy(m_Newest.data(), state, size);
+
+	std::memcpy(&m_Storage[m_WritePos], m_Scratch.data(), encoded);
+	At(m_End) = { frame, static_cast<uint32_t>(m_WritePos), static_cast<uint32_t>(encoded) };
+	m_End++;
+	m_WritePos += encoded;
+	m_Used += encoded;
+	m_Stats.pushed++;
+	m_Stats.encodedBytes += encoded;
+}
+
+bool RewindBuffer::Read(const size_t& age, Byte* state, uint64_t& frame)
+{
+	if (age >= GetCount())
+		return false;
+	frame = At(m_End - 1 - age).frame;
+	return Decode(m_End - 1 - age, state);
+}
+
+bool RewindBuffer::Rewind(const size_t& count, Byte* state, uint64_t& frame)
+{
+	if (!Read(count, state, frame))
+		return false;
+	for (size_t i = 0; i < count; i++)
+	{
+		m_End--;
+		m_Used -= At(m_End).size;
+	}
+	const Entry& newest = At(m_End - 1);
+	m_WritePos = newest.offset + newest.size;
+	std::memcpy(m_Newest.data(), state, m_StateSize);
+	return true;
+}
+
+size_t RewindBuffer::GetCount() const
+{
+	return static_cast<size_t>(m_End - m_First);
+}
+
+size_t RewindBuffer::GetUsedBytes() const
+{
+	return m_Used;
+}
+
+const RewindBuffer::Stats& RewindBuffer::GetStats() const
+{
+	return m_Stats;
+}
+
+RewindBuffer::Entry& RewindBuffer::At(const uint64_t& sequence)
+{
+	return m_Entries[sequence % m_Entries.size()];
+}
+
+const RewindBuffer::Entry& RewindBuffer::At(const uint64_t& sequence) const
+{
+	return m_Entries[sequence % m_Entries.size()];
+}
+
+void RewindBuffer::Reserve(const size_t& size)
+{
+	if (m_WritePos + size > m_Storage.size()) {
+		// Records at or after the write position are left from the previous
+		// lap, so they are the oldest ones. Wrap around to the start.
+		while (m_First != m_End && At(m_First).offset >= m_WritePos)
+			DropOldest();
+		m_WritePos = 0;
+	}
+	while (m_First != m_End)
+	{
+		const Entry& oldest = At(m_First);
+		if (oldest.offset >= m_WritePos + size || m_WritePos >= oldest.offset + oldest.size)
+			break;
+		DropOldest();
+	}
+}
+
+void RewindBuffer::DropOldest()
+{
+	// A keyframe takes its deltas with it
+	do {
+		m_Used -= At(m_First).size;
+		m_First++;
+		m_Stats.dropped++;
+	} while (m_First != m_End && m_Storage[At(m_First).offset] == DELTA);
+}
+
+bool RewindBuffer::Decode(const uint64_t& sequence, Byte* state)
+{
+	if (sequence == m_End - 1) {
+		std::memcpy(state, m_Newest.data(), m_StateSize);
+		return true;
+	}
+	uint64_t keyframe = sequence;
+	while (m_Storage[At(keyframe).offset] != KEYFRAME)
+		keyframe--;
+	std::memset(state, 0, m_StateSize);
+	for (uint64_t i = keyframe; i <= sequence; i++)
+	{
+		const Entry& entry = At(i);
+		Apply(&m_Storage[entry.offset + 1], entry.size - 1, state, m_StateSize);
+	}
+	return true;
+}
+
+size_t RewindBuffer::Encode(const Byte* data, const Byte* base, const size_t& size, Byte* out)
+{
+	auto diff = [&](const size_t& i) { return base ? static_cast<Byte>(data[i] ^ base[i]) : data[i]; };
+	Byte* start = out;
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t zeros = 0;
+		while (i + zeros < size && diff(i + zeros) == 0)
+			zeros++;
+		i += zeros;
+
+		// The literal ends at the next run of MIN_ZERO_RUN zeros (or the end)
+		size_t literal = i;
+		while (i < size)
+		{
+			if (diff(i) != 0) {
+				i++;
+				continue;
+			}
+			size_t run = 1;
+			while (run < MIN_ZERO_RUN && i + run < size && diff(i + run) == 0)
+				run++;
+			if (run == MIN_ZERO_RUN || i + run == size)
+				break;
+			i += run;
+		}
+
+		out = WriteVarint(out, zeros);
+		out = WriteVarint(out, i - literal);
+		for (size_t j = literal; j < i; j++)
+			*out++ = diff(j);
+	}
+	return static_cast<size_t>(out - start);
+}
+
+void RewindBuffer::Apply(const Byte* in, const size_t& inSize, Byte* out, const size_t& size)
+{
+	const Byte* end = in + inSize;
+	size_t i = 0;
+	while (in < end)
+	{
+		size_t zeros, literal;
+		in = ReadVarint(in, zeros);
+		in = ReadVarint(in, literal);
+		i += zeros;
+		for (size_t j = 0; j < literal && i < size; j++)
+			out[i++] ^= *in++;
+	}
+}
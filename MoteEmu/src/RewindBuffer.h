@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "CPU.h"
+
+// History of save states in a fixed amount of memory, one snapshot per frame.
+// Every snapshot is stored as the XOR against the previous one, with the
+// (mostly zero) result run-length encoded, and every KEYFRAME_INTERVAL
+// snapshots comes a keyframe with only its zero runs encoded. A snapshot is
+// decoded by applying the deltas since its keyframe. A frame typically
+// changes a few dozen bytes, so ten minutes take about a megabyte. Records
+// live in a byte ring, the oldest ones are dropped (a keyframe together with
+// its deltas) when room is needed.
+class RewindBuffer
+{
+public:
+	static constexpr const size_t DEFAULT_CAPACITY = 4 * 1024 * 1024; // Bytes of encoded snapshots
+	static constexpr const size_t DEFAULT_MAX_SNAPSHOTS = 10 * 60 * 60; // Ten minutes of frames
+	static constexpr const size_t KEYFRAME_INTERVAL = 600; // In snapshots
+
+	struct Stats {
+		uint64_t pushed = 0;
+		uint64_t keyframes = 0;
+		uint64_t encodedBytes = 0; // Sum of the sizes of all pushed records
+		uint64_t dropped = 0;      // Snapshots that were pushed out of the history
+
+		double AverageSnapshotSize() const;
+	};
+
+	explicit RewindBuffer(const size_t& capacity = DEFAULT_CAPACITY, const size_t& maxSnapshots = DEFAULT_MAX_SNAPSHOTS);
+	~RewindBuffer();
+
+	void Clear();
+	// Stores the state taken after the given frame. States must all have the
+	// same size, a state of a different size starts a new history.
+	void Push(const Byte* state, const size_t& size, const uint64_t& frame);
+	// Decodes the snapshot `age` snapshots back (0 is the newest) into `state`
+	// (of the pushed size). Returns false if the history isn't that long.
+	bool Read(const size_t& age, Byte* state, uint64_t& frame);
+	// Drops the newest `count` snapshots and decodes the one that is the newest
+	// after that, i.e. steps back `count` frames. Returns false if the history
+	// isn't that long, dropping nothing.
+	bool Rewind(const size_t& count, Byte* state, uint64_t& frame);
+
+	size_t GetCount() const;
+	size_t GetUsedBytes() const;
+	const Stats& GetStats() const;
+private:
+	enum RecordType : Byte { KEYFRAME, DELTA };
+	struct Entry {
+		uint64_t frame;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	Entry& At(const uint64_t& sequence);
+	const Entry& At(const uint64_t& sequence) const;
+	void Reserve(const size_t& size);
+	void DropOldest();
+	bool Decode(const uint64_t& sequence, Byte* state);
+
+	// Zero runs and XORed literals, see the .cpp. `base` may be null for zeros.
+	static size_t Encode(const Byte* data, const Byte* base, const size_t& size, Byte* out);
+	// XORs a record's tokens into `out`
+	static void Apply(const Byte* in, const size_t& inSize, Byte* out, const size_t& size);
+
+	std::vector<Byte> m_Storage;
+	std::vector<Entry> m_Entries; // Ring indexed by sequence number
+	uint64_t m_First = 0;         // Sequence number of the oldest snapshot
+	uint64_t m_End = 0;           // One past the newest
+	size_t m_WritePos = 0;
+	size_t m_Used = 0;
+
+	size_t m_StateSize = 0;
+	uint64_t m_Keyframe = 0;     // Sequence number of the newest keyframe
+	std::vector<Byte> m_Newest;  // Decoded newest snapshot, the base of the next delta
+	std::vector<Byte> m_Scratch; // Encoding buffer, large enough for any record
+	Stats m_Stats;
+};
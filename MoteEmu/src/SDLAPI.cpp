@@ -12,8 +12,8 @@ SDLAPI::SDLAPI(Cui32& initFlags)
 
 SDLAPI::~SDLAPI()
 {
-	SDL_FreeSurface(m_Surface[0]);
-	SDL_FreeSurface(m_Surface[1]);
+	SDL_FreeFormat(m_Format);
+	SDL_DestroyTexture(m_Texture);
 	SDL_DestroyRenderer(m_Renderer);
 	SDL_DestroyWindow(m_Window);
 	SDL_Quit();
@@ -21,6 +21,11 @@ SDLAPI::~SDLAPI()
 
 bool SDLAPI::Init()
 {
+	if (m_WakeEvent == 0) {
+		m_WakeEvent = SDL_RegisterEvents(1);
+		if (m_WakeEvent == static_cast<Uint32>(-1))
+			m_WakeEvent = 0;
+	}
 	return SDL_Init(m_InitFlags) < 0;
 }
 
@@ -43,28 +48,25 @@ SDL_Window* SDLAPI::GetWindow() const
 	return m_Window;
 }
 
-SDL_Surface* SDLAPI::GetSurface(const size_t& index) const
-{
-	return m_Surface[index];
-}
-
 bool SDLAPI::CreateWindow(const std::string& title, Cui32& width, Cui32& height, Cui32& posX, Cui32& posY)
 {
 	m_Window = SDL_CreateWindow(title.c_str(), posX, posY, width, height, m_WindowFlags);
 	bool windowStatus = m_Window != nullptr;
 	if (windowStatus) {
-		auto s = SDL_GetWindowSurface(m_Window);
-		m_Surface[0] = s;
-		auto f = s->format;
-		char* pixels = new char[s->h * s->pitch];
-		m_Surface[1] = SDL_CreateRGBSurfaceWithFormatFrom(pixels, s->w, s->h, f->BitsPerPixel / f->BytesPerPixel, s->pitch, f->format);
 		m_Renderer = SDL_CreateRenderer(m_Window, -1, SDL_RENDERER_ACCELERATED);
-		windowStatus = SDL_SetRenderDrawColor(m_Renderer, m_DrawColor.r, m_DrawColor.b, m_DrawColor.g, m_DrawColor.a) == 0;
+		windowStatus = m_Renderer != nullptr && SDL_SetRenderDrawColor(m_Renderer, m_DrawColor.r, m_DrawColor.g, m_DrawColor.b, m_DrawColor.a) == 0;
+	}
+	if (windowStatus) {
+		// The display is uploaded at its native size, the renderer scales it to the window
+		m_Texture = SDL_CreateTexture(m_Renderer, TEXTURE_FORMAT, SDL_TEXTUREACCESS_STREAMING, Display::WIDTH, Display::HEIGHT);
+		// Streaming textures start out undefined
+		windowStatus = m_Texture != nullptr && Upload(m_Frame);
 	}
-	return windowStatus && m_Surface[0] != nullptr && m_Surface[1] != nullptr && m_Renderer != nullptr;
+	m_Dirty = true;
+	return windowStatus;
 }
 
-void SDLAPI::RunGameLoop(Function events, Function update, Function render, ErrorHandler error)
+void SDLAPI::RunGameLoop(Function events, Function update, Function render, ErrorHandler error, Deadline deadline)
 {
 	if (error == nullptr)
 		error = [](const ErrorType&, const char*) {};
@@ -72,31 +74,78 @@ void SDLAPI::RunGameLoop(Function events, Function update, Function render, Erro
 		error(ErrorType::CRITICAL, "Window is not created!");
 		return;
 	}
-	if (m_Surface == nullptr) {
-		error(ErrorType::CRITICAL, "Surface is not available!");
+	if (m_Texture == nullptr) {
+		error(ErrorType::CRITICAL, "Display texture is not available!");
 		return;
 	}
 
 	m_Running = true;
+	Clock::time_point start = Clock::now();
 
 	while (m_Running) {
 		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
-			if (event.type == SDL_EventType::SDL_QUIT) {
-				m_Running = false;
-				break;
-			}
-			if (events != nullptr)
-				events(this);
-		}
+		while (m_Running && SDL_PollEvent(&event))
+			HandleEvent(event, events);
+		if (!m_Running)
+			break;
 		if (update != nullptr)
 			update(this);
+		// Presenting is up to the render callback, which can skip unchanged frames
 		if (render != nullptr)
 			render(this);
-		if (!UpdateWindow()) {
-			error(ErrorType::WARNING, "Failed to update window!");
+		m_LoopStats.iterations++;
+		if (deadline != nullptr && m_Running && WaitUntil(deadline(this), event))
+			HandleEvent(event, events);
+	}
+	m_LoopStats.runTime += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void SDLAPI::HandleEvent(const SDL_Event& event, const Function& events)
+{
+	if (event.type == SDL_EventType::SDL_QUIT) {
+		m_Running = false;
+		return;
+	}
+	if (event.type == SDL_EventType::SDL_WINDOWEVENT)
+		m_Dirty = true; // Exposed, resized, restored... redraw on the next Present
+	if (event.type != m_WakeEvent && events != nullptr)
+		events(this);
+}
+
+bool SDLAPI::WaitUntil(const Clock::time_point& deadline, SDL_Event& event)
+{
+	Clock::time_point start = Clock::now();
+	if (start >= deadline)
+		return false;
+	m_LoopStats.waits++;
+	bool woken = false;
+	Clock::time_point now = start;
+	while (now < deadline)
+	{
+		Clock::duration remaining = deadline - now;
+		if (remaining > WAIT_MARGIN) {
+			// Sleeps in the event queue, so input ends the wait right away
+			int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(remaining - WAIT_MARGIN).count());
+			woken = SDL_WaitEventTimeout(&event, std::max(timeout, 1)) != 0;
+		}
+		else {
+			woken = SDL_PollEvent(&event) != 0;
+			if (!woken)
+				std::this_thread::sleep_for(std::min<Clock::duration>(remaining, WAIT_SLICE));
 		}
+		now = Clock::now();
+		if (woken)
+			break;
 	}
+	m_LoopStats.waitTime += std::chrono::duration<double>(now - start).count();
+	if (woken) {
+		m_LoopStats.eventWakeups++;
+		return true;
+	}
+	double lateness = std::chrono::duration<double>(now - deadline).count();
+	m_LoopStats.totalLateness += lateness;
+	m_LoopStats.maxLateness = std::max(m_LoopStats.maxLateness, lateness);
+	return false;
 }
 
 void SDLAPI::Quit()
@@ -104,34 +153,74 @@ void SDLAPI::Quit()
 	m_Running = false;
 }
 
+void SDLAPI::WakeUp()
+{
+	if (m_WakeEvent == 0)
+		return;
+	SDL_Event event = {};
+	event.type = m_WakeEvent;
+	SDL_PushEvent(&event);
+}
+
 bool SDLAPI::UpdateWindow()
 {
-	return SDL_UpdateWindowSurface(m_Window) == 0;
+	if (SDL_RenderClear(m_Renderer) != 0 || SDL_RenderCopy(m_Renderer, m_Texture, nullptr, nullptr) != 0)
+		return false;
+	SDL_RenderPresent(m_Renderer);
+	m_PresentStats.presents++;
+	m_Dirty = false;
+	return true;
 }
 
-bool SDLAPI::FillRect(const SDL_Rect * rect, Cui32 & color)
+bool SDLAPI::Present(const Display& display)
 {
-	return SDL_FillRect(m_Surface[0], rect, color) == 0;
+	bool changed = display != m_Frame;
+	if (!changed && !m_Dirty) {
+		m_PresentStats.skipped++;
+		return true;
+	}
+	if (changed && !Upload(display))
+		return false;
+	return UpdateWindow();
 }
 
-bool SDLAPI::FillRect(const SDL_Rect * rect, Cui8 & r, Cui8 & g, Cui8 & b)
+bool SDLAPI::Upload(const Display& display)
 {
-	return FillRect(rect, RGB(r,g,b));
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(m_Texture, nullptr, &pixels, &pitch) != 0)
+		return false;
+	display.Expand(static_cast<Uint32*>(pixels), pitch / sizeof(Uint32), RGB(0xFF, 0xFF, 0xFF), RGB(0, 0, 0));
+	SDL_UnlockTexture(m_Texture);
+	m_Frame = display;
+	m_PresentStats.uploads++;
+	return true;
 }
 
-bool SDLAPI::FillRect(const SDL_Rect * rect, Cui8 & r, Cui8 & g, Cui8 & b, Cui8 & a)
+const SDLAPI::PresentStats& SDLAPI::GetPresentStats() const
 {
-	return FillRect(rect, RGBA(r, g, b, a));
+	return m_PresentStats;
 }
 
-bool SDLAPI::ClearScreen()
+const SDLAPI::LoopStats& SDLAPI::GetLoopStats() const
 {
-	bool status = SDL_RenderClear(m_Renderer) == 0;
-	if (status) {
-		size_t size = m_Surface[0]->h * m_Surface[0]->pitch;
-		memcpy_s(m_Surface[1]->pixels, size, m_Surface[0]->pixels, size);
-	}
-	return status;
+	return m_LoopStats;
+}
+
+double SDLAPI::LoopStats::AverageLateness() const
+{
+	uint64_t reached = waits - eventWakeups;
+	return reached != 0 ? totalLateness * 1000.0 / reached : 0.0;
+}
+
+double SDLAPI::LoopStats::MaxLateness() const
+{
+	return maxLateness * 1000.0;
+}
+
+double SDLAPI::LoopStats::BusyFraction() const
+{
+	return runTime > 0.0 ? 1.0 - waitTime / runTime : 1.0;
 }
 
 bool SDLAPI::SetDrawColor(Cui8 & r, Cui8 & g, Cui8 & b, Cui8 & a)
@@ -148,12 +237,32 @@ bool SDLAPI::IsKeyPressed(const KeyMap::key_type& key)
 	return state[((m_Keymap.find(key) != m_Keymap.end()) ? m_Keymap.at(key) : key)];
 }
 
+bool SDLAPI::IsScancodePressed(const SDL_Scancode& code) const
+{
+	return SDL_GetKeyboardState(NULL)[code] != 0;
+}
+
+Uint16 SDLAPI::GetKeyState()
+{
+	Uint16 keys = 0;
+	for (Uint16 key = 0; key < 16; key++)
+		keys |= IsKeyPressed(key) ? 1 << key : 0;
+	return keys;
+}
+
+const char* SDLAPI::GetError() const
+{
+	return SDL_GetError();
+}
+
 Uint32 SDLAPI::RGB(Cui8 & r, Cui8 & g, Cui8 & b)
 {
-	return SDL_MapRGB(m_Surface[0]->format, r, g, b);
+	return RGBA(r, g, b, 0xFF);
 }
 
 Uint32 SDLAPI::RGBA(Cui8 & r, Cui8 & g, Cui8 & b, Cui8 & a)
 {
-	return SDL_MapRGBA(m_Surface[0]->format, r, g, b, a);
+	if (m_Format == nullptr)
+		m_Format = SDL_AllocFormat(TEXTURE_FORMAT);
+	return SDL_MapRGBA(m_Format, r, g, b, a);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <SDL.h>
+#include <chrono>
 #include <string>
 #include <functional>
 #include <vector>
@@ -8,10 +9,11 @@
 #include <thread>
 #include <atomic>
 
+#include "Peripherals.h"
 
 
 
-class SDLAPI
+class SDLAPI : public Peripherals
 {
 public:
 	typedef const Uint64 Cui64;
@@ -21,8 +23,31 @@ public:
 	typedef std::unordered_map<Uint16, SDL_Scancode> KeyMap;
 	enum class ErrorType { NOTICE, WARNING, ERROR, CRITICAL };
 
+	typedef std::chrono::steady_clock Clock;
 	typedef std::function<void(SDLAPI*)> Function;
 	typedef std::function<void(const ErrorType&, const char*)> ErrorHandler;
+	// When the loop has work to do next. The loop sleeps until then or until an event arrives.
+	typedef std::function<Clock::time_point(SDLAPI*)> Deadline;
+
+	struct PresentStats {
+		uint64_t uploads = 0;  // Frames copied into the texture
+		uint64_t presents = 0; // Frames shown on the window
+		uint64_t skipped = 0;  // Present calls without any change to show
+	};
+	struct LoopStats {
+		uint64_t iterations = 0;   // Updates and renders
+		uint64_t waits = 0;        // Times the loop slept
+		uint64_t eventWakeups = 0; // Waits ended early by an event
+		double waitTime = 0.0;     // Seconds spent sleeping
+		double runTime = 0.0;      // Seconds spent in the loop
+		// How late the waits that ran to their deadline woke, in seconds
+		double totalLateness = 0.0;
+		double maxLateness = 0.0;
+
+		double AverageLateness() const; // ms
+		double MaxLateness() const;     // ms
+		double BusyFraction() const;    // Share of the time not spent sleeping
+	};
 
 	SDLAPI();
 	SDLAPI(Cui32& initFlags);
@@ -32,25 +57,56 @@ public:
 	void SetKeyMap(const KeyMap& keymap);
 	void SetWindowFlags(Cui32& flags);
 	SDL_Window* GetWindow() const;
-	SDL_Surface* GetSurface(const size_t& index = 0) const;
 	bool CreateWindow(const std::string& title, Cui32& width, Cui32& height, Cui32& posX = SDL_WINDOWPOS_UNDEFINED, Cui32& posY = SDL_WINDOWPOS_UNDEFINED);
-	void RunGameLoop(Function events = nullptr, Function update = nullptr, Function render = nullptr, ErrorHandler eh = nullptr);
+	// Handles the pending events, updates and renders, then sleeps until the
+	// deadline (if there is one) or the next event, whichever comes first
+	void RunGameLoop(Function events = nullptr, Function update = nullptr, Function render = nullptr, ErrorHandler eh = nullptr, Deadline deadline = nullptr);
 	void Quit();
+	// Ends the loop's current wait early. Can be called from any thread.
+	void WakeUp();
+	// Shows the last uploaded frame again, e.g. after the window was uncovered
 	bool UpdateWindow();
-	bool FillRect(const SDL_Rect* rect, Cui32& color);
-	bool FillRect(const SDL_Rect* rect, Cui8& r, Cui8& g, Cui8& b);
-	bool FillRect(const SDL_Rect* rect, Cui8& r, Cui8& g, Cui8& b, Cui8& a);
-	bool ClearScreen();
 	bool SetDrawColor(Cui8& r, Cui8& g, Cui8& b, Cui8& a);
 
-	bool IsKeyPressed(const KeyMap::key_type& key);
+	// Peripherals
+	// Uploads the frame to a streaming texture of the display's native size
+	// and lets the renderer scale it to the window. Frames equal to the last
+	// one are skipped unless the window needs to be redrawn.
+	bool Present(const Display& display) override;
+	bool IsKeyPressed(const KeyMap::key_type& key) override;
+	// For keys outside of the emulated keypad
+	bool IsScancodePressed(const SDL_Scancode& code) const;
+	const char* GetError() const override;
+
+	const PresentStats& GetPresentStats() const;
+	const LoopStats& GetLoopStats() const;
+	// Bit N set means key N is held down, for handing the input to another thread
+	Uint16 GetKeyState();
 
+	// Colors in the format of the display texture
 	Uint32 RGB(Cui8& r, Cui8& g, Cui8& b);
 	Uint32 RGBA(Cui8& r, Cui8& g, Cui8& b, Cui8& a);
 private:
+	static constexpr const Uint32 TEXTURE_FORMAT = SDL_PIXELFORMAT_ARGB8888;
+	// Event waits have a granularity of about a millisecond, so they stop this
+	// early and the rest of the wait is slept in short slices
+	static constexpr const std::chrono::microseconds WAIT_MARGIN{ 2000 };
+	static constexpr const std::chrono::microseconds WAIT_SLICE{ 200 };
+
+	bool Upload(const Display& display);
+	void HandleEvent(const SDL_Event& event, const Function& events);
+	// Returns true if an event ended the wait, which is then in `event`
+	bool WaitUntil(const Clock::time_point& deadline, SDL_Event& event);
+
 	SDL_Window* m_Window = nullptr;
-	SDL_Surface* m_Surface[2] = { nullptr };
 	SDL_Renderer* m_Renderer = nullptr;
+	SDL_Texture* m_Texture = nullptr;
+	SDL_PixelFormat* m_Format = nullptr;
+	Display m_Frame;       // Contents of the texture
+	bool m_Dirty = true;   // The window has to be redrawn even if the frame didn't change
+	PresentStats m_PresentStats;
+	LoopStats m_LoopStats;
+	Uint32 m_WakeEvent = 0; // Registered by Init
 	SDL_Color m_DrawColor = { 0, 0, 0, 0xFF };
 	Uint32 m_InitFlags = SDL_INIT_VIDEO;
 	Uint32 m_WindowFlags = SDL_WINDOW_SHOWN;
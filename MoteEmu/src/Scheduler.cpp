@@ -0,0 +1,169 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+
+double Scheduler::Stats::AchievedIPS() const
+{
+	return wallSeconds > 0 ? instructions / wallSeconds : 0.0;
+}
+
+double Scheduler::Stats::AverageFrameTime() const
+{
+	return frames ? busySeconds * 1000.0 / frames : 0.0;
+}
+
+Scheduler::Scheduler(CPU* processor, const uint32_t& ips)
+	:m_CPU(processor), m_IPS(std::max(ips, 1u))
+{
+}
+
+Scheduler::~Scheduler()
+{
+}
+
+void Scheduler::SetInstructionsPerSecond(const uint32_t& ips)
+{
+	// The current frame starts over at the new speed
+	m_IPS = std::max(ips, 1u);
+	m_Cycles = 0;
+	m_Frame = 0;
+}
+
+uint32_t Scheduler::GetInstructionsPerSecond() const
+{
+	return m_IPS;
+}
+
+void Scheduler::SetUnthrottled(const bool& unthrottled)
+{
+	m_Unthrottled = unthrottled;
+}
+
+bool Scheduler::IsUnthrottled() const
+{
+	return m_Unthrottled;
+}
+
+void Scheduler::Reset()
+{
+	m_Cycles = 0;
+	m_Frame = 0;
+	m_Started = false;
+	m_Stats = Stats();
+}
+
+void Scheduler::SetFrameCallback(const FrameCallback& callback)
+{
+	m_FrameCallback = callback;
+}
+
+uint64_t Scheduler::GetFrame() const
+{
+	return m_Frame;
+}
+
+void Scheduler::SeekFrame(const uint64_t& frame)
+{
+	m_Frame = frame;
+	m_Cycles = frame ? FrameEnd(frame - 1, m_IPS) : 0;
+	m_Epoch = Clock::now();
+	m_RealTimeFrames = 0;
+}
+
+size_t Scheduler::Run(const size_t& cycles)
+{
+	size_t executed = 0;
+	while (executed < cycles)
+	{
+		uint64_t end = FrameEnd(m_Frame, m_IPS);
+		size_t chunk = static_cast<size_t>(std::min<uint64_t>(cycles - executed, end - m_Cycles));
+		size_t ran = m_CPU->Run(chunk);
+		executed += ran;
+		m_Cycles += ran;
+		m_Stats.instructions += ran;
+		if (ran < chunk)
+			break; // The program ended
+		// Below 60 instructions per second some frames have no instructions at all
+		while (m_Cycles == FrameEnd(m_Frame, m_IPS))
+		{
+			m_CPU->TickTimers();
+			m_Frame++;
+			m_Stats.frames++;
+			if (m_FrameCallback)
+				m_FrameCallback(m_Frame);
+		}
+	}
+	return executed;
+}
+
+bool Scheduler::RunFrame()
+{
+	size_t cycles = static_cast<size_t>(FrameEnd(m_Frame, m_IPS) - m_Cycles);
+	return Run(cycles) == cycles;
+}
+
+bool Scheduler::Update()
+{
+	Clock::time_point now = Clock::now();
+	if (!m_Started) {
+		m_Started = true;
+		m_Start = m_Epoch = now;
+		m_RealTimeFrames = 0;
+	}
+
+	bool running = true;
+	if (m_Unthrottled) {
+		// Emulate for one display period, the caller presents after that
+		Clock::time_point end = GetFrameTime(m_RealTimeFrames + 1);
+		end = std::max(end, now + std::chrono::nanoseconds(1000000000 / FRAME_RATE));
+		do {
+			running = RunFrame();
+		} while (running && Clock::now() < end);
+		// Throttling may be turned back on, resume from here then
+		m_Epoch = Clock::now();
+		m_RealTimeFrames = 0;
+	}
+	else {
+		size_t frames = 0;
+		while (running && frames < MAX_CATCH_UP_FRAMES && now >= GetFrameTime(m_RealTimeFrames))
+		{
+			running = RunFrame();
+			m_RealTimeFrames++;
+			frames++;
+		}
+		if (now >= GetFrameTime(m_RealTimeFrames)) {
+			// Too far behind (host too slow or suspended), drop the backlog instead of spiralling
+			m_Epoch = now;
+			m_RealTimeFrames = 0;
+		}
+	}
+
+	Clock::time_point end = Clock::now();
+	m_Stats.busySeconds += std::chrono::duration<double>(end - now).count();
+	m_Stats.wallSeconds = std::chrono::duration<double>(end - m_Start).count();
+	return running;
+}
+
+Scheduler::Clock::time_point Scheduler::GetNextFrameTime() const
+{
+	if (m_Unthrottled || !m_Started)
+		return Clock::now();
+	return GetFrameTime(m_RealTimeFrames);
+}
+
+const Scheduler::Stats& Scheduler::GetStats() const
+{
+	return m_Stats;
+}
+
+uint64_t Scheduler::FrameEnd(const uint64_t& frame, const uint32_t& ips)
+{
+	// ceil((frame + 1) * ips / FRAME_RATE), so that speeds that aren't a
+	// multiple of the frame rate spread the remainder over the frames
+	return ((frame + 1) * ips + FRAME_RATE - 1) / FRAME_RATE;
+}
+
+Scheduler::Clock::time_point Scheduler::GetFrameTime(const uint64_t& frame) const
+{
+	return m_Epoch + std::chrono::nanoseconds(frame * 1000000000ull / FRAME_RATE);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+#include "CPU.h"
+
+// Drives a CPU in frames of emulated time. A frame is 1/60 s: the frame's
+// share of the configured instructions per second, followed by one tick of
+// the 60 Hz timers. Frame boundaries only depend on the number of executed
+// instructions, so headless runs tick the timers exactly like real-time ones.
+// In real time the frames are paced by the host clock, unless unthrottled,
+// in which case frames run back to back and the display is presented once
+// per display period.
+class Scheduler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::function<void(const uint64_t& frame)> FrameCallback;
+	static constexpr const uint32_t FRAME_RATE = 60; // Hz, both the timers and the display
+	static constexpr const uint32_t DEFAULT_IPS = 600;
+	static constexpr const size_t MAX_CATCH_UP_FRAMES = 4; // Frames run at most per Update when behind
+
+	struct Stats {
+		uint64_t frames = 0;
+		uint64_t instructions = 0;
+		double busySeconds = 0.0; // Host time spent emulating in Update
+		double wallSeconds = 0.0; // Host time from the first to the last Update
+
+		double AchievedIPS() const;
+		double AverageFrameTime() const; // Host milliseconds to emulate a frame
+	};
+
+	explicit Scheduler(CPU* processor, const uint32_t& ips = DEFAULT_IPS);
+	~Scheduler();
+
+	void SetInstructionsPerSecond(const uint32_t& ips);
+	uint32_t GetInstructionsPerSecond() const;
+	void SetUnthrottled(const bool& unthrottled);
+	bool IsUnthrottled() const;
+	// Starts over at frame 0, e.g. after a program was loaded
+	void Reset();
+
+	// Called at the end of every frame, after the timers ticked, with the number of frames completed
+	void SetFrameCallback(const FrameCallback& callback);
+
+	// Frames completed since the last Reset or change of speed
+	uint64_t GetFrame() const;
+	// Moves to the start of the given frame, e.g. after restoring a save state
+	// taken there. Real-time pacing continues from now.
+	void SeekFrame(const uint64_t& frame);
+
+	// Executes up to `cycles` instructions, ticking the timers at every frame
+	// boundary reached. Returns less than requested only if the program ran off its end.
+	size_t Run(const size_t& cycles);
+	// Runs the rest of the current frame. Returns false if the program ran off its end.
+	bool RunFrame();
+	// Runs the frames that are due by the host clock (or, unthrottled, as many
+	// frames as fit into one display period). Call once per display frame.
+	// Returns false if the program ran off its end.
+	bool Update();
+	// Host time at which the next Update has a frame to run (now when unthrottled)
+	Clock::time_point GetNextFrameTime() const;
+
+	const Stats& GetStats() const;
+
+	// Number of instructions after which the given frame ends (counted from 0)
+	static uint64_t FrameEnd(const uint64_t& frame, const uint32_t& ips);
+private:
+	Clock::time_point GetFrameTime(const uint64_t& frame) const;
+
+	CPU* m_CPU;
+	uint32_t m_IPS;
+	bool m_Unthrottled = false;
+	FrameCallback m_FrameCallback;
+
+	// Counted from the last Reset or change of speed
+	uint64_t m_Cycles = 0;
+	uint64_t m_Frame = 0;
+
+	bool m_Started = false;
+	Clock::time_point m_Start;
+	Clock::time_point m_Epoch; // Host time at which m_RealTimeFrames was 0
+	uint64_t m_RealTimeFrames = 0;
+	Stats m_Stats;
+};
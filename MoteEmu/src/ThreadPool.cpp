@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t i = 0; i < threads; i++)
+		m_Workers.emplace_back(new Worker());
+	for (size_t i = 0; i < threads; i++)
+		m_Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_WorkAvailable.notify_all();
+	for (std::thread& thread : m_Threads)
+		thread.join();
+}
+
+void ThreadPool::Submit(Task task)
+{
+	Worker& worker = *m_Workers[m_NextWorker];
+	m_NextWorker = (m_NextWorker + 1) % m_Workers.size();
+	// Counted before it's queued, so that a worker can never see it finish first
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Queued++;
+		m_Pending++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+	}
+	m_WorkAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Finished.wait(lock, [this] { return m_Pending == 0; });
+}
+
+size_t ThreadPool::GetThreadCount() const
+{
+	return m_Threads.size();
+}
+
+uint64_t ThreadPool::GetSteals() const
+{
+	return m_Steals.load(std::memory_order_relaxed);
+}
+
+void ThreadPool::WorkerLoop(const size_t& index)
+{
+	Task task;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WorkAvailable.wait(lock, [this] { return m_Stop || m_Queued > 0; });
+			if (m_Queued == 0)
+				return; // Stopping and nothing left to do
+		}
+		// Another worker may have taken the task in the meantime, go back to waiting then
+		if (!Pop(index, task))
+			continue;
+
+		task();
+		task = nullptr;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (--m_Pending == 0)
+			m_Finished.notify_all();
+	}
+}
+
+bool ThreadPool::Pop(const size_t& index, Task& task)
+{
+	for (size_t i = 0; i < m_Workers.size(); i++)
+	{
+		size_t victim = (index + i) % m_Workers.size();
+		Worker& worker = *m_Workers[victim];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.tasks.empty())
+			continue;
+		// Own queue is used as a stack for locality, others are robbed from the far end
+		if (i == 0) {
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+		}
+		else {
+			task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
+			m_Steals.fetch_add(1, std::memory_order_relaxed);
+		}
+		std::lock_guard<std::mutex> counterLock(m_Mutex);
+		m_Queued--;
+		return true;
+	}
+	return false;
+}
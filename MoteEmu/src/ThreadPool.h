@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task queue. A worker takes
+// the newest task from its own queue and, once that is empty, steals the
+// oldest task from another worker. Tasks must not throw.
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	// 0 threads means one per hardware thread
+	explicit ThreadPool(size_t threads = 0);
+	~ThreadPool();
+
+	// Queues the task on the workers in turn
+	void Submit(Task task);
+	// Blocks until every submitted task has finished
+	void Wait();
+
+	size_t GetThreadCount() const;
+	// Number of tasks that were run by a worker other than the one they were queued on
+	uint64_t GetSteals() const;
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerLoop(const size_t& index);
+	bool Pop(const size_t& index, Task& task);
+
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::vector<std::thread> m_Threads;
+	size_t m_NextWorker = 0;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkAvailable;
+	std::condition_variable m_Finished;
+	size_t m_Queued = 0;  // Tasks in the queues, guarded by m_Mutex
+	size_t m_Pending = 0; // Tasks not finished yet, guarded by m_Mutex
+	bool m_Stop = false;
+	std::atomic<uint64_t> m_Steals{ 0 };
+};
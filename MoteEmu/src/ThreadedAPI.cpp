@@ -0,0 +1,52 @@
+#include "ThreadedAPI.h"
+
+ThreadedAPI::ThreadedAPI()
+{
+}
+
+ThreadedAPI::~ThreadedAPI()
+{
+}
+
+bool ThreadedAPI::Present(const Display& display)
+{
+	m_Frames.GetBack() = display;
+	m_Frames.Publish();
+	return true;
+}
+
+bool ThreadedAPI::IsKeyPressed(const Key& key)
+{
+	return key < 16 && (m_Keys >> key) & 1;
+}
+
+const char* ThreadedAPI::GetError() const
+{
+	return "";
+}
+
+uint16_t ThreadedAPI::LatchKeyState()
+{
+	m_Keys = m_Input.load(std::memory_order_relaxed);
+	return m_Keys;
+}
+
+void ThreadedAPI::SetKeyState(const uint16_t& keys)
+{
+	m_Input.store(keys, std::memory_order_relaxed);
+}
+
+bool ThreadedAPI::AcquireFrame()
+{
+	return m_Frames.Acquire();
+}
+
+bool ThreadedAPI::HasNewFrame() const
+{
+	return m_Frames.HasNew();
+}
+
+const Display& ThreadedAPI::GetFrame() const
+{
+	return m_Frames.GetFront();
+}
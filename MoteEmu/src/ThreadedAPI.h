@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+#include "Peripherals.h"
+#include "TripleBuffer.h"
+
+// Peripherals for a CPU on its own thread. Presented frames are handed to the
+// UI thread through a triple buffer and the UI thread hands the key state back
+// as an atomic bitmask, so neither thread ever waits for the other. The CPU
+// sees the key state as of the last LatchKeyState, so input only changes
+// between frames and a run can be recorded exactly.
+class ThreadedAPI : public Peripherals
+{
+public:
+	ThreadedAPI();
+	~ThreadedAPI();
+
+	// Emulation thread
+	bool Present(const Display& display) override;
+	bool IsKeyPressed(const Key& key) override;
+	const char* GetError() const override;
+	// Takes the key state last set by the UI thread, returns it
+	uint16_t LatchKeyState();
+
+	// UI thread
+	// Bit N set means key N is held down
+	void SetKeyState(const uint16_t& keys);
+	// Makes the newest presented frame current. Returns false if there was none since the last call.
+	bool AcquireFrame();
+	bool HasNewFrame() const;
+	const Display& GetFrame() const;
+private:
+	TripleBuffer<Display> m_Frames;
+	std::atomic<uint16_t> m_Input{ 0 }; // Set by the UI thread
+	uint16_t m_Keys = 0;                 // Seen by the CPU
+};
@@ -0,0 +1,119 @@
+#include "TraceFile.h"
+
+#include <stdio.h>
+
+TraceFile::TraceFile()
+{
+}
+
+TraceFile::~TraceFile()
+{
+}
+
+bool TraceFile::Open(const char* filename)
+{
+	m_Records = nullptr;
+	m_Count = 0;
+	if (ROMLoader::Map(filename, m_Image) != ROMLoader::Error::NONE || m_Image.GetSize() < sizeof(Tracer::FileHeader))
+		return false;
+	m_Header = *reinterpret_cast<const Tracer::FileHeader*>(m_Image.GetData());
+	if (m_Header.magic != Tracer::MAGIC || m_Header.version != Tracer::VERSION || m_Header.recordSize != sizeof(Record))
+		return false;
+	// A trace cut short by a crash ends in the middle of a record
+	m_Records = reinterpret_cast<const Record*>(m_Image.GetData() + sizeof(Tracer::FileHeader));
+	m_Count = (m_Image.GetSize() - sizeof(Tracer::FileHeader)) / sizeof(Record);
+	return true;
+}
+
+const Tracer::FileHeader& TraceFile::GetHeader() const
+{
+	return m_Header;
+}
+
+const TraceFile::Record* TraceFile::GetRecords() const
+{
+	return m_Records;
+}
+
+size_t TraceFile::GetCount() const
+{
+	return m_Count;
+}
+
+uint64_t TraceFile::GetCycle(const size_t& index) const
+{
+	// Records are never dropped, so the one at `index` is that many cycles in
+	return (static_cast<uint64_t>(index) & ~0xFFFFFFFFull) | m_Records[index].cycle;
+}
+
+std::string TraceFile::Disassemble(const CPU::Opcode& opcode)
+{
+	typedef Chip8::InstructionId Id;
+	unsigned nnn = opcode & 0xFFF;
+	unsigned nn = opcode & 0xFF;
+	unsigned n = opcode & 0xF;
+	unsigned x = (opcode >> 8) & 0xF;
+	unsigned y = (opcode >> 4) & 0xF;
+
+	char text[32];
+	switch (Chip8::Decode(opcode))
+	{
+	case Id::OP_0NNN: snprintf(text, sizeof(text), "SYS 0x%03X", nnn); break;
+	case Id::OP_00E0: snprintf(text, sizeof(text), "CLS"); break;
+	case Id::OP_00EE: snprintf(text, sizeof(text), "RET"); break;
+	case Id::OP_1NNN: snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+	case Id::OP_2NNN: snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+	case Id::OP_3XNN: snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); break;
+	case Id::OP_4XNN: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); break;
+	case Id::OP_5XY0: snprintf(text, sizeof(text), "SE V%X, V%X", x, y); break;
+	case Id::OP_6XNN: snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); break;
+	case Id::OP_7XNN: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); break;
+	case Id::OP_8XY0: snprintf(text, sizeof(text), "LD V%X, V%X", x, y); break;
+	case Id::OP_8XY1: snprintf(text, sizeof(text), "OR V%X, V%X", x, y); break;
+	case Id::OP_8XY2: snprintf(text, sizeof(text), "AND V%X, V%X", x, y); break;
+	case Id::OP_8XY3: snprintf(text, sizeof(text), "XOR V%X, V%X", x, y); break;
+	case Id::OP_8XY4: snprintf(text, sizeof(text), "ADD V%X, V%X", x, y); break;
+	case Id::OP_8XY5: snprintf(text, sizeof(text), "SUB V%X, V%X", x, y); break;
+	case Id::OP_8XY6: snprintf(text, sizeof(text), "SHR V%X, V%X", x, y); break;
+	case Id::OP_8XY7: snprintf(text, sizeof(text), "SUBN V%X, V%X", x, y); break;
+	case Id::OP_8XYE: snprintf(text, sizeof(text), "SHL V%X, V%X", x, y); break;
+	case Id::OP_9XY0: snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); break;
+	case Id::OP_ANNN: snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+	case Id::OP_BNNN: snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+	case Id::OP_CXNN: snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); break;
+	case Id::OP_DXYN: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+	case Id::OP_EX9E: snprintf(text, sizeof(text), "SKP V%X", x); break;
+	case Id::OP_EXA1: snprintf(text, sizeof(text), "SKNP V%X", x); break;
+	case Id::OP_FX07: snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+	case Id::OP_FX0A: snprintf(text, sizeof(text), "LD V%X, K", x); break;
+	case Id::OP_FX15: snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+	case Id::OP_FX18: snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+	case Id::OP_FX1E: snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+	case Id::OP_FX29: snprintf(text, sizeof(text), "LD F, V%X", x); break;
+	case Id::OP_FX33: snprintf(text, sizeof(text), "LD B, V%X", x); break;
+	case Id::OP_FX55: snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+	case Id::OP_FX65: snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+	default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+	}
+	return text;
+}
+
+std::string TraceFile::FormatEffects(const Record& record)
+{
+	char text[48];
+	int length = 0;
+	if (record.reg == Tracer::REGISTER_I)
+		length += snprintf(text + length, sizeof(text) - length, "I=0x%03X ", record.value);
+	else if (record.reg < 0x10)
+		length += snprintf(text + length, sizeof(text) - length, "V%X=0x%02X ", record.reg, record.value);
+	length += snprintf(text + length, sizeof(text) - length, "VF=%u", record.flag);
+	if (record.address != Tracer::NO_ADDRESS)
+		snprintf(text + length, sizeof(text) - length, " [0x%03X]", record.address);
+	return text;
+}
+
+bool TraceFile::Matches(const Record& a, const Record& b)
+{
+	return a.pc == b.pc && a.opcode == b.opcode && a.address == b.address
+		&& a.reg == b.reg && a.value == b.value && a.flag == b.flag;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "ROMLoader.h"
+#include "Tracer.h"
+
+// A trace written by Tracer, mapped read-only
+class TraceFile
+{
+public:
+	typedef Tracer::Record Record;
+
+	TraceFile();
+	~TraceFile();
+
+	// Returns false if the file can't be mapped or isn't a trace of this version
+	bool Open(const char* filename);
+
+	const Tracer::FileHeader& GetHeader() const;
+	const Record* GetRecords() const;
+	size_t GetCount() const;
+	// Cycle of a record, with the bits the record leaves out
+	uint64_t GetCycle(const size_t& index) const;
+
+	// Assembly of an opcode, e.g. "ADD V1, V2"
+	static std::string Disassemble(const CPU::Opcode& opcode);
+	// The effects of a record, e.g. "V1=0x3C VF=1 [0x2F0]"
+	static std::string FormatEffects(const Record& record);
+	// True if the records show the same instruction with the same effects
+	static bool Matches(const Record& a, const Record& b);
+private:
+	ROMImage m_Image;
+	Tracer::FileHeader m_Header = {};
+	const Record* m_Records = nullptr;
+	size_t m_Count = 0;
+};
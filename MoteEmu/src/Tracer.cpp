@@ -0,0 +1,95 @@
+#include "Tracer.h"
+
+#include <chrono>
+
+Tracer::Tracer(const size_t& capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size *= 2;
+	m_Ring.resize(size);
+	m_Mask = size - 1;
+}
+
+Tracer::~Tracer()
+{
+	Close();
+}
+
+bool Tracer::Open(const char* filename, const uint64_t& romHash, const Chip8::Quirks& quirks)
+{
+	Close();
+	m_File.open(filename, std::ios::binary | std::ios::trunc);
+	if (!m_File.is_open())
+		return false;
+	FileHeader header = { MAGIC, VERSION, static_cast<uint16_t>(sizeof(Record)), romHash, quirks, 0 };
+	m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	m_Head = 0;
+	m_Limit = m_Ring.size();
+	m_Stats = Stats();
+	m_Published.store(0, std::memory_order_relaxed);
+	m_Written.store(0, std::memory_order_relaxed);
+	m_Stop.store(false, std::memory_order_relaxed);
+	m_Writer = std::thread(&Tracer::Write, this);
+	return true;
+}
+
+bool Tracer::Close()
+{
+	if (!m_Writer.joinable())
+		return true;
+	m_Published.store(m_Head, std::memory_order_release);
+	m_Stop.store(true, std::memory_order_release);
+	m_Writer.join();
+	m_Stats.records = m_Head;
+	m_File.close();
+	return !m_File.fail();
+}
+
+bool Tracer::IsOpen() const
+{
+	return m_Writer.joinable();
+}
+
+const Tracer::Stats& Tracer::GetStats() const
+{
+	return m_Stats;
+}
+
+void Tracer::WaitForSpace()
+{
+	m_Stats.stalls++;
+	// Everything appended so far has to be visible to the writer, or it may never make room
+	m_Published.store(m_Head, std::memory_order_release);
+	while (m_Head - m_Written.load(std::memory_order_acquire) == m_Ring.size())
+		std::this_thread::yield();
+	m_Limit = m_Written.load(std::memory_order_relaxed) + m_Ring.size();
+}
+
+// Writer thread: copies published records to the file in at most two pieces
+// (the ring wraps), sleeps while there are none
+void Tracer::Write()
+{
+	uint64_t written = 0;
+	while (true)
+	{
+		bool stopping = m_Stop.load(std::memory_order_acquire);
+		uint64_t published = m_Published.load(std::memory_order_acquire);
+		if (published == written) {
+			if (stopping)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		while (written < published)
+		{
+			uint64_t start = written & m_Mask;
+			uint64_t count = std::min(published - written, m_Ring.size() - start);
+			m_File.write(reinterpret_cast<const char*>(&m_Ring[start]), count * sizeof(Record));
+			written += count;
+		}
+		m_Written.store(written, std::memory_order_release);
+	}
+	m_File.flush();
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "Chip8.h"
+
+// Binary execution trace: one fixed-size record per executed instruction,
+// appended to a preallocated ring that a background thread writes to a file.
+// The emulation thread only waits when the ring is full, records are never
+// dropped. Chip8 feeds it only in builds with the "trace" premake option
+// (MOTE_TRACE), the hooks are empty macros otherwise.
+// TraceFile reads the files back, MoteTrace disassembles and diffs them.
+class Tracer
+{
+public:
+	typedef Chip8::Address Address;
+	typedef Chip8::InstructionId InstructionId;
+	static constexpr const uint32_t MAGIC = 0x52543843; // "C8TR"
+	static constexpr const uint16_t VERSION = 1;
+	static constexpr const size_t DEFAULT_CAPACITY = 1 << 20; // Records, 16 MB
+	static constexpr const Byte REGISTER_I = 0x10;
+	static constexpr const Byte NO_REGISTER = 0xFF;
+	static constexpr const Address NO_ADDRESS = 0xFFFF;
+
+	// Values are in the host's byte order
+	struct Record {
+		uint32_t cycle;     // Instructions since the trace started, low 32 bits
+		Address pc;
+		uint16_t opcode;
+		Address address;    // First byte of RAM read or written at I, NO_ADDRESS if none
+		uint16_t value;     // Of the written register after the instruction
+		Byte reg;           // Register written: V0-VF, REGISTER_I or NO_REGISTER
+		Byte flag;          // VF after the instruction
+	};
+	static_assert(sizeof(Record) == 16, "Trace records are 16 bytes");
+
+	// Followed by the records
+	struct FileHeader {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t recordSize;
+		uint64_t romHash;
+		uint32_t quirks;
+		uint32_t reserved;
+	};
+
+	struct Stats {
+		uint64_t records = 0;
+		uint64_t stalls = 0; // Times the ring was full and the emulation thread waited for the writer
+	};
+
+	// `capacity` is in records and rounded up to a power of 2
+	explicit Tracer(const size_t& capacity = DEFAULT_CAPACITY);
+	~Tracer();
+
+	// Creates the file and starts the writer thread. Returns false if the file can't be created.
+	bool Open(const char* filename, const uint64_t& romHash, const Chip8::Quirks& quirks);
+	// Writes what is left in the ring and stops the writer. Returns false if a write failed.
+	bool Close();
+	bool IsOpen() const;
+
+	// Emulation thread, the record gets the next cycle
+	inline void Append(const Address& pc, const CPU::Opcode& opcode, const Address& address,
+		const Byte& reg, const uint16_t& value, const Byte& flag);
+	// The register an instruction writes, NO_REGISTER for those that only
+	// change the PC, the timers, the display or RAM (and VF alone). FX0A
+	// waits for the key in VX here, it doesn't load one into it.
+	static inline Byte GetWrittenRegister(const InstructionId& id, const Byte& x);
+	// True for the instructions that read or write RAM at I
+	static inline bool TouchesMemory(const InstructionId& id);
+
+	const Stats& GetStats() const;
+private:
+	// Records are handed to the writer in batches, and all of them on Close
+	static constexpr const uint64_t PUBLISH_MASK = 0xFF;
+
+	void WaitForSpace();
+	void Write();
+
+	std::vector<Record> m_Ring;
+	uint64_t m_Mask;
+	// Emulation thread
+	uint64_t m_Head = 0;
+	uint64_t m_Limit = 0; // m_Head may grow up to it without reading m_Written
+	Stats m_Stats;
+	// Shared, each on its own cache line
+	alignas(64) std::atomic<uint64_t> m_Published{ 0 };
+	alignas(64) std::atomic<uint64_t> m_Written{ 0 };
+	alignas(64) std::atomic<bool> m_Stop{ false };
+	// Writer thread
+	std::ofstream m_File;
+	std::thread m_Writer;
+};
+
+inline void Tracer::Append(const Address& pc, const CPU::Opcode& opcode, const Address& address,
+	const Byte& reg, const uint16_t& value, const Byte& flag)
+{
+	if (m_Head == m_Limit)
+		WaitForSpace();
+	m_Ring[m_Head & m_Mask] = { static_cast<uint32_t>(m_Head), pc, static_cast<uint16_t>(opcode), address, value, reg, flag };
+	m_Head++;
+	if ((m_Head & PUBLISH_MASK) == 0)
+		m_Published.store(m_Head, std::memory_order_release);
+}
+
+inline Byte Tracer::GetWrittenRegister(const InstructionId& id, const Byte& x)
+{
+	switch (id)
+	{
+	case InstructionId::OP_6XNN: case InstructionId::OP_7XNN:
+	case InstructionId::OP_8XY0: case InstructionId::OP_8XY1: case InstructionId::OP_8XY2: case InstructionId::OP_8XY3:
+	case InstructionId::OP_8XY4: case InstructionId::OP_8XY5: case InstructionId::OP_8XY6: case InstructionId::OP_8XY7:
+	case InstructionId::OP_8XYE: case InstructionId::OP_CXNN: case InstructionId::OP_FX07:
+	case InstructionId::OP_FX65: // The last register loaded
+		return x;
+	case InstructionId::OP_ANNN: case InstructionId::OP_FX1E: case InstructionId::OP_FX29:
+		return REGISTER_I;
+	default:
+		return NO_REGISTER;
+	}
+}
+
+inline bool Tracer::TouchesMemory(const InstructionId& id)
+{
+	switch (id)
+	{
+	case InstructionId::OP_DXYN:
+	case InstructionId::OP_FX33:
+	case InstructionId::OP_FX55:
+	case InstructionId::OP_FX65:
+		return true;
+	default:
+		return false;
+	}
+}
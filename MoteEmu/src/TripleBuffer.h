@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+// Hands the newest value from one producer thread to one consumer thread
+// without locks. Each side owns a slot, the third one is exchanged through an
+// atomic index. The producer never waits for the consumer (it overwrites an
+// unread value), the consumer always sees a complete value.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// Producer: fill the back slot, then publish it
+	T& GetBack();
+	void Publish();
+
+	// Consumer: takes the newest published value if there is one. Returns false
+	// if nothing was published since the last call, the front slot stays as is.
+	bool Acquire();
+	bool HasNew() const;
+	const T& GetFront() const;
+private:
+	static constexpr const uint8_t INDEX_MASK = 0x3;
+	static constexpr const uint8_t FRESH = 0x4; // Set in m_Middle when it holds an unread value
+
+	std::array<T, 3> m_Slots = {};
+	uint8_t m_Back = 0;
+	// Kept on its own cache line, it is the only thing both threads touch
+	alignas(64) std::atomic<uint8_t> m_Middle{ 1 };
+	alignas(64) uint8_t m_Front = 2;
+};
+
+template<typename T>
+inline T& TripleBuffer<T>::GetBack()
+{
+	return m_Slots[m_Back];
+}
+
+template<typename T>
+inline void TripleBuffer<T>::Publish()
+{
+	m_Back = m_Middle.exchange(m_Back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+}
+
+template<typename T>
+inline bool TripleBuffer<T>::Acquire()
+{
+	if (!HasNew())
+		return false;
+	m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & INDEX_MASK;
+	return true;
+}
+
+template<typename T>
+inline bool TripleBuffer<T>::HasNew() const
+{
+	return (m_Middle.load(std::memory_order_relaxed) & FRESH) != 0;
+}
+
+template<typename T>
+inline const T& TripleBuffer<T>::GetFront() const
+{
+	return m_Slots[m_Front];
+}
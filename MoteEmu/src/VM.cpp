@@ -1,12 +1,19 @@
 #include "VM.h"
+#include "Hash.h"
+#include "Log.h"
+
+#include <random>
+#include <stdexcept>
+#include <thread>
 
 VM::VM(CPU * processor, const size_t & RAMSize)
-	:m_CPU(processor), m_RAM(RAMSize)
+	:m_CPU(processor), m_RAM(RAMSize), m_Scheduler(processor)
 {
 	m_Peripherals.Init();
 	m_CPU->UseMemory(&m_RAM);
 	m_CPU->UsePeripherals(&m_Peripherals);
 	m_CPU->Init();
+	LOG(NOTICE, "VM initialized!");
 }
 
 VM::~VM()
@@ -18,64 +25,222 @@ void VM::MapKeyCodes(const SDLAPI::KeyMap & keymap)
 	m_Peripherals.SetKeyMap(keymap);
 }
 
+void VM::SetInstructionsPerSecond(const uint32_t& ips)
+{
+	m_Scheduler.SetInstructionsPerSecond(ips);
+}
+
+void VM::SetUnthrottled(const bool& unthrottled)
+{
+	m_Scheduler.SetUnthrottled(unthrottled);
+}
+
+void VM::SetThreaded(const bool& threaded)
+{
+	m_Threaded = threaded;
+}
+
+void VM::SetRewind(const bool& enabled)
+{
+	if (enabled)
+		m_Rewind.reset(new RewindBuffer());
+	else
+		m_Rewind.reset();
+}
+
+void VM::Record(const char* filename, const uint16_t& quirks)
+{
+	m_MovieFile = filename;
+	m_MovieQuirks = quirks;
+	m_Movie.reset(new Movie());
+}
+
 void VM::Start(const char* filename)
 {
 	{
-		std::ifstream file(filename, std::ios::binary | std::ios::ate);
-		if (!file.is_open()) {
+		ROMImage rom;
+		ROMLoader::Error error = ROMLoader::Map(filename, rom);
+		if (error == ROMLoader::Error::NONE)
+			error = ROMLoader::Load(rom, *m_CPU);
+		if (error != ROMLoader::Error::NONE) {
+			LOG(ERROR, "Could not load %s: %s", filename, ROMLoader::GetErrorName(error));
 			return;
 		}
-		size_t size = file.tellg();
-		file.seekg(0, file.beg);
-		Memory m;
-		m.reserve(size);
-		std::copy(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), std::back_inserter(m));
-		file.close();
-		m_CPU->LoadProgram(m);
+		m_Scheduler.Reset();
+		if (m_Movie) {
+			uint32_t seed = std::random_device()();
+			m_CPU->Seed(seed);
+			m_Movie->Start(seed, m_Scheduler.GetInstructionsPerSecond(), Hash::Fnv1a(rom.GetData(), rom.GetSize()), m_MovieQuirks);
+		}
 	}
+	// Threaded or recorded runs see the input latched at frame boundaries
+	bool latched = m_Threaded || m_Movie;
+	if (latched)
+		m_CPU->UsePeripherals(&m_SharedPeripherals);
+	if (m_Rewind)
+		m_State.resize(m_CPU->GetSaveStateSize());
+	auto endFrame = [this, latched](const uint64_t& frame) {
+		if (m_Rewind) {
+			m_CPU->SaveState(m_State.data(), m_State.size());
+			m_Rewind->Push(m_State.data(), m_State.size(), frame);
+		}
+		if (latched)
+			LatchInput(frame);
+	};
+	endFrame(0);
+	m_Scheduler.SetFrameCallback(endFrame);
 
 	if (!m_Peripherals.CreateWindow("Chip8 test", 256, 128)) {
-		printf_s("Could not create window! %s\n", SDL_GetError());
+		LOG(CRITICAL, "Could not create window! %s", SDL_GetError());
+		Log::Flush();
 		exit(1);
 	}
 
-	m_Peripherals.RunGameLoop(
-		nullptr, 
-		[&](SDLAPI* handle) { 
-			if(!m_CPU->ExecuteInstruction())
-				handle->Quit(); 
-		},
-		[&](SDLAPI* handle) {
-			auto s = handle->GetSurface();
-			auto s1 = handle->GetSurface(1);
-			
-			SDL_Rect display = { 0, 0, 64, 32 };
-			SDL_Rect stretch = { 0, 0, s->w, s->h };
-			handle->UpdateWindow();
-			SDL_BlitScaled(s1, &display, s, &stretch);
-			handle->UpdateWindow();
-		},
-		[&](const SDLAPI::ErrorType& type, const char* msg) {
-			std::string typeStr;
-			switch (type)
-			{
-			case SDLAPI::ErrorType::NOTICE:
-				typeStr = "NOTICE";
-				break;
-			case SDLAPI::ErrorType::WARNING:
-				typeStr = "WARNING";
-				break;
-			case SDLAPI::ErrorType::ERROR:
-				typeStr = "ERROR";
-				break;
-			case SDLAPI::ErrorType::CRITICAL:
-				typeStr = "CRITICAL";
-				break;
-			default:
-				typeStr = "UNKNOWN";
-				break;
+	// One site per severity, so that a flood of notices can't hide an error
+	SDLAPI::ErrorHandler onError = [](const SDLAPI::ErrorType& type, const char* msg) {
+		switch (type)
+		{
+		case SDLAPI::ErrorType::NOTICE:
+			LOG(NOTICE, "%s %s", msg, SDL_GetError());
+			break;
+		case SDLAPI::ErrorType::WARNING:
+			LOG(WARNING, "%s %s", msg, SDL_GetError());
+			break;
+		case SDLAPI::ErrorType::ERROR:
+			LOG(ERROR, "%s %s", msg, SDL_GetError());
+			break;
+		default:
+			LOG(CRITICAL, "%s %s", msg, SDL_GetError());
+			break;
+		}
+	};
+
+	if (m_Threaded) {
+		m_Emulating = true;
+		std::thread emulation(&VM::EmulationLoop, this);
+		m_Peripherals.RunGameLoop(
+			nullptr,
+			[&](SDLAPI* handle) {
+				m_SharedPeripherals.SetKeyState(handle->GetKeyState());
+				m_Rewinding = handle->IsScancodePressed(SDL_SCANCODE_BACKSPACE);
+				if (!m_Emulating)
+					handle->Quit();
+			},
+			[&](SDLAPI* handle) {
+				m_SharedPeripherals.AcquireFrame();
+				if (!handle->Present(m_SharedPeripherals.GetFrame()))
+					LOG(ERROR, "Failed to present the frame! %s", handle->GetError());
+			},
+			onError,
+			[&](SDLAPI*) {
+				// The emulation thread wakes the loop for every frame, this only bounds the wait
+				SDLAPI::Clock::time_point now = SDLAPI::Clock::now();
+				return m_SharedPeripherals.HasNewFrame() ? now : now + std::chrono::milliseconds(100);
+			}
+		);
+		m_Emulating = false;
+		emulation.join();
+	}
+	else {
+		m_Peripherals.RunGameLoop(
+			nullptr,
+			[&](SDLAPI* handle) {
+				if (latched)
+					m_SharedPeripherals.SetKeyState(handle->GetKeyState());
+				try {
+					if (!UpdateEmulation(handle->IsScancodePressed(SDL_SCANCODE_BACKSPACE)))
+						handle->Quit();
+				}
+				catch (const std::exception& e) {
+					LOG(ERROR, "Emulation stopped: %s", e.what());
+					handle->Quit();
+				}
+			},
+			[&](SDLAPI* handle) {
+				if (!handle->Present(m_CPU->GetDisplay()))
+					LOG(ERROR, "Failed to present the frame! %s", handle->GetError());
+			},
+			onError,
+			[&](SDLAPI* handle) {
+				if (m_Rewind && handle->IsScancodePressed(SDL_SCANCODE_BACKSPACE))
+					return m_NextRewind;
+				return m_Scheduler.GetNextFrameTime();
 			}
-			printf_s("(%s): %s %s\n", typeStr.c_str(), msg, SDL_GetError());
+		);
+	}
+
+	m_CPU->UsePeripherals(&m_Peripherals);
+	m_Scheduler.SetFrameCallback(nullptr);
+
+	const SDLAPI::PresentStats& stats = m_Peripherals.GetPresentStats();
+	printf("Presented %llu frames, %llu uploads, %llu unchanged frames skipped\n",
+		static_cast<unsigned long long>(stats.presents), static_cast<unsigned long long>(stats.uploads),
+		static_cast<unsigned long long>(stats.skipped));
+	const SDLAPI::LoopStats& loop = m_Peripherals.GetLoopStats();
+	printf("Main loop: %llu iterations, busy %.1f%% of the time, %llu waits (%llu ended by events), woke %.3f ms late on average, %.3f ms at most\n",
+		static_cast<unsigned long long>(loop.iterations), loop.BusyFraction() * 100.0, static_cast<unsigned long long>(loop.waits),
+		static_cast<unsigned long long>(loop.eventWakeups), loop.AverageLateness(), loop.MaxLateness());
+	const Scheduler::Stats& timing = m_Scheduler.GetStats();
+	printf("Emulated %llu frames at %.0f instructions per second (target %u%s), %.3f ms per frame\n",
+		static_cast<unsigned long long>(timing.frames), timing.AchievedIPS(), m_Scheduler.GetInstructionsPerSecond(),
+		m_Scheduler.IsUnthrottled() ? ", unthrottled" : "", timing.AverageFrameTime());
+	if (m_Rewind) {
+		const RewindBuffer::Stats& rewind = m_Rewind->GetStats();
+		printf("Rewind: %llu frames of history in %llu bytes, %.1f bytes per snapshot\n",
+			static_cast<unsigned long long>(m_Rewind->GetCount()), static_cast<unsigned long long>(m_Rewind->GetUsedBytes()),
+			rewind.AverageSnapshotSize());
+	}
+	if (m_Movie) {
+		if (m_Movie->Save(m_MovieFile.c_str()))
+			printf("Recorded %llu frames to %s\n", static_cast<unsigned long long>(m_Movie->GetFrameCount()), m_MovieFile.c_str());
+		else
+			printf("Could not write the movie to %s\n", m_MovieFile.c_str());
+	}
+}
+
+void VM::EmulationLoop()
+{
+	try {
+		while (m_Emulating)
+		{
+			bool rewinding = m_Rewinding;
+			bool running = UpdateEmulation(rewinding);
+			m_SharedPeripherals.Present(m_CPU->GetDisplay());
+			m_Peripherals.WakeUp();
+			if (!running)
+				break;
+			std::this_thread::sleep_until(rewinding && m_Rewind ? m_NextRewind : m_Scheduler.GetNextFrameTime());
 		}
-	);
+	}
+	catch (const std::exception& e) {
+		LOG(ERROR, "Emulation stopped: %s", e.what());
+	}
+	m_Emulating = false;
+	m_Peripherals.WakeUp(); // So the window notices
+}
+
+bool VM::UpdateEmulation(const bool& rewinding)
+{
+	if (!rewinding || !m_Rewind)
+		return m_Scheduler.Update();
+
+	Scheduler::Clock::time_point now = Scheduler::Clock::now();
+	if (now < m_NextRewind)
+		return true;
+	m_NextRewind = now + std::chrono::nanoseconds(1000000000 / Scheduler::FRAME_RATE);
+	uint64_t frame;
+	if (m_Rewind->Rewind(1, m_State.data(), frame)) {
+		m_CPU->LoadState(m_State.data(), m_State.size());
+		m_Scheduler.SeekFrame(frame);
+		if (m_Threaded || m_Movie)
+			LatchInput(frame); // The movie continues from here
+	}
+	return true;
+}
+
+void VM::LatchInput(const uint64_t& frame)
+{
+	uint16_t keys = m_SharedPeripherals.LatchKeyState();
+	if (m_Movie)
+		m_Movie->Record(frame, keys);
 }
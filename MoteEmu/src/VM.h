@@ -1,21 +1,56 @@
 #pragma once
 
-#include <fstream>
-#include <iterator>
+#include <atomic>
+#include <memory>
 
 #include "SDLAPI.h"
+#include "ThreadedAPI.h"
 #include "CPU.h"
+#include "ROMLoader.h"
+#include "Scheduler.h"
+#include "RewindBuffer.h"
+#include "Movie.h"
 
 class VM
 {
 public:
-	explicit VM(CPU* processor, const size_t& RAMSize);
+	// RAMSize is the memory handed to CPUs without memory of their own (Chip8 has its own)
+	explicit VM(CPU* processor, const size_t& RAMSize = 0);
 	~VM();
 
 	void MapKeyCodes(const SDLAPI::KeyMap& keymap);
+	void SetInstructionsPerSecond(const uint32_t& ips);
+	// Runs as fast as the host allows, presenting at the display rate
+	void SetUnthrottled(const bool& unthrottled);
+	// Runs the CPU on its own thread, so the window never waits for emulation
+	// and emulation never waits for the window (e.g. on vsync)
+	void SetThreaded(const bool& threaded);
+	// Keeps a snapshot of every frame, holding Backspace steps back through them
+	void SetRewind(const bool& enabled);
+	// Records the seed and the input of every frame to a movie file, written
+	// when the window is closed. Input only changes between frames then.
+	// `quirks` are the CPU's, kept for the replay.
+	void Record(const char* filename, const uint16_t& quirks = 0);
 	void Start(const char* filename);
 private:
+	void EmulationLoop();
+	// Runs the frames that are due, or steps back one frame (at the frame rate) while rewinding
+	bool UpdateEmulation(const bool& rewinding);
+	// Hands the input of the frame about to start to the CPU (and the movie)
+	void LatchInput(const uint64_t& frame);
+
 	Memory m_RAM;
 	SDLAPI m_Peripherals;
+	ThreadedAPI m_SharedPeripherals; // Used by the CPU in threaded mode
 	CPU* m_CPU;
+	Scheduler m_Scheduler;
+	bool m_Threaded = false;
+	std::atomic<bool> m_Emulating{ false };
+	std::atomic<bool> m_Rewinding{ false }; // Rewind key state for the emulation thread
+	std::unique_ptr<RewindBuffer> m_Rewind;
+	Memory m_State;
+	Scheduler::Clock::time_point m_NextRewind;
+	std::string m_MovieFile;
+	uint16_t m_MovieQuirks = 0;
+	std::unique_ptr<Movie> m_Movie;
 };
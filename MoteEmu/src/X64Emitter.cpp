@@ -0,0 +1,208 @@
+#include "X64Emitter.h"
+
+void X64Emitter::Clear()
+{
+	m_Code.clear();
+}
+
+const std::vector<uint8_t>& X64Emitter::GetCode() const
+{
+	return m_Code;
+}
+
+void X64Emitter::Alu8(const Alu& op, const Register& dst, const Register& src)
+{
+	Rex(false, src, dst, true);
+	Emit(static_cast<uint8_t>(op) * 8); // op r/m8, r8
+	ModRM(3, src, dst);
+}
+
+void X64Emitter::Alu8(const Alu& op, const Register& dst, const uint8_t& imm)
+{
+	Rex(false, RAX, dst, true);
+	Emit(0x80);
+	ModRM(3, static_cast<uint8_t>(op), dst);
+	Emit(imm);
+}
+
+void X64Emitter::Mov8(const Register& dst, const Register& src)
+{
+	Rex(false, src, dst, true);
+	Emit(0x88);
+	ModRM(3, src, dst);
+}
+
+void X64Emitter::Mov8(const Register& dst, const uint8_t& imm)
+{
+	Rex(false, RAX, dst, true);
+	Emit(0xB0 + (dst & 7));
+	Emit(imm);
+}
+
+void X64Emitter::Shr8(const Register& reg, const uint8_t& count)
+{
+	Rex(false, RAX, reg, true);
+	Emit(count == 1 ? 0xD0 : 0xC0);
+	ModRM(3, 5, reg);
+	if (count != 1)
+		Emit(count);
+}
+
+void X64Emitter::Shl8(const Register& reg)
+{
+	Rex(false, RAX, reg, true);
+	Emit(0xD0);
+	ModRM(3, 4, reg);
+}
+
+void X64Emitter::Setcc(const Condition& cc, const Register& dst)
+{
+	Rex(false, RAX, dst, true);
+	Emit(0x0F);
+	Emit(0x90 + static_cast<uint8_t>(cc));
+	ModRM(3, 0, dst);
+}
+
+void X64Emitter::Load8(const Register& dst, const Register& base, const int8_t& disp)
+{
+	Rex(false, dst, base, false);
+	Emit(0x0F);
+	Emit(0xB6);
+	ModRM(1, dst, base);
+	Emit(static_cast<uint8_t>(disp));
+}
+
+void X64Emitter::Store8(const Register& base, const int8_t& disp, const Register& src)
+{
+	Rex(false, src, base, true);
+	Emit(0x88);
+	ModRM(1, src, base);
+	Emit(static_cast<uint8_t>(disp));
+}
+
+void X64Emitter::Load16(const Register& dst, const Register& base)
+{
+	Rex(false, dst, base, false);
+	Emit(0x0F);
+	Emit(0xB7);
+	ModRM(1, dst, base);
+	Emit(0);
+}
+
+void X64Emitter::Store16(const Register& base, const Register& src)
+{
+	Emit(0x66);
+	Rex(false, src, base, false);
+	Emit(0x89);
+	ModRM(1, src, base);
+	Emit(0);
+}
+
+void X64Emitter::Store16(const Register& base, const uint16_t& imm)
+{
+	Emit(0x66);
+	Rex(false, RAX, base, false);
+	Emit(0xC7);
+	ModRM(1, 0, base);
+	Emit(0);
+	Emit16(imm);
+}
+
+void X64Emitter::Movzx8(const Register& dst, const Register& src)
+{
+	Rex(false, dst, src, true);
+	Emit(0x0F);
+	Emit(0xB6);
+	ModRM(3, dst, src);
+}
+
+void X64Emitter::Mov32(const Register& dst, const uint32_t& imm)
+{
+	Rex(false, RAX, dst, false);
+	Emit(0xB8 + (dst & 7));
+	Emit32(imm);
+}
+
+void X64Emitter::Add32(const Register& dst, const Register& src)
+{
+	Rex(false, src, dst, false);
+	Emit(0x01);
+	ModRM(3, src, dst);
+}
+
+void X64Emitter::Add32(const Register& dst, const uint32_t& imm)
+{
+	Rex(false, RAX, dst, false);
+	Emit(0x81);
+	ModRM(3, 0, dst);
+	Emit32(imm);
+}
+
+void X64Emitter::Imul32(const Register& dst, const Register& src, const int8_t& imm)
+{
+	Rex(false, dst, src, false);
+	Emit(0x6B);
+	ModRM(3, dst, src);
+	Emit(static_cast<uint8_t>(imm));
+}
+
+void X64Emitter::Cmov32(const Condition& cc, const Register& dst, const Register& src)
+{
+	Rex(false, dst, src, false);
+	Emit(0x0F);
+	Emit(0x40 + static_cast<uint8_t>(cc));
+	ModRM(3, dst, src);
+}
+
+void X64Emitter::Mov64(const Register& dst, const Register& src)
+{
+	Rex(true, src, dst, true);
+	Emit(0x89);
+	ModRM(3, src, dst);
+}
+
+void X64Emitter::Push(const Register& reg)
+{
+	Rex(false, RAX, reg, false);
+	Emit(0x50 + (reg & 7));
+}
+
+void X64Emitter::Pop(const Register& reg)
+{
+	Rex(false, RAX, reg, false);
+	Emit(0x58 + (reg & 7));
+}
+
+void X64Emitter::Ret()
+{
+	Emit(0xC3);
+}
+
+void X64Emitter::Emit(const uint8_t& byte)
+{
+	m_Code.push_back(byte);
+}
+
+void X64Emitter::Emit16(const uint16_t& value)
+{
+	Emit(value & 0xFF);
+	Emit(value >> 8);
+}
+
+void X64Emitter::Emit32(const uint32_t& value)
+{
+	Emit16(value & 0xFFFF);
+	Emit16(value >> 16);
+}
+
+void X64Emitter::Rex(const bool& w, const Register& reg, const Register& rm, const bool& force)
+{
+	uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+	if (force || rex != 0x40)
+		Emit(rex);
+}
+
+void X64Emitter::ModRM(const uint8_t& mod, const uint8_t& reg, const Register& rm)
+{
+	Emit(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (rm & 7)));
+}
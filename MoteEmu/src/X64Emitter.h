@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+// Minimal x86-64 machine code assembler, covering just the instructions
+// the Chip8 JIT needs. All byte operations are emitted with a REX prefix
+// so that SIL, DIL, BPL and R8B-R15B can be used interchangeably.
+class X64Emitter
+{
+public:
+	enum Register : uint8_t {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15
+	};
+	// Condition codes as used by Jcc/SETcc/CMOVcc
+	enum class Condition : uint8_t {
+		B = 0x2, AE = 0x3, E = 0x4, NE = 0x5
+	};
+	// The /digit of the 0x80 group, opcode of the register form is digit * 8
+	enum class Alu : uint8_t {
+		ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7
+	};
+
+	void Clear();
+	const std::vector<uint8_t>& GetCode() const;
+
+	// 8-bit register operations
+	void Alu8(const Alu& op, const Register& dst, const Register& src);
+	void Alu8(const Alu& op, const Register& dst, const uint8_t& imm);
+	void Mov8(const Register& dst, const Register& src);
+	void Mov8(const Register& dst, const uint8_t& imm);
+	void Shr8(const Register& reg, const uint8_t& count = 1);
+	void Shl8(const Register& reg); // By 1
+	void Setcc(const Condition& cc, const Register& dst);
+
+	// Memory access through [base + disp8], base can't be RSP or R12
+	void Load8(const Register& dst, const Register& base, const int8_t& disp);   // movzx r32, byte
+	void Store8(const Register& base, const int8_t& disp, const Register& src);
+	void Load16(const Register& dst, const Register& base);                     // movzx r32, word
+	void Store16(const Register& base, const Register& src);
+	void Store16(const Register& base, const uint16_t& imm);
+
+	// 32/64-bit register operations
+	void Movzx8(const Register& dst, const Register& src);
+	void Mov32(const Register& dst, const uint32_t& imm);
+	void Add32(const Register& dst, const Register& src);
+	void Add32(const Register& dst, const uint32_t& imm);
+	void Imul32(const Register& dst, const Register& src, const int8_t& imm);
+	void Cmov32(const Condition& cc, const Register& dst, const Register& src);
+	void Mov64(const Register& dst, const Register& src);
+	void Push(const Register& reg);
+	void Pop(const Register& reg);
+	void Ret();
+private:
+	void Emit(const uint8_t& byte);
+	void Emit16(const uint16_t& value);
+	void Emit32(const uint32_t& value);
+	void Rex(const bool& w, const Register& reg, const Register& rm, const bool& force);
+	void ModRM(const uint8_t& mod, const uint8_t& reg, const Register& rm);
+
+	std::vector<uint8_t> m_Code;
+};
@@ -1,9 +1,14 @@
 #include <memory>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "VM.h"
 #include "Chip8.h"
 #include "test.h"
+#ifdef MOTE_PROFILE
+#include "ExecutionProfile.h"
+#endif // MOTE_PROFILE
 
 #ifndef TEST
 int main(int argc, char** argv) {
@@ -11,12 +16,41 @@ int main(int argc, char** argv) {
 int _main(int argc, char** argv) {
 #endif // !TEST
 
-	if (argc != 2) {
-		printf_s("%u arguments passed. Expected: %u.\n", argc, 2);
+	if (argc < 2) {
+		printf("Usage: %s <rom> [--ips N] [--quirks PLATFORM|MASK] [--unthrottled] [--threaded] [--rewind] [--record FILE] [--profile FILE]\n", argv[0]);
 		return 1;
 	}
 	Chip8 chip8;
-	VM vm(&chip8, 1024 * 4);
+	VM vm(&chip8);
+	const char* profile = nullptr;
+	const char* record = nullptr;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+			vm.SetInstructionsPerSecond(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0)));
+		else if (strcmp(argv[i], "--unthrottled") == 0)
+			vm.SetUnthrottled(true);
+		else if (strcmp(argv[i], "--threaded") == 0)
+			vm.SetThreaded(true);
+		else if (strcmp(argv[i], "--rewind") == 0)
+			vm.SetRewind(true);
+		else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+			Chip8::Quirks quirks;
+			if (!Chip8::ParseQuirks(argv[++i], quirks)) {
+				printf("Unknown quirks: %s\n", argv[i]);
+				return 1;
+			}
+			chip8.SetQuirks(quirks);
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			record = argv[++i];
+		else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+			profile = argv[++i];
+		else
+			printf("Ignoring unknown argument: %s\n", argv[i]);
+	}
+	if (record != nullptr)
+		vm.Record(record, static_cast<uint16_t>(chip8.GetQuirks()));
 	vm.MapKeyCodes({
 		{ 0x0, SDL_Scancode::SDL_SCANCODE_X },
 		{ 0x1, SDL_Scancode::SDL_SCANCODE_1 },
@@ -36,5 +70,12 @@ int _main(int argc, char** argv) {
 		{ 0xF, SDL_Scancode::SDL_SCANCODE_V },
 	});
 	vm.Start(argv[1]);
+#ifdef MOTE_PROFILE
+	if (profile != nullptr && !chip8.GetProfile().Save(profile))
+		printf("Could not write %s\n", profile);
+#else
+	if (profile != nullptr)
+		printf("--profile needs a build with the \"profile\" premake option\n");
+#endif // MOTE_PROFILE
 	return 0;
 }
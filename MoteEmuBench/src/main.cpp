@@ -0,0 +1,289 @@
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HeadlessVM.h"
+#include "ROMCatalog.h"
+#include "Chip8.h"
+#include "Chip8JIT.h"
+#include "Display.h"
+
+// Microbenchmarks of the emulator's hot paths. Every benchmark is run with a
+// growing number of iterations until one run takes --min-time, then the best
+// of three runs is reported. Results go to stdout (or --out) as JSON, so two
+// builds can be diffed; progress goes to stderr.
+
+struct Benchmark {
+	std::string name;
+	// Runs the measured operation `iterations` times
+	std::function<void(const uint64_t& iterations)> run;
+};
+
+struct Result {
+	std::string name;
+	uint64_t iterations;
+	double nsPerOp;
+};
+
+static volatile uint64_t s_Sink; // Keeps results alive so the work isn't optimized away
+
+static constexpr const uint64_t MAX_ITERATIONS = 1ull << 40;
+
+static double Time(const Benchmark& benchmark, const uint64_t& iterations)
+{
+	auto start = std::chrono::steady_clock::now();
+	benchmark.run(iterations);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Result Measure(const Benchmark& benchmark, const double& minTime)
+{
+	uint64_t iterations = 1;
+	double seconds = Time(benchmark, iterations);
+	while (seconds < minTime && iterations < MAX_ITERATIONS)
+	{
+		// Aim a bit past the target, at most 100x per step
+		double scale = seconds > 0 ? minTime * 1.2 / seconds : 100.0;
+		iterations = static_cast<uint64_t>(iterations * (scale < 100.0 ? scale : 100.0)) + 1;
+		seconds = Time(benchmark, iterations);
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		double again = Time(benchmark, iterations);
+		seconds = again < seconds ? again : seconds;
+	}
+	return { benchmark.name, iterations, seconds * 1e9 / iterations };
+}
+
+// Big-endian opcodes, loaded at 0x200
+static Memory MakeROM(const std::vector<uint16_t>& opcodes)
+{
+	Memory rom;
+	for (uint16_t opcode : opcodes)
+	{
+		rom.push_back(static_cast<Byte>(opcode >> 8));
+		rom.push_back(static_cast<Byte>(opcode & 0xFF));
+	}
+	return rom;
+}
+
+// `body` repeated to fill most of a block, followed by a jump back to the start
+static Memory MakeLoop(const std::vector<uint16_t>& body, const size_t& repeat = 32)
+{
+	std::vector<uint16_t> opcodes;
+	for (size_t i = 0; i < repeat; i++)
+		opcodes.insert(opcodes.end(), body.begin(), body.end());
+	opcodes.push_back(0x1000 | Chip8::USER_SPACE_ADDR);
+	return MakeROM(opcodes);
+}
+
+// A program run on a fresh machine, timed per executed instruction
+static Benchmark ProgramBenchmark(const std::string& name, const Memory& rom, const Chip8::ExecutionMode& mode)
+{
+	return { name, [rom, mode](const uint64_t& iterations) {
+		Chip8 chip8;
+		chip8.Seed(0);
+		chip8.SetExecutionMode(mode);
+		HeadlessVM vm(&chip8);
+		vm.Load(rom);
+		s_Sink = chip8.Run(static_cast<size_t>(iterations));
+	} };
+}
+
+static std::vector<Benchmark> CreateBenchmarks(const char* romFile)
+{
+	std::vector<Benchmark> benchmarks;
+
+	// Opcode dispatch: a mix of register instructions, one ExecuteInstruction call each
+	std::vector<uint16_t> alu = { 0x6012, 0x7103, 0x8014, 0x8122, 0x8235, 0x8306, 0x840E, 0xA123 };
+	benchmarks.push_back({ "dispatch/execute_instruction", [alu](const uint64_t& iterations) {
+		Chip8 chip8;
+		HeadlessVM vm(&chip8);
+		vm.Load(MakeLoop(alu));
+		for (uint64_t i = 0; i < iterations; i++)
+			chip8.ExecuteInstruction();
+	} });
+	benchmarks.push_back(ProgramBenchmark("dispatch/run_cached", MakeLoop(alu), Chip8::ExecutionMode::CACHED));
+	if (Chip8JIT::IsSupported())
+		benchmarks.push_back(ProgramBenchmark("dispatch/run_jit", MakeLoop(alu), Chip8::ExecutionMode::JIT));
+
+	// DXYN through the interpreter and Display::Draw on its own, per height and position
+	const Byte sprite[15] = { 0xF0, 0x90, 0xF0, 0x90, 0xF0, 0xFF, 0x81, 0x81, 0x81, 0xFF, 0xAA, 0x55, 0xAA, 0x55, 0xAA };
+	const struct { const char* name; Byte x; Byte y; } positions[] = {
+		{ "aligned", 8, 4 },   // Starts on a byte boundary
+		{ "unaligned", 13, 4 },
+		{ "clipped", 60, 26 }, // Cut off at the right and bottom edges
+		{ "wrapped", 70, 40 }  // Start position wraps around the screen
+	};
+	for (size_t height : { 1, 5, 15 })
+	{
+		for (const auto& position : positions)
+		{
+			std::string suffix = "/h" + std::to_string(height) + "/" + position.name;
+			Byte x = position.x;
+			Byte y = position.y;
+			benchmarks.push_back({ "draw/display" + suffix, [=](const uint64_t& iterations) {
+				Display display;
+				uint64_t collisions = 0;
+				for (uint64_t i = 0; i < iterations; i++)
+					collisions += display.Draw(x, y, sprite, height);
+				s_Sink = collisions;
+			} });
+			// V0 = x, V1 = y, I = font, then DXYN on repeat
+			Memory rom = MakeROM({ static_cast<uint16_t>(0x6000 | x), static_cast<uint16_t>(0x6100 | y), 0xA000 });
+			Memory loop = MakeLoop({ static_cast<uint16_t>(0xD010 | height) });
+			for (size_t i = 0; i + 1 < loop.size(); i += 2)
+			{
+				// Jump back to the loop, not to the setup
+				uint16_t opcode = static_cast<uint16_t>(loop[i] << 8 | loop[i + 1]);
+				if ((opcode & 0xF000) == 0x1000)
+					opcode = 0x1000 | (Chip8::USER_SPACE_ADDR + 6);
+				rom.push_back(static_cast<Byte>(opcode >> 8));
+				rom.push_back(static_cast<Byte>(opcode & 0xFF));
+			}
+			benchmarks.push_back(ProgramBenchmark("draw/dxyn" + suffix, rom, Chip8::ExecutionMode::INTERPRETER));
+		}
+	}
+
+	// Memory instructions, I points at free RAM
+	benchmarks.push_back(ProgramBenchmark("memory/fx33", MakeROM({ 0x60FE, 0xA800, 0xF033, 0x1204 }), Chip8::ExecutionMode::INTERPRETER));
+	benchmarks.push_back(ProgramBenchmark("memory/fx55", MakeROM({ 0xA800, 0xFF55, 0x1202 }), Chip8::ExecutionMode::INTERPRETER));
+	benchmarks.push_back(ProgramBenchmark("memory/fx65", MakeROM({ 0xA800, 0xFF65, 0x1202 }), Chip8::ExecutionMode::INTERPRETER));
+
+	// 2NNN/00EE through Chip8's call stack: two nested calls, their returns and the jump back
+	benchmarks.push_back(ProgramBenchmark("stack/call_return", MakeROM({ 0x2204, 0x1200, 0x2208, 0x00EE, 0x00EE }),
+		Chip8::ExecutionMode::INTERPRETER));
+
+	// Loading a ROM from disk into a machine, like VM::Start does
+	std::string path = romFile;
+	benchmarks.push_back({ "load/rom_file", [path](const uint64_t& iterations) {
+		Chip8 chip8;
+		HeadlessVM vm(&chip8);
+		for (uint64_t i = 0; i < iterations; i++)
+			vm.Load(path.c_str());
+	} });
+	// Loading from a mapping shared by many machines, only the copy into RAM
+	benchmarks.push_back({ "load/rom_image", [path](const uint64_t& iterations) {
+		ROMImage image;
+		ROMLoader::Map(path.c_str(), image);
+		Chip8 chip8;
+		HeadlessVM vm(&chip8);
+		for (uint64_t i = 0; i < iterations; i++)
+			vm.Load(image);
+	} });
+	// Analyzing a ROM for the catalog, and finding the analysis again
+	benchmarks.push_back({ "catalog/analyze", [path](const uint64_t& iterations) {
+		ROMImage image;
+		ROMLoader::Map(path.c_str(), image);
+		for (uint64_t i = 0; i < iterations; i++)
+		{
+			ROMCatalog catalog;
+			s_Sink = catalog.Lookup(image.GetData(), image.GetSize()).blockCount;
+		}
+	} });
+	benchmarks.push_back({ "catalog/find", [path](const uint64_t& iterations) {
+		ROMImage image;
+		ROMLoader::Map(path.c_str(), image);
+		ROMCatalog catalog;
+		ROMCatalog::Entry entry = catalog.Lookup(image.GetData(), image.GetSize());
+		for (uint64_t i = 0; i < iterations; i++)
+			s_Sink = catalog.Find(image.GetData(), image.GetSize(), entry);
+	} });
+
+	// Expanding the bitplane to 32-bit pixels, the CPU side of presenting a frame
+	benchmarks.push_back({ "render/expand", [sprite](const uint64_t& iterations) {
+		Display display;
+		for (size_t i = 0; i < 32; i++)
+			display.Draw(i * 7, i, sprite, 5);
+		std::vector<uint32_t> pixels(Display::WIDTH * Display::HEIGHT);
+		for (uint64_t i = 0; i < iterations; i++)
+			display.Expand(pixels.data(), Display::WIDTH, 0xFFFFFFFF, 0xFF000000 | static_cast<uint32_t>(i));
+		s_Sink = pixels[0];
+	} });
+
+	return benchmarks;
+}
+
+static void PrintUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  --filter TEXT   Only run the benchmarks whose name contains TEXT\n");
+	printf("  --min-time S    Seconds a measured run has to take at least (default: 0.2)\n");
+	printf("  --out FILE      Write the JSON results to FILE instead of stdout\n");
+	printf("  --list          Print the benchmark names and exit\n");
+}
+
+int main(int argc, char** argv) {
+	const char* filter = nullptr;
+	const char* out = nullptr;
+	double minTime = 0.2;
+	bool list = false;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--filter") == 0 && hasValue)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--min-time") == 0 && hasValue)
+			minTime = atof(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && hasValue)
+			out = argv[++i];
+		else if (strcmp(argv[i], "--list") == 0)
+			list = true;
+		else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	// A ROM of typical size for the loading benchmark
+	const char* romFile = "MoteEmuBench.rom.tmp";
+	{
+		Memory rom(3584);
+		for (size_t i = 0; i < rom.size(); i++)
+			rom[i] = static_cast<Byte>(i * 37);
+		FILE* file = fopen(romFile, "wb");
+		if (file == nullptr || fwrite(rom.data(), 1, rom.size(), file) != rom.size()) {
+			printf("Could not write %s\n", romFile);
+			return 1;
+		}
+		fclose(file);
+	}
+
+	std::vector<Result> results;
+	for (const Benchmark& benchmark : CreateBenchmarks(romFile))
+	{
+		if (filter != nullptr && benchmark.name.find(filter) == std::string::npos)
+			continue;
+		if (list) {
+			printf("%s\n", benchmark.name.c_str());
+			continue;
+		}
+		results.push_back(Measure(benchmark, minTime));
+		fprintf(stderr, "%-32s %12.2f ns/op\n", results.back().name.c_str(), results.back().nsPerOp);
+	}
+	remove(romFile);
+	if (list)
+		return 0;
+
+	FILE* json = out != nullptr ? fopen(out, "w") : stdout;
+	if (json == nullptr) {
+		printf("Could not open %s\n", out);
+		return 1;
+	}
+	fprintf(json, "{\n  \"min_time\": %g,\n  \"benchmarks\": [\n", minTime);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& result = results[i];
+		fprintf(json, "    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"ops_per_second\": %.0f }%s\n",
+			result.name.c_str(), static_cast<unsigned long long>(result.iterations), result.nsPerOp,
+			result.nsPerOp > 0 ? 1e9 / result.nsPerOp : 0.0, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(json, "  ]\n}\n");
+	if (json != stdout)
+		fclose(json);
+	return 0;
+}
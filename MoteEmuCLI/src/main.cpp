@@ -0,0 +1,691 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HeadlessVM.h"
+#include "Chip8.h"
+#include "Chip8AOT.h"
+#include "Chip8JIT.h"
+#include "BatchRunner.h"
+#include "Chip8Lockstep.h"
+#include "ROMLoader.h"
+#include "ROMCatalog.h"
+#include "RewindBuffer.h"
+#include "Movie.h"
+#include "Hash.h"
+#ifdef MOTE_PROFILE
+#include "ExecutionProfile.h"
+#endif // MOTE_PROFILE
+#ifdef MOTE_TRACE
+#include "Tracer.h"
+#endif // MOTE_TRACE
+
+static void PrintUsage(const char* program)
+{
+	printf("Usage: %s <rom>... [options]\n", program);
+	printf("  --cycles N   Number of instructions to execute (default: 1000000)\n");
+	printf("  --frames N   Number of 60 Hz frames to execute instead of cycles\n");
+	printf("  --ips N      Instructions per second of emulated time (default: %u)\n", Scheduler::DEFAULT_IPS);
+	printf("  --ipf N      Instructions per frame, same as --ips N*60\n");
+	printf("  --keys MASK  Keys held down during the run, bit N is key N (e.g. 0x20)\n");
+	printf("  --mode MODE  Execution mode: interpreter (default), cached or jit\n");
+	printf("  --quirks Q   Behaviour of the instructions interpreters disagree on: default, vip, schip, xochip\n");
+	printf("               or a mask of the bits 1 shift VX, 2 increment I in FX55/FX65, 4 wrap sprites, 8 BNNN with VX\n");
+	printf("  --crosscheck Compare every JIT block against the interpreter\n");
+	printf("  --no-idle-skip Run loops that wait for the delay timer or a key out instead of skipping to the frame's end\n");
+	printf("  --dump       Print the framebuffer after the run\n");
+	printf("  --seed N     Seed of the random number generator (default: random, 0 in batch mode)\n");
+	printf("  --statecheck Save the state halfway, then check that restoring it replays the second half identically\n");
+	printf("  --rewindcheck Keep a rewind history of every frame, then check that snapshots decode to the recorded states\n");
+	printf("  --profile FILE Write instruction counts and the PC heatmap after the run, CSV for *.csv, JSON otherwise\n");
+	printf("  --folded FILE Write the instructions per call chain after the run (for flamegraph.pl) and\n");
+	printf("               print the subroutines with the most instructions\n");
+	printf("  --top N      Number of subroutines printed with --folded (default: 10)\n");
+	printf("               (--profile, --folded and --top need a build with the \"profile\" premake option)\n");
+	printf("  --trace FILE Write a record of every executed instruction, for MoteTrace (needs a build with the\n");
+	printf("               \"trace\" premake option, jit runs interpret their blocks while tracing)\n");
+	printf("  --catalog FILE Look ROMs up in a catalog of analyses (adding the missing ones), cached and jit\n");
+	printf("               runs then start with the ROM's reachable blocks translated. --quirks is recorded\n");
+	printf("               for the ROM, runs without --quirks use the ones recorded\n");
+	printf("  --aot FILE   Run the blocks compiled ahead of time by MoteAOT for this ROM natively, cached and jit\n");
+	printf("  --replay FILE Replay a movie recorded by MoteEmu --record as fast as possible (seed, speed and input come from it)\n");
+	printf("Batch mode (implied by more than one ROM, --jobs or --repeat):\n");
+	printf("  --batch      Run every ROM as an independent instance in this process\n");
+	printf("  --jobs N     Worker threads (default: one per hardware thread)\n");
+	printf("  --repeat N   Instances per ROM (default: 1)\n");
+	printf("Lockstep mode:\n");
+	printf("  --lockstep N Run N lanes of the ROM side by side, lane L seeded with seed + L\n");
+	printf("               (with --crosscheck every lane is compared against a Chip8 instance)\n");
+}
+
+static void DumpFramebuffer(const Display& display)
+{
+	for (size_t y = 0; y < Display::HEIGHT; y++)
+	{
+		for (size_t x = 0; x < Display::WIDTH; x++)
+			putchar(display.IsSet(x, y) ? '#' : '.');
+		putchar('\n');
+	}
+}
+
+// Runs half of the cycles, saves the state and runs the rest, then restores
+// the state and runs the rest again. Both runs have to end in the same state.
+static int CheckSaveState(HeadlessVM& vm, Chip8& chip8, const size_t& cycles)
+{
+	Scheduler& scheduler = vm.GetScheduler();
+	size_t executed = 0;
+	while (executed < cycles / 2)
+	{
+		size_t frameCycles = static_cast<size_t>(Scheduler::FrameEnd(scheduler.GetFrame(), scheduler.GetInstructionsPerSecond())
+			- (scheduler.GetFrame() ? Scheduler::FrameEnd(scheduler.GetFrame() - 1, scheduler.GetInstructionsPerSecond()) : 0));
+		size_t ran = vm.Run(frameCycles);
+		executed += ran;
+		if (ran < frameCycles)
+			break;
+	}
+
+	Memory state(chip8.GetSaveStateSize());
+	const size_t iterations = 10000;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+		chip8.SaveState(state.data(), state.size());
+	std::chrono::duration<double> saveTime = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+		chip8.LoadState(state.data(), state.size());
+	std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - start;
+	uint64_t frame = scheduler.GetFrame();
+
+	size_t first = vm.Run(cycles - executed);
+	uint64_t hash = chip8.GetStateHash();
+	Display display = chip8.GetDisplay();
+
+	if (!chip8.LoadState(state.data(), state.size())) {
+		printf("Save state was rejected\n");
+		return 1;
+	}
+	scheduler.SeekFrame(frame);
+	size_t second = vm.Run(cycles - executed);
+	bool identical = first == second && hash == chip8.GetStateHash() && display == chip8.GetDisplay();
+
+	printf("Save state: %llu bytes, %.1f ns to save, %.1f ns to load\n", static_cast<unsigned long long>(state.size()),
+		saveTime.count() * 1e9 / iterations, loadTime.count() * 1e9 / iterations);
+	printf("Restored at frame %llu (instruction %llu): %s\n", static_cast<unsigned long long>(frame),
+		static_cast<unsigned long long>(executed), identical ? "replay identical" : "replay DIFFERS");
+	return identical ? 0 : 1;
+}
+
+// Pushes a snapshot after every frame while recording the state hash of each
+// frame, then decodes snapshots from all over the history and checks them
+// against the recorded hashes. Finally rewinds a second and replays it.
+static int CheckRewind(HeadlessVM& vm, Chip8& chip8, const size_t& cycles)
+{
+	RewindBuffer rewind;
+	Memory state(chip8.GetSaveStateSize());
+	std::vector<uint64_t> hashes(1, chip8.GetStateHash());
+	std::chrono::duration<double> pushTime(0);
+	auto snapshot = [&](const uint64_t& frame) {
+		auto start = std::chrono::steady_clock::now();
+		chip8.SaveState(state.data(), state.size());
+		rewind.Push(state.data(), state.size(), frame);
+		pushTime += std::chrono::steady_clock::now() - start;
+		hashes.resize(frame + 1);
+		hashes[frame] = chip8.GetStateHash();
+	};
+	snapshot(0);
+	vm.GetScheduler().SetFrameCallback(snapshot);
+	size_t executed = vm.Run(cycles);
+	uint64_t finalHash = chip8.GetStateHash();
+
+	const RewindBuffer::Stats& stats = rewind.GetStats();
+	printf("Rewind: %llu frames pushed, %llu kept (%.1f s) in %llu bytes, %.1f bytes and %.2f us per snapshot, %llu keyframes\n",
+		static_cast<unsigned long long>(stats.pushed), static_cast<unsigned long long>(rewind.GetCount()),
+		static_cast<double>(rewind.GetCount()) / Scheduler::FRAME_RATE, static_cast<unsigned long long>(rewind.GetUsedBytes()),
+		stats.AverageSnapshotSize(), stats.pushed ? pushTime.count() * 1e6 / stats.pushed : 0.0,
+		static_cast<unsigned long long>(stats.keyframes));
+
+	size_t checked = 0;
+	size_t mismatches = 0;
+	uint64_t frame;
+	for (size_t age = 0; age < rewind.GetCount(); age += 1 + age / 8)
+	{
+		if (!rewind.Read(age, state.data(), frame) || !chip8.LoadState(state.data(), state.size())
+			|| chip8.GetStateHash() != hashes[frame])
+			mismatches++;
+		checked++;
+	}
+
+	size_t back = std::min<size_t>(Scheduler::FRAME_RATE, rewind.GetCount() - 1);
+	if (rewind.Rewind(back, state.data(), frame) && chip8.LoadState(state.data(), state.size())) {
+		checked++;
+		if (chip8.GetStateHash() != hashes[frame])
+			mismatches++;
+		vm.GetScheduler().SeekFrame(frame);
+		size_t start = frame ? static_cast<size_t>(Scheduler::FrameEnd(frame - 1, vm.GetScheduler().GetInstructionsPerSecond())) : 0;
+		vm.Run(executed - start);
+		if (chip8.GetStateHash() != finalHash)
+			mismatches++;
+	}
+	printf("Executed %llu instructions, checked %llu snapshots: %llu mismatches\n",
+		static_cast<unsigned long long>(executed), static_cast<unsigned long long>(checked),
+		static_cast<unsigned long long>(mismatches));
+	return mismatches ? 1 : 0;
+}
+
+// Writes the catalog back if the runs added to it or changed it
+static bool SaveCatalog(ROMCatalog& catalog, const char* filename)
+{
+	const ROMCatalog::Stats& stats = catalog.GetStats();
+	bool changed = stats.misses != 0 || stats.updates != 0;
+	printf("Catalog: %llu hits, %llu misses, %llu platforms set, %llu entries\n", static_cast<unsigned long long>(stats.hits),
+		static_cast<unsigned long long>(stats.misses), static_cast<unsigned long long>(stats.updates),
+		static_cast<unsigned long long>(catalog.GetCount()));
+	if (changed && !catalog.Save(filename)) {
+		printf("Could not write %s\n", filename);
+		return false;
+	}
+	return true;
+}
+
+static void PrintIdleCycles(const Chip8& chip8, const size_t& executed)
+{
+	if (chip8.GetIdleCycles() != 0) {
+		printf("Idle loops: %llu instructions skipped (%.2f%%)\n", static_cast<unsigned long long>(chip8.GetIdleCycles()),
+			executed ? chip8.GetIdleCycles() * 100.0 / executed : 0.0);
+	}
+}
+
+// Drives a run with the seed, speed and per-frame input of a movie. As the
+// movie decides everything, the state hash at the end is the same on every
+// host and the instructions per second make a benchmark of a real workload.
+static int ReplayMovie(const char* rom, const char* filename, const Chip8::ExecutionMode& mode, const bool& skipIdle)
+{
+	Movie movie;
+	if (!movie.Load(filename)) {
+		printf("Could not read movie: %s\n", filename);
+		return 1;
+	}
+	ROMImage image;
+	ROMLoader::Error error = ROMLoader::Map(rom, image);
+	if (error != ROMLoader::Error::NONE) {
+		printf("Could not load %s: %s\n", rom, ROMLoader::GetErrorName(error));
+		return 1;
+	}
+	if (Hash::Fnv1a(image.GetData(), image.GetSize()) != movie.GetROMHash())
+		printf("Warning: the movie was recorded with a different ROM\n");
+
+	Chip8 chip8;
+	chip8.Seed(movie.GetSeed());
+	if (!chip8.SetExecutionMode(mode)) {
+		printf("Execution mode not supported on this host\n");
+		return 1;
+	}
+	chip8.SetQuirks(movie.GetQuirks());
+	chip8.SetIdleSkipping(skipIdle);
+	HeadlessVM vm(&chip8);
+	error = vm.Load(image);
+	if (error != ROMLoader::Error::NONE) {
+		printf("Could not load %s: %s\n", rom, ROMLoader::GetErrorName(error));
+		return 1;
+	}
+	Scheduler& scheduler = vm.GetScheduler();
+	scheduler.SetInstructionsPerSecond(movie.GetInstructionsPerSecond());
+	vm.GetPeripherals().SetKeyState(movie.GetKeys(0));
+	scheduler.SetFrameCallback([&](const uint64_t& frame) { vm.GetPeripherals().SetKeyState(movie.GetKeys(frame)); });
+
+	// The last entry is the input of the frame that was about to start when recording stopped
+	uint64_t frames = movie.GetFrameCount() > 1 ? movie.GetFrameCount() - 1 : 0;
+	size_t cycles = frames ? static_cast<size_t>(Scheduler::FrameEnd(frames - 1, movie.GetInstructionsPerSecond())) : 0;
+	auto start = std::chrono::steady_clock::now();
+	size_t executed = 0;
+	try {
+		executed = vm.Run(cycles);
+	}
+	catch (const std::exception& e) {
+		printf("The program crashed at frame %llu: %s\n", static_cast<unsigned long long>(scheduler.GetFrame()), e.what());
+		return 1;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	double seconds = elapsed.count();
+	printf("Replayed %llu of %llu frames (%llu instructions) in %.3f s: %.2f MIPS, %.0f frames per second%s\n",
+		static_cast<unsigned long long>(scheduler.GetFrame()), static_cast<unsigned long long>(frames),
+		static_cast<unsigned long long>(executed), seconds, seconds > 0 ? executed / seconds / 1e6 : 0.0,
+		seconds > 0 ? scheduler.GetFrame() / seconds : 0.0, executed < cycles ? ", program ended" : "");
+	PrintIdleCycles(chip8, executed);
+	printf("Final state %016llx, framebuffer %016llx\n", static_cast<unsigned long long>(chip8.GetStateHash()),
+		static_cast<unsigned long long>(Hash::Fnv1a(chip8.GetDisplay().GetRows().data(), sizeof(Display::Rows))));
+	return 0;
+}
+
+static int RunBatch(const std::vector<const char*>& roms, const size_t& cycles, const uint32_t& ips, const uint16_t& keys,
+	const Chip8::ExecutionMode& mode, const Chip8::Quirks& quirks, const size_t& jobs, const size_t& repeat, const uint32_t& seed,
+	ROMCatalog* catalog)
+{
+	BatchRunner runner(jobs);
+	if (!runner.SetExecutionMode(mode)) {
+		printf("Execution mode not supported on this host\n");
+		return 1;
+	}
+	runner.SetCatalog(catalog);
+	for (const char* rom : roms)
+	{
+		for (size_t i = 0; i < repeat; i++)
+		{
+			BatchRunner::Job job;
+			job.rom = rom;
+			job.cycles = cycles;
+			job.ips = ips;
+			job.keys = keys;
+			job.seed = seed;
+			job.quirks = quirks;
+			runner.Add(job);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	const std::vector<BatchRunner::Result>& results = runner.Run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	unsigned long long executed = 0;
+	size_t failed = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BatchRunner::Result& result = results[i];
+		printf("[%llu] %s: %s, %llu instructions, state %016llx, framebuffer %016llx%s%s\n",
+			static_cast<unsigned long long>(i), roms[i / repeat], BatchRunner::GetExitReasonName(result.reason),
+			static_cast<unsigned long long>(result.executed), static_cast<unsigned long long>(result.stateHash),
+			static_cast<unsigned long long>(result.framebufferHash), result.error.empty() ? "" : ", ", result.error.c_str());
+		executed += result.executed;
+		if (result.reason == BatchRunner::ExitReason::LOAD_FAILED || result.reason == BatchRunner::ExitReason::CRASHED)
+			failed++;
+	}
+
+	double seconds = elapsed.count();
+	printf("Ran %llu instances on %llu threads in %.3f s: %llu instructions (%.2f MIPS), %llu steals, %llu failed\n",
+		static_cast<unsigned long long>(results.size()), static_cast<unsigned long long>(runner.GetThreadCount()),
+		seconds, executed, seconds > 0 ? executed / seconds / 1e6 : 0.0,
+		static_cast<unsigned long long>(runner.GetSteals()), static_cast<unsigned long long>(failed));
+	return failed == 0 ? 0 : 1;
+}
+
+static int RunLockstep(const char* rom, const size_t& lanes, const size_t& cycles, const uint32_t& ips, const uint16_t& keys,
+	const uint32_t& seed, const bool& crossCheck)
+{
+	// One mapping for the lanes and every machine they're checked against
+	ROMImage program;
+	ROMLoader::Error error = ROMLoader::Map(rom, program);
+	if (error != ROMLoader::Error::NONE) {
+		printf("Could not load %s: %s\n", rom, ROMLoader::GetErrorName(error));
+		return 1;
+	}
+	Chip8Lockstep lockstep(lanes);
+	if (!lockstep.LoadProgram(program.GetData(), program.GetSize())) {
+		printf("Could not load %s: %s\n", rom, ROMLoader::GetErrorName(ROMLoader::Error::TOO_LARGE));
+		return 1;
+	}
+	lockstep.SetInstructionsPerSecond(ips);
+	for (size_t lane = 0; lane < lanes; lane++)
+	{
+		lockstep.Seed(lane, static_cast<uint32_t>(seed + lane));
+		lockstep.SetKeyState(lane, keys);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	size_t executed = lockstep.Run(cycles);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	double seconds = elapsed.count();
+	const Chip8Lockstep::Stats& stats = lockstep.GetStats();
+	printf("Executed %llu instructions on %llu lanes in %.3f s (%.2f MIPS), %.2f lanes per group, %llu divergent steps\n",
+		static_cast<unsigned long long>(executed), static_cast<unsigned long long>(lanes), seconds,
+		seconds > 0 ? executed / seconds / 1e6 : 0.0, stats.AverageGroupSize(),
+		static_cast<unsigned long long>(stats.divergent));
+	for (size_t lane = 0; lane < lanes; lane++)
+	{
+		if (lockstep.GetError(lane) != nullptr)
+			printf("Lane %llu stopped: %s\n", static_cast<unsigned long long>(lane), lockstep.GetError(lane));
+	}
+	if (!crossCheck)
+		return 0;
+
+	size_t mismatches = 0;
+	for (size_t lane = 0; lane < lanes; lane++)
+	{
+		Chip8 chip8;
+		chip8.Seed(static_cast<uint32_t>(seed + lane));
+		HeadlessVM vm(&chip8);
+		vm.Load(program);
+		vm.GetScheduler().SetInstructionsPerSecond(ips);
+		vm.GetPeripherals().SetKeyState(keys);
+		try {
+			vm.Run(cycles);
+		}
+		catch (...) {
+			// The lockstep lane stops at the same point
+		}
+		if (chip8.GetStateHash() != lockstep.GetStateHash(lane) || chip8.GetDisplay() != lockstep.GetDisplay(lane)) {
+			printf("Lane %llu differs from Chip8: state %016llx/%016llx\n", static_cast<unsigned long long>(lane),
+				static_cast<unsigned long long>(lockstep.GetStateHash(lane)), static_cast<unsigned long long>(chip8.GetStateHash()));
+			mismatches++;
+		}
+	}
+	printf("Cross-check: %llu of %llu lanes differ\n", static_cast<unsigned long long>(mismatches), static_cast<unsigned long long>(lanes));
+	return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	std::vector<const char*> roms;
+	bool batch = false;
+	size_t jobs = 0;
+	size_t repeat = 1;
+	size_t lanes = 0;
+	bool seeded = false;
+	uint32_t seed = 0;
+	size_t cycles = 1000000;
+	size_t frames = 0;
+	uint32_t ips = Scheduler::DEFAULT_IPS;
+	uint16_t keys = 0;
+	bool dump = false;
+	bool crossCheck = false;
+	bool skipIdle = true;
+	bool stateCheck = false;
+	bool rewindCheck = false;
+	const char* replay = nullptr;
+	const char* profile = nullptr;
+	const char* folded = nullptr;
+	const char* trace = nullptr;
+	const char* top = nullptr;
+	const char* catalogFile = nullptr;
+	const char* aotFile = nullptr;
+	Chip8::ExecutionMode mode = Chip8::ExecutionMode::INTERPRETER;
+	Chip8::Quirks quirks = Chip8::DEFAULT_QUIRKS;
+	bool quirksGiven = false;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--cycles") == 0 && hasValue)
+			cycles = strtoull(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+			frames = strtoull(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "--ips") == 0 && hasValue)
+			ips = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+		else if (strcmp(argv[i], "--ipf") == 0 && hasValue)
+			ips = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0) * Scheduler::FRAME_RATE);
+		else if (strcmp(argv[i], "--keys") == 0 && hasValue)
+			keys = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+		else if (strcmp(argv[i], "--mode") == 0 && hasValue) {
+			const char* name = argv[++i];
+			if (strcmp(name, "interpreter") == 0)
+				mode = Chip8::ExecutionMode::INTERPRETER;
+			else if (strcmp(name, "cached") == 0)
+				mode = Chip8::ExecutionMode::CACHED;
+			else if (strcmp(name, "jit") == 0)
+				mode = Chip8::ExecutionMode::JIT;
+			else {
+				printf("Unknown execution mode: %s\n", name);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--quirks") == 0 && hasValue) {
+			if (!Chip8::ParseQuirks(argv[++i], quirks)) {
+				printf("Unknown quirks: %s\n", argv[i]);
+				return 1;
+			}
+			quirksGiven = true;
+		}
+		else if (strcmp(argv[i], "--crosscheck") == 0)
+			crossCheck = true;
+		else if (strcmp(argv[i], "--no-idle-skip") == 0)
+			skipIdle = false;
+		else if (strcmp(argv[i], "--statecheck") == 0)
+			stateCheck = true;
+		else if (strcmp(argv[i], "--rewindcheck") == 0)
+			rewindCheck = true;
+		else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+			replay = argv[++i];
+		else if (strcmp(argv[i], "--profile") == 0 && hasValue)
+			profile = argv[++i];
+		else if (strcmp(argv[i], "--folded") == 0 && hasValue)
+			folded = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+			trace = argv[++i];
+		else if (strcmp(argv[i], "--catalog") == 0 && hasValue)
+			catalogFile = argv[++i];
+		else if (strcmp(argv[i], "--aot") == 0 && hasValue)
+			aotFile = argv[++i];
+		else if (strcmp(argv[i], "--top") == 0 && hasValue)
+			top = argv[++i];
+		else if (strcmp(argv[i], "--dump") == 0)
+			dump = true;
+		else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+			seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+			seeded = true;
+		}
+		else if (strcmp(argv[i], "--batch") == 0)
+			batch = true;
+		else if (strcmp(argv[i], "--jobs") == 0 && hasValue)
+			jobs = strtoull(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "--repeat") == 0 && hasValue)
+			repeat = strtoull(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "--lockstep") == 0 && hasValue)
+			lanes = strtoull(argv[++i], nullptr, 0);
+		else if (argv[i][0] != '-')
+			roms.push_back(argv[i]);
+		else {
+			printf("Unknown argument: %s\n", argv[i]);
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+#ifndef MOTE_PROFILE
+	if (profile != nullptr || folded != nullptr) {
+		printf("--profile, --folded and --top need a build with the \"profile\" premake option\n");
+		return 1;
+	}
+	if (top != nullptr)
+		printf("--profile, --folded and --top need a build with the \"profile\" premake option, ignoring --top\n");
+#endif // !MOTE_PROFILE
+#ifndef MOTE_TRACE
+	if (trace != nullptr) {
+		printf("--trace needs a build with the \"trace\" premake option\n");
+		return 1;
+	}
+#endif // !MOTE_TRACE
+	if (frames != 0)
+		cycles = static_cast<size_t>(Scheduler::FrameEnd(frames - 1, ips));
+	if (roms.empty()) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	if (replay != nullptr)
+		return ReplayMovie(roms[0], replay, mode, skipIdle);
+	if (lanes != 0 && quirks != Chip8::DEFAULT_QUIRKS) {
+		printf("--lockstep only runs the default quirks\n");
+		return 1;
+	}
+	if (lanes != 0)
+		return RunLockstep(roms[0], lanes, cycles, ips, keys, seed, crossCheck);
+	ROMCatalog catalog;
+	if (catalogFile != nullptr && !catalog.Open(catalogFile)) {
+		printf("%s isn't a catalog of this version\n", catalogFile); // Rather than overwriting it
+		return 1;
+	}
+	if (batch || roms.size() > 1 || jobs != 0 || repeat != 1) {
+		int status = RunBatch(roms, cycles, ips, keys, mode, quirksGiven ? quirks : ROMCatalog::NO_PLATFORM, jobs, repeat, seed,
+			catalogFile ? &catalog : nullptr);
+		if (catalogFile != nullptr && !SaveCatalog(catalog, catalogFile))
+			status = 1;
+		return status;
+	}
+
+	ROMImage image;
+	ROMLoader::Error error = ROMLoader::Map(roms[0], image);
+	ROMCatalog::Entry entry;
+	if (catalogFile != nullptr && error == ROMLoader::Error::NONE) {
+		entry = catalog.Lookup(image.GetData(), image.GetSize());
+		// Quirks given for a ROM become its platform, runs without take them from there
+		if (quirksGiven)
+			catalog.SetPlatform(entry, quirks);
+		else if (entry.platform != ROMCatalog::NO_PLATFORM) {
+			quirks = entry.platform;
+			printf("Quirks %u, as cataloged for the ROM\n", quirks);
+		}
+	}
+	Chip8 chip8;
+	if (seeded)
+		chip8.Seed(seed);
+	chip8.SetQuirks(quirks);
+	chip8.SetIdleSkipping(skipIdle);
+	if (!chip8.SetExecutionMode(mode)) {
+		printf("Execution mode not supported on this host\n");
+		return 1;
+	}
+	if (chip8.GetJIT() != nullptr)
+		chip8.GetJIT()->SetCrossCheck(crossCheck);
+	HeadlessVM vm(&chip8);
+	if (error == ROMLoader::Error::NONE)
+		error = vm.Load(image);
+	if (error != ROMLoader::Error::NONE) {
+		printf("Could not load %s: %s\n", roms[0], ROMLoader::GetErrorName(error));
+		return 1;
+	}
+	Chip8AOT aot;
+	if (aotFile != nullptr) {
+		Chip8AOT::Error aotError = aot.Open(aotFile);
+		if (aotError != Chip8AOT::Error::NONE) {
+			printf("%s %s\n", aotFile, Chip8AOT::GetErrorName(aotError));
+			return 1;
+		}
+		if (mode == Chip8::ExecutionMode::INTERPRETER || !chip8.SetAOT(&aot)) {
+			printf("%s wasn't made for this ROM and these quirks, or the mode doesn't translate blocks\n", aotFile);
+			return 1;
+		}
+	}
+	if (catalogFile != nullptr) {
+		if (mode != Chip8::ExecutionMode::INTERPRETER) {
+			size_t translated = ROMCatalog::Precompile(entry, chip8);
+			printf("Precompiled %llu blocks (%llu instructions)\n",
+				static_cast<unsigned long long>(translated), static_cast<unsigned long long>(entry.instructionCount));
+		}
+		printf("Quirk-sensitive instructions:");
+		for (uint32_t bit = 0; bit < ROMCatalog::QUIRK_USE_COUNT; bit++)
+		{
+			if (entry.quirks & (1u << bit))
+				printf(" %s", ROMCatalog::GetQuirkUseName(static_cast<ROMCatalog::QuirkUse>(1u << bit)));
+		}
+		printf("%s\n", entry.quirks == 0 ? " none" : "");
+		if (!SaveCatalog(catalog, catalogFile))
+			return 1;
+	}
+	vm.GetScheduler().SetInstructionsPerSecond(ips);
+	vm.GetPeripherals().SetKeyState(keys);
+	try {
+		if (stateCheck)
+			return CheckSaveState(vm, chip8, cycles);
+		if (rewindCheck)
+			return CheckRewind(vm, chip8, cycles);
+	}
+	catch (const std::exception& e) {
+		printf("Emulation stopped: %s\n", e.what());
+		return 1;
+	}
+#ifdef MOTE_TRACE
+	Tracer tracer;
+	if (trace != nullptr) {
+		if (!tracer.Open(trace, Hash::Fnv1a(image.GetData(), image.GetSize()), quirks)) {
+			printf("Could not write %s\n", trace);
+			return 1;
+		}
+		chip8.SetTracer(&tracer);
+	}
+#endif // MOTE_TRACE
+
+	auto start = std::chrono::steady_clock::now();
+	size_t executed = 0;
+	try {
+		executed = vm.Run(cycles);
+	}
+	catch (const std::exception& e) {
+		printf("Emulation stopped: %s\n", e.what());
+		return 1;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+#ifdef MOTE_TRACE
+	if (trace != nullptr) {
+		chip8.SetTracer(nullptr);
+		if (!tracer.Close()) {
+			printf("Could not write %s\n", trace);
+			return 1;
+		}
+		printf("Trace: %llu records, the emulation waited for the writer %llu times\n",
+			static_cast<unsigned long long>(tracer.GetStats().records), static_cast<unsigned long long>(tracer.GetStats().stalls));
+	}
+#endif // MOTE_TRACE
+
+	double seconds = elapsed.count();
+	printf("Executed %llu instructions in %.3f s (%.2f MIPS)%s\n",
+		static_cast<unsigned long long>(executed), seconds,
+		seconds > 0 ? executed / seconds / 1e6 : 0.0,
+		executed < cycles ? ", program ended" : "");
+	uint64_t emulated = vm.GetScheduler().GetStats().frames;
+	printf("Emulated %llu frames at %u instructions per second (%.4f ms per frame)\n",
+		static_cast<unsigned long long>(emulated), ips, emulated ? seconds * 1000.0 / emulated : 0.0);
+	PrintIdleCycles(chip8, executed);
+	if (mode != Chip8::ExecutionMode::INTERPRETER) {
+		const Chip8::InstructionCache::Stats& stats = chip8.GetCacheStats();
+		printf("Block cache: %llu hits, %llu misses, %llu invalidations (%.2f%% hit rate)\n",
+			static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+			static_cast<unsigned long long>(stats.invalidations), stats.HitRate() * 100.0);
+	}
+	if (chip8.GetJIT() != nullptr) {
+		const Chip8JIT::Stats& stats = chip8.GetJIT()->GetStats();
+		printf("JIT: %llu blocks compiled, %llu native instructions (%.2f%%), %llu cache flushes",
+			static_cast<unsigned long long>(stats.compiledBlocks), static_cast<unsigned long long>(stats.nativeInstructions),
+			executed ? stats.nativeInstructions * 100.0 / executed : 0.0, static_cast<unsigned long long>(stats.cacheFlushes));
+		if (crossCheck)
+			printf(", %llu mismatches", static_cast<unsigned long long>(stats.mismatches));
+		printf("\n");
+	}
+	if (aotFile != nullptr && chip8.GetJIT() == nullptr) {
+		printf("AOT: %llu blocks in the module, %llu native instructions (%.2f%%)\n",
+			static_cast<unsigned long long>(aot.GetModule().blockCount), static_cast<unsigned long long>(chip8.GetAOTInstructions()),
+			executed ? chip8.GetAOTInstructions() * 100.0 / executed : 0.0);
+	}
+#ifdef MOTE_PROFILE
+	if (profile != nullptr) {
+		const ExecutionProfile::Counters& counters = chip8.GetProfile().GetCounters();
+		printf("Profile: %llu draws, %llu clears, %.2f%% of the instructions waiting on the delay timer\n",
+			static_cast<unsigned long long>(counters.draws), static_cast<unsigned long long>(counters.clears),
+			counters.TimerWaitFraction() * 100.0);
+		if (!chip8.GetProfile().Save(profile)) {
+			printf("Could not write %s\n", profile);
+			return 1;
+		}
+	}
+	if (folded != nullptr) {
+		const CallProfile& calls = chip8.GetProfile().GetCalls();
+		std::ofstream file(folded);
+		calls.WriteFolded(file);
+		if (!file.good()) {
+			printf("Could not write %s\n", folded);
+			return 1;
+		}
+		calls.WriteTop(std::cout, top != nullptr ? static_cast<size_t>(strtoull(top, nullptr, 0)) : 10);
+	}
+#endif // MOTE_PROFILE
+	if (dump)
+		DumpFramebuffer(vm.GetPeripherals().GetDisplay());
+	return 0;
+}
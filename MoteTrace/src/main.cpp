@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TraceFile.h"
+
+// Turns the traces written by MoteEmuCLI --trace into a readable disassembly,
+// or compares two of them and shows where they part ways.
+
+static void PrintUsage(const char* program)
+{
+	printf("Usage: %s <trace> [options]\n", program);
+	printf("       %s --diff <trace> <trace> [options]\n", program);
+	printf("  --from N     First cycle printed (default: 0)\n");
+	printf("  --count N    Number of records printed (default: all)\n");
+	printf("  --context N  Records printed before the first difference (default: 8)\n");
+}
+
+static void PrintRecord(const TraceFile& trace, const size_t& index, const char* marker)
+{
+	const TraceFile::Record& record = trace.GetRecords()[index];
+	printf("%s%12llu  %03X  %04X  %-18s %s\n", marker, static_cast<unsigned long long>(trace.GetCycle(index)),
+		record.pc, record.opcode, TraceFile::Disassemble(record.opcode).c_str(), TraceFile::FormatEffects(record).c_str());
+}
+
+static void PrintHeader(const char* filename, const TraceFile& trace)
+{
+	printf("%s: %llu records, ROM %016llx, quirks %u\n", filename, static_cast<unsigned long long>(trace.GetCount()),
+		static_cast<unsigned long long>(trace.GetHeader().romHash), trace.GetHeader().quirks);
+}
+
+static int Disassemble(const char* filename, const size_t& from, const size_t& count)
+{
+	TraceFile trace;
+	if (!trace.Open(filename)) {
+		printf("%s isn't a trace of this version\n", filename);
+		return 1;
+	}
+	PrintHeader(filename, trace);
+	size_t end = std::min(trace.GetCount(), count == 0 ? trace.GetCount() : from + count);
+	for (size_t i = from; i < end; i++)
+		PrintRecord(trace, i, "  ");
+	return 0;
+}
+
+// Both traces start at cycle 0, so records are compared by position
+static int Diff(const char* firstName, const char* secondName, const size_t& context)
+{
+	TraceFile first;
+	TraceFile second;
+	if (!first.Open(firstName)) {
+		printf("%s isn't a trace of this version\n", firstName);
+		return 1;
+	}
+	if (!second.Open(secondName)) {
+		printf("%s isn't a trace of this version\n", secondName);
+		return 1;
+	}
+	PrintHeader(firstName, first);
+	PrintHeader(secondName, second);
+
+	size_t common = std::min(first.GetCount(), second.GetCount());
+	size_t index = 0;
+	while (index < common && TraceFile::Matches(first.GetRecords()[index], second.GetRecords()[index]))
+		index++;
+	if (index == common) {
+		if (first.GetCount() == second.GetCount()) {
+			printf("Identical\n");
+			return 0;
+		}
+		printf("Identical for %llu records, then only %s goes on\n", static_cast<unsigned long long>(common),
+			first.GetCount() > common ? firstName : secondName);
+		return 1;
+	}
+
+	size_t differing = 0;
+	for (size_t i = index; i < common; i++)
+	{
+		if (!TraceFile::Matches(first.GetRecords()[i], second.GetRecords()[i]))
+			differing++;
+	}
+	printf("First difference at cycle %llu (%llu of %llu common records differ)\n",
+		static_cast<unsigned long long>(first.GetCycle(index)), static_cast<unsigned long long>(differing),
+		static_cast<unsigned long long>(common));
+	for (size_t i = index - std::min(index, context); i < index; i++)
+		PrintRecord(first, i, "  ");
+	PrintRecord(first, index, "< ");
+	PrintRecord(second, index, "> ");
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	std::vector<const char*> traces;
+	bool diff = false;
+	size_t from = 0;
+	size_t count = 0;
+	size_t context = 8;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--diff") == 0)
+			diff = true;
+		else if (strcmp(argv[i], "--from") == 0 && hasValue)
+			from = strtoull(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "--count") == 0 && hasValue)
+			count = strtoull(argv[++i], nullptr, 0);
+		else if (strcmp(argv[i], "--context") == 0 && hasValue)
+			context = strtoull(argv[++i], nullptr, 0);
+		else if (argv[i][0] != '-')
+			traces.push_back(argv[i]);
+		else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (traces.size() != (diff ? 2u : 1u)) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	if (diff)
+		return Diff(traces[0], traces[1], context);
+	return Disassemble(traces[0], from, count);
+}
@@ -1,6 +1,32 @@
 -- Global variables
 outputdir = "%{cfg.buildcfg}_%{cfg.system}_%{cfg.architecture}"
 inputdir = "%{prj.name}/src"
+coredir = "MoteEmu/src"
+
+-- Build options
+newoption
+{
+    trigger = "map-dispatch",
+    description = "Dispatch opcodes through the legacy hash map instead of the decode table"
+}
+
+newoption
+{
+    trigger = "profile",
+    description = "Count executions per instruction and address (adds a check to every instruction)"
+}
+
+newoption
+{
+    trigger = "trace",
+    description = "Let MoteEmuCLI --trace record every executed instruction (adds a check to every instruction)"
+}
+
+newoption
+{
+    trigger = "avx2",
+    description = "Let the compiler use AVX2 (the lockstep interpreter's lane loops benefit the most)"
+}
 
 -- Workspace definition (applies to all projects)
 workspace "MoteEmu"
@@ -43,17 +69,125 @@ workspace "MoteEmu"
         cppdialect "C++17"
         systemversion "latest"
 
+    filter "system:linux"
+        cppdialect "C++17"
+        links { "pthread", "dl" }
+
+    filter "action:vs*"
+        -- The opcode decode table is generated by a 64K iteration constexpr loop
+        buildoptions { "/constexpr:steps4194304" }
+
+    filter "options:map-dispatch"
+        defines { "MOTE_MAP_DISPATCH" }
+
+    filter "options:profile"
+        defines { "MOTE_PROFILE" }
+
+    filter "options:trace"
+        defines { "MOTE_TRACE" }
+
+    filter "options:avx2"
+        vectorextensions "AVX2"
+
 
 -- Project definitions
 project "MoteEmu"
     location "MoteEmu"
 
     includedirs { "vendor/SDL2/include" }
-    links { "SDL2", "SDL2main" }
 
-    filter "platforms:x86"
+    filter "system:windows"
+        links { "SDL2", "SDL2main" }
+
+    filter "system:linux"
+        links { "SDL2" }
+
+    filter { "system:windows", "platforms:x86" }
         libdirs { "vendor/SDL2/lib/x86" }
 
-    filter "platforms:x64"
+    filter { "system:windows", "platforms:x64" }
         libdirs { "vendor/SDL2/lib/x64" }
-        
\ No newline at end of file
+
+-- Runs ROMs without a window (no SDL dependency)
+project "MoteEmuCLI"
+    location "MoteEmuCLI"
+    kind "ConsoleApp"
+
+    files
+    {
+        coredir .. "/*.h",
+        coredir .. "/*.cpp"
+    }
+
+    removefiles
+    {
+        coredir .. "/main.cpp",
+        coredir .. "/test.h",
+        coredir .. "/SDLAPI.*",
+        coredir .. "/VM.*"
+    }
+
+    includedirs { coredir }
+
+-- Microbenchmarks of the emulator core, results as JSON
+project "MoteEmuBench"
+    location "MoteEmuBench"
+    kind "ConsoleApp"
+
+    files
+    {
+        coredir .. "/*.h",
+        coredir .. "/*.cpp"
+    }
+
+    removefiles
+    {
+        coredir .. "/main.cpp",
+        coredir .. "/test.h",
+        coredir .. "/SDLAPI.*",
+        coredir .. "/VM.*"
+    }
+
+    includedirs { coredir }
+
+-- Disassembles and diffs the traces written by MoteEmuCLI --trace
+project "MoteTrace"
+    location "MoteTrace"
+    kind "ConsoleApp"
+
+    files
+    {
+        coredir .. "/*.h",
+        coredir .. "/*.cpp"
+    }
+
+    removefiles
+    {
+        coredir .. "/main.cpp",
+        coredir .. "/test.h",
+        coredir .. "/SDLAPI.*",
+        coredir .. "/VM.*"
+    }
+
+    includedirs { coredir }
+
+-- Translates a ROM into a shared library of native blocks for MoteEmuCLI --aot
+project "MoteAOT"
+    location "MoteAOT"
+    kind "ConsoleApp"
+
+    files
+    {
+        coredir .. "/*.h",
+        coredir .. "/*.cpp"
+    }
+
+    removefiles
+    {
+        coredir .. "/main.cpp",
+        coredir .. "/test.h",
+        coredir .. "/SDLAPI.*",
+        coredir .. "/VM.*"
+    }
+
+    includedirs { coredir }